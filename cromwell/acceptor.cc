@@ -2,18 +2,274 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <stdexcept>
+#include <string>
 
-#include "event_loop.h"
 #include "channel.h"
-#include "socket.h"
+#include "event_loop.h"
+#include "event_loop_thread_pool.h"
+#include "sema.h"
 #include "socket_opt.h"
 
 namespace cromwell {
 
+// A listening socket and the loop accepting on it.
+struct Acceptor::Listener {
+  Listener(EventLoop& l, int fd)
+    : loop(&l),
+    socket(fd),
+    idle_fd(open("/dev/null", O_RDONLY | O_CLOEXEC)) {
+
+    }
+  ~Listener() {
+    if (idle_fd >= 0) close(idle_fd);
+  }
+
+  EventLoop* loop;
+  Socket socket;
+  std::unique_ptr<Channel> channel;
+  int idle_fd; // spent to shed a connection when out of fds
+};
+
+// An fd on its way to a worker loop.
+struct Acceptor::AcceptedFd {
+  int fd;
+  int port;
+  char ip[46];
+};
+
+const int Acceptor::kDefaultBatch = 64;
+
 Acceptor::Acceptor(EventLoop& loop, const char* ip, int port, bool reuseport)
   : loop_(loop),
-  accept_socket_(-1),
-  acc{
+  port_(port),
+  listen_fd_(-1),
+  reuseport_(reuseport),
+  per_loop_(false),
+  steer_by_cpu_(false),
+  batch_(kDefaultBatch),
+  fastopen_qlen_(0),
+  defer_accept_(0),
+  pool_(nullptr),
+  listening_(false),
+  accepted_(0) {
+  ip_[0] = '\0';
+  path_[0] = '\0';
+  if (ip) {
+    strncpy(ip_, ip, sizeof(ip_) - 1);
+    ip_[sizeof(ip_) - 1] = '\0';
+  }
+}
+
+Acceptor::Acceptor(EventLoop& loop, const char* path)
+  : loop_(loop),
+  port_(0),
+  listen_fd_(-1),
+  reuseport_(false),
+  per_loop_(false),
+  steer_by_cpu_(false),
+  batch_(kDefaultBatch),
+  fastopen_qlen_(0),
+  defer_accept_(0),
+  pool_(nullptr),
+  listening_(false),
+  accepted_(0) {
+  ip_[0] = '\0';
+  strncpy(path_, path, sizeof(path_) - 1);
+  path_[sizeof(path_) - 1] = '\0';
+}
+
+Acceptor::~Acceptor() {
+  if (listen_fd_ >= 0) close(listen_fd_);
+  if (!listeners_.empty() && listeners_[0]->loop != &loop_) pool_->RemoveThreadExitCallback(this);
+  for (size_t i = 0; i < listeners_.size(); ++i) {
+    Unregister(listeners_[i].get());
+  }
+}
+
+bool Acceptor::Listen() {
+  loop_.AssertInLoopThread();
+  if (listening_) return true;
+
+  std::vector<EventLoop*> loops(1, &loop_);
+  if (per_loop_ && !path_[0] && listen_fd_ < 0 && pool_ && pool_->Started())
+    loops = pool_->GetAllLoops();
+  // Opened here in order, so listener i is index i of the reuseport group.
+  bool reuseport = reuseport_ || loops.size() > 1;
+  for (size_t i = 0; i < loops.size(); ++i) {
+    if (!OpenListener(*loops[i], reuseport)) {
+      listeners_.clear();
+      return false;
+    }
+  }//end-for.
+  if (loops.size() > 1 && steer_by_cpu_ &&
+      reuse_port_steer_cpu(nullptr, listeners_[0]->socket.SocketId(),
+        static_cast<int>(loops.size())) == -1) {
+    listeners_.clear();
+    return false;
+  }
+
+  if (listeners_[0]->loop != &loop_) {
+    pool_->AddThreadExitCallback(this, [this](EventLoop& loop) { RemoveListeners(loop); });
+  }
+  for (size_t i = 0; i < listeners_.size(); ++i) {
+    Listener* listener = listeners_[i].get();
+    if (listener->loop == &loop_) {
+      if (!Register(listener)) {
+        listeners_.clear();
+        return false;
+      }
+      continue;
+    }
+    listener->loop->QueueInLoop([this, listener]() {
+      // Unable to watch it: close it so the kernel stops choosing it.
+      if (!Register(listener)) listener->socket.Close();
+    });
+  }//end-for.
+  listening_ = true;
+  return true;
+}
+
+bool Acceptor::OpenListener(EventLoop& loop, bool reuseport) {
+  if (listen_fd_ >= 0) {
+    std::unique_ptr<Listener> listener(new Listener(loop, listen_fd_));
+    listen_fd_ = -1;
+    if (nonblock(nullptr, listener->socket.SocketId()) == -1) return false;
+    listeners_.push_back(std::move(listener));
+    return true;
+  }
+  std::unique_ptr<Listener> listener(new Listener(loop, -1));
+  if (path_[0]) {
+    if (!listener->socket.ListenUnix(path_)) return false;
+    listeners_.push_back(std::move(listener));
+    return true;
+  }
+  if (!listener->socket.Listen(ip_[0] ? ip_ : nullptr, static_cast<uint16_t>(port_), reuseport))
+    return false;
+  if (fastopen_qlen_ > 0 && !listener->socket.SetFastOpen(fastopen_qlen_))
+    return false;
+  if (defer_accept_ > 0 && !listener->socket.SetDeferAccept(defer_accept_))
+    return false;
+  listeners_.push_back(std::move(listener));
+  return true;
+}
+
+int Acceptor::ListenFd() const {
+  return listeners_.empty() ? -1 : listeners_[0]->socket.SocketId();
+}
+
+// In the listener's loop.
+bool Acceptor::Register(Listener* listener) {
+  listener->channel.reset(new Channel(*listener->loop, listener->socket.SocketId()));
+  listener->channel->SetReadCallback([this, listener](long long receive_time) {
+    HandleRead(listener);
+  });
+  try {
+    listener->channel->EnableReading();
+  } catch (const std::runtime_error&) {
+    listener->channel->DisableAll();
+    listener->channel->Remove();
+    listener->channel.reset();
+    return false;
+  }
+  return true;
+}
+
+// A listener on a worker loop is removed there, and we wait for it: an
+// accept may be running on it right now.
+void Acceptor::Unregister(Listener* listener) {
+  // The loop is gone, RemoveListeners took care of it.
+  if (listener->loop != &loop_ && !(pool_ && pool_->Started())) return;
+  SemaType done(0);
+  listener->loop->RunInLoop([listener, &done]() {
+    if (listener->channel) {
+      listener->channel->DisableAll();
+      listener->channel->Remove();
+      listener->channel.reset();
+    }
+    done.Post();
+  });
+  done.Wait(-1);
+}
+
+// A worker loop of the pool quit while we still listen there: the channel
+// goes while the loop is alive, and the socket with it, so the kernel
+// stops choosing it.
+void Acceptor::RemoveListeners(EventLoop& loop) {
+  for (size_t i = 0; i < listeners_.size(); ++i) {
+    Listener* listener = listeners_[i].get();
+    if (listener->loop != &loop) continue;
+    if (listener->channel) {
+      listener->channel->DisableAll();
+      listener->channel->Remove();
+      listener->channel.reset();
+    }
+    listener->socket.Close();
+  }//end-for.
+}
+
+void Acceptor::HandleRead(Listener* listener) {
+  // Connections for other loops, sent as one task per loop at the end.
+  std::vector<std::pair<EventLoop*, std::shared_ptr<std::vector<AcceptedFd> > > > handoffs;
+
+  for (int i = 0; i < batch_; ++i) {
+    AcceptedFd conn;
+    conn.port = 0;
+    conn.fd = listener->socket.Accept(conn.ip, sizeof(conn.ip), &conn.port);
+    if (conn.fd < 0) {
+      if (errno == ECONNABORTED || errno == EPROTO) continue;
+      // Out of fds: the connection would keep the listener readable and
+      // the loop busy. Spend the spare fd to accept and drop it.
+      if ((errno == EMFILE || errno == ENFILE) && listener->idle_fd >= 0) {
+        close(listener->idle_fd);
+        listener->idle_fd = ::accept(listener->socket.SocketId(), nullptr, nullptr);
+        if (listener->idle_fd >= 0) close(listener->idle_fd);
+        listener->idle_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+      }
+      break; // EAGAIN: the backlog is empty
+    }
+    __atomic_add_fetch(&accepted_, 1, __ATOMIC_RELAXED);
+
+    EventLoop* io_loop = listener->loop;
+    if (io_loop == &loop_ && pool_) io_loop = pool_->GetNextLoop();
+    if (io_loop == listener->loop) {
+      NewConnection(*io_loop, conn.fd, conn.ip, conn.port);
+      continue;
+    }
+    // Counted as load right away so least-load does not pick the same loop
+    // for every connection of a burst.
+    io_loop->AddPending(1);
+    size_t k = 0;
+    while (k < handoffs.size() && handoffs[k].first != io_loop) ++k;
+    if (k == handoffs.size()) {
+      handoffs.push_back(std::make_pair(io_loop, std::make_shared<std::vector<AcceptedFd> >()));
+    }
+    handoffs[k].second->push_back(conn);
+  }//end-for.
+
+  for (size_t k = 0; k < handoffs.size(); ++k) {
+    EventLoop* io_loop = handoffs[k].first;
+    std::shared_ptr<std::vector<AcceptedFd> > conns = handoffs[k].second;
+    io_loop->QueueInLoop([this, io_loop, conns]() {
+      for (size_t j = 0; j < conns->size(); ++j) {
+        const AcceptedFd& conn = (*conns)[j];
+        io_loop->AddPending(-1);
+        NewConnection(*io_loop, conn.fd, conn.ip, conn.port);
+      }
+    });
+  }//end-for.
+}
+
+void Acceptor::NewConnection(EventLoop& loop, int sockfd, const char* ip, int port) {
+  if (new_conn_cb_) {
+    new_conn_cb_(loop, sockfd, ip, port);
+  } else {
+    socket_close(sockfd);
+  }
 }
 
 }//end-cromwell.
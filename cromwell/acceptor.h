@@ -2,37 +2,125 @@
 #define _CROMWELL_ACCEPTOR_H
 
 #include <functional>
+#include <memory>
+#include <vector>
+
+#include "noncopyable.h"
+#include "socket.h"
 
 namespace cromwell {
 
-class EventLoop;
 class Channel;
-class Socket;
+class EventLoop;
+class EventLoopThreadPool;
 
-class Acceptor : std::noncopyable {
+// Listens on ip:port in loop and hands every accepted, non-blocking fd to
+// the new connection callback. With a worker pool the fd is passed to the
+// loop chosen by the pool and the callback runs there, so one acceptor
+// feeds every reactor. The acceptor must outlive the worker loops.
+//
+// Each wakeup accepts until the backlog is empty or the batch is used up,
+// and fds bound for the same worker travel in one task.
+//
+// With a listener per loop every worker loop gets its own SO_REUSEPORT
+// listener and accepts for itself: no fd crosses threads and the kernel
+// spreads the connections over the listeners.
+//
+// The listener may also be an AF_UNIX path, or a listening socket handed
+// over by another process, e.g. by the binary being upgraded, see
+// SetListenFd and FdChannel.
+class Acceptor : noncopyable {
 public:
-  typedef std::function<void (sockfd, const char* ip, int port)> NewConnectionCallback;
+  typedef std::function<void (EventLoop& loop, int sockfd, const char* ip, int port)> NewConnectionCallback;
 
   Acceptor(EventLoop& loop, const char* ip, int port, bool reuseport);
+  // AF_UNIX stream listener on path, '@' first for the abstract namespace.
+  // Connections come with ip "/unixsocket" and port 0.
+  Acceptor(EventLoop& loop, const char* path);
   ~Acceptor();
 
   void SetNewConnectionCallback(const NewConnectionCallback& cb) {
     new_conn_cb_ = cb;
   }
+  void SetWorkerPool(EventLoopThreadPool* pool) {
+    pool_ = pool;
+  }
+  // Connections accepted per wakeup at most, 64 by default; the rest wait
+  // for the next iteration so the loop gets to its other fds.
+  void SetAcceptBatch(int batch) {
+    batch_ = batch > 0 ? batch : 1;
+  }
+  // One listener per loop of the started worker pool instead of one that
+  // hands fds out. By default the kernel picks the listener by hashing the
+  // connection; with steer_by_cpu by the cpu that received the SYN, which
+  // is the cpu of loop i when the pool pins loop i to cpu i, its default.
+  // Before Listen. If the pool stops first, each worker loop closes its
+  // listener on the way out.
+  void SetListenerPerLoop(bool on, bool steer_by_cpu = false) {
+    per_loop_ = on;
+    steer_by_cpu_ = steer_by_cpu;
+  }
+
+  // TCP Fast Open on the listeners, qlen fast opens pending at most, 0
+  // for none (the default). A client holding a cookie then sends its
+  // request in the SYN. Also needs the server bit (2) of
+  // net.ipv4.tcp_fastopen. Before Listen.
+  void SetFastOpen(int qlen) {
+    fastopen_qlen_ = qlen;
+  }
+  // TCP_DEFER_ACCEPT: the listener is readable only once a connection
+  // has data, so the loop wakes up to read rather than to accept and wait.
+  // Connections silent for about seconds are dropped. Before Listen.
+  void SetDeferAccept(int seconds) {
+    defer_accept_ = seconds;
+  }
+
+  // Accept on fd, an already listening socket, instead of opening one;
+  // the acceptor owns it from here on. No listener per loop then. Before
+  // Listen.
+  void SetListenFd(int fd) {
+    listen_fd_ = fd;
+  }
 
   bool Listening() const { return listening_; }
-  void Listen();
+  bool Listen();
+  // The listening socket, e.g. to pass on to a new binary; -1 before
+  // Listen. With a listener per loop, the one of the base loop.
+  int ListenFd() const;
+  // Connections accepted so far, over all listeners.
+  long long Accepted() const { return __atomic_load_n(&accepted_, __ATOMIC_RELAXED); }
+
+private:
+  struct Listener;
+  struct AcceptedFd;
+
+  bool OpenListener(EventLoop& loop, bool reuseport);
+  bool Register(Listener* listener);
+  void Unregister(Listener* listener);
+  void RemoveListeners(EventLoop& loop);
+  void HandleRead(Listener* listener);
+  void NewConnection(EventLoop& loop, int sockfd, const char* ip, int port);
 
 private:
-  void HandleRead();
+  static const int kDefaultBatch;
 
 private:
   EventLoop& loop_;
-  Socket accept_socket_;
-  Channel accept_channal_;
+  char ip_[46];
+  int port_;
+  char path_[108]; // sun_path, empty for TCP
+  int listen_fd_;
+  bool reuseport_;
+  bool per_loop_;
+  bool steer_by_cpu_;
+  int batch_;
+  int fastopen_qlen_;
+  int defer_accept_;
+  std::vector<std::unique_ptr<Listener> > listeners_;
+  EventLoopThreadPool* pool_;
   NewConnectionCallback new_conn_cb_;
   bool listening_;
-  int idle_fd_;
+  long long accepted_;
 };
 
 }//end-cromwell.
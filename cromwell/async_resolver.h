@@ -0,0 +1,24 @@
+#ifndef __CROMWELL_ASYNC_RESOLVER_H
+#define __CROMWELL_ASYNC_RESOLVER_H
+
+#include <functional>
+
+namespace cromwell {
+
+// Name resolution that does not block the loop, for Connector and
+// UpstreamPool. One per loop; examples/cdns has one on c-ares.
+class AsyncResolver {
+public:
+  // The address as text, NULL if the name did not resolve.
+  typedef std::function<void(const char* ip)> Callback;
+
+  virtual ~AsyncResolver() {}
+
+  // Loop thread. cb runs in the loop, possibly before Resolve returns
+  // when the answer is cached.
+  virtual void Resolve(const char* host, const Callback& cb) = 0;
+};
+
+}//end-cromwell.
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef __CROMWELL_BUFFER_BUDGET_H
+#define __CROMWELL_BUFFER_BUDGET_H
+
+#include <stddef.h>
+
+#include "noncopyable.h"
+
+namespace cromwell {
+
+// A ceiling on the bytes buffered by a set of connections, typically all
+// of a process. Connections charge what sits in their input and output
+// buffers; while the total is over the limit they stop reading, which
+// lets TCP flow control slow the peers producing the data, and resume
+// once it fell back below seven eighths of it. Any thread.
+class BufferBudget : noncopyable {
+public:
+  // 0 for no limit, charges are still counted.
+  explicit BufferBudget(size_t limit, double retry_seconds = 0.005)
+    : limit_(limit),
+    used_(0),
+    peak_(0),
+    retry_seconds_(retry_seconds) {
+
+    }
+
+  void Charge(long long delta) {
+    long long used = __atomic_add_fetch(&used_, delta, __ATOMIC_RELAXED);
+    long long peak = __atomic_load_n(&peak_, __ATOMIC_RELAXED);
+    while (used > peak &&
+        !__atomic_compare_exchange_n(&peak_, &peak, used, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+  }
+
+  bool Over() const {
+    size_t limit = Limit();
+    return limit != 0 && Used() >= limit;
+  }
+  bool Relieved() const {
+    size_t limit = Limit();
+    return limit == 0 || Used() < limit - limit / 8;
+  }
+
+  size_t Limit() const { return __atomic_load_n(&limit_, __ATOMIC_RELAXED); }
+  void SetLimit(size_t limit) { __atomic_store_n(&limit_, limit, __ATOMIC_RELAXED); }
+  size_t Used() const {
+    long long used = __atomic_load_n(&used_, __ATOMIC_RELAXED);
+    return used > 0 ? static_cast<size_t>(used) : 0;
+  }
+  size_t Peak() const {
+    return static_cast<size_t>(__atomic_load_n(&peak_, __ATOMIC_RELAXED));
+  }
+  // How long a paused connection waits before checking again.
+  double RetrySeconds() const { return retry_seconds_; }
+
+private:
+  size_t limit_;
+  long long used_;
+  long long peak_;
+  double retry_seconds_;
+};
+
+}//end-cromwell.
+
+#endif
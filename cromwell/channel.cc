@@ -1,21 +1,20 @@
 #include "channel.h"
 
-#include "macros.h"
+#include <assert.h>
+
+#include "event_loop.h"
 
 namespace cromwell {
 
-const int Channel::kNoneEvent = 0;
-const int Channel::kReadEvent = POLLIN | POLLPRI;
-const int Channel::kWriteEvent = POLLOUT;
+const int Channel::kNoneEvent = SE_NONE;
+const int Channel::kReadEvent = SE_READABLE;
+const int Channel::kWriteEvent = SE_WRITABLE;
 
 Channel::Channel(EventLoop& loop, int fd)
 : loop_(loop),
   fd_(fd),
   events_(0),
-  revents_(0),
-  index_(-1),
-  log_hup_(true),
-  tied_(false),
+  tie_(nullptr),
   event_handling_(false),
   add_to_loop_(false) {
 
@@ -29,11 +28,6 @@ Channel::~Channel() {
   }
 }
 
-void Channel::Tie(const std::shared_ptr<void>& obj) {
-  tie_ = obj;
-  tied_ = true;
-}
-
 void Channel::Update() {
   add_to_loop_ = true;
   loop_.UpdateChannel(this);
@@ -45,54 +39,27 @@ void Channel::Remove() {
   loop_.RemoveChannel(this);
 }
 
-void Channel::HandleEvent(Timestamp receive_time) {
-  std::shared_ptr<void> guard;
-  if (tied_) {
-    guard = tie_.lock();
-    if (guard) {
-      HandleEventWithGuard(receive_time);
-    }
-  }else {
-    HandleEventWithGuard(receive_time);
-  }
+void Channel::OnEvent(SeEventLoop* loop, int fd, void* client, int mask) {
+  static_cast<Channel*>(client)->HandleEvent(mask, SeGetLoopTime(loop));
 }
 
-void Channel::HandleEventWithGuard(Timestamp receive_time) {
-  event_handling = true;
-  if ((revents_ & POLLHUP) && !(reevents_ & POLLIN)) {
-    if (log_hup_) {}
-    if (close_cb_) close_cb_();
-  }
-
-  if (revents_ & POLLNVAL) {
-    LOG_WARN("Channel::handle_event POLLNVAL");
-  }
-
-  if (revents_ & (POLLERR | POLLNVAL)) {
-    if (error_cb_) error_cb_();
-  }
-  if (revents_ & (POLLIN | POLLPRI | POLLRDHUP)) {
-    if (read_cb_) read_cb_();
+void Channel::HandleEvent(int revents, long long receive_time) {
+  if (tie_) {
+    // The guard may delete the owner, and this channel with it, on the
+    // way out: nothing may touch members after the call.
+    RefPtr<const RefCounted> guard(tie_);
+    HandleEventWithGuard(revents, receive_time);
+  } else {
+    HandleEventWithGuard(revents, receive_time);
   }
-  if (revents_ & POLLOUT) {
-    if (write_cb_) write_cb_();
-  }
-
-  event_handling_ = false;
 }
 
-std::string Channel::ReventsToString() const {
-  std::ostringstream oss;
-  oss << fd_ << ": ";
-  if (revents_ & POLLIN) oss << "IN ";
-  if (revents_ & POLLPRI) oss << "PRI ";
-  if (revents_ & POLLOUT) oss << "OUT ";
-  if (revents_ & POLLHUP) oss << "HUP ";
-  if (revents_ & POLLRDHUP) oss << "RDHUP ";
-  if (revents_ & POLLERR) oss << "ERR ";
-  if (revents_ & POLLNVAL) oss << "NVAL ";
-
-  return oss.str();
+void Channel::HandleEventWithGuard(int revents, long long receive_time) {
+  event_handling_ = true;
+  if ((revents & kReadEvent) && read_cb_) read_cb_(receive_time);
+  // The read callback may have disabled writing, e.g. on close.
+  if ((revents & kWriteEvent) && (events_ & kWriteEvent) && write_cb_) write_cb_();
+  event_handling_ = false;
 }
 
 }//end-cromwell
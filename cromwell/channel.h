@@ -1,59 +1,63 @@
 #ifndef __CHANNEL_H
 #define __CHANNEL_H
 
-#include <function>
-#include <memory>
+#include "delegate.h"
+#include "noncopyable.h"
+#include "ref_counted.h"
+#include "se.h"
 
 namespace cromwell {
 
 class EventLoop;
 
-class Channel : std::noncopyable {
+// The events of one fd in one EventLoop, dispatched to inline delegates.
+// The channel does not own the fd. Hangups and errors come in as readable
+// and writable at once, so a channel that only reads still learns of EOF,
+// e.g. on a pipe whose writer closed; whichever callbacks are enabled see
+// them as a failing read or write. Loop thread only.
+class Channel : noncopyable {
 public:
-  typedef std::function<void(void)> EventCallback;
-  typedef std::function<void(Timestamp)> ReadEventCallback;
+  typedef Delegate<void()> EventCallback;
+  // receive_time: loop time of the wakeup, monotonic nanoseconds.
+  typedef Delegate<void(long long receive_time)> ReadEventCallback;
 
   Channel(EventLoop& loop, int fd);
   ~Channel();
 
-  void HandleEvent(Timestamp receive_time);
+  void HandleEvent(int revents, long long receive_time);
   void SetReadCallback(const ReadEventCallback& cb) {
     read_cb_ = cb;
   }
   void SetWriteCallback(const EventCallback& cb) {
     write_cb_ = cb;
   }
-  void SetCloseCallback(const EventCallback& cb) {
-    close_cb_ = cb;
-  }
-  void SetErrorCallback(const EventCallback& cb) {
-    error_cb_ = cb;
-  }
 
-  void Tie(const std::shared_ptr<void>&);
+  // Keep owner alive while a callback runs, so one that drops the last
+  // reference, e.g. on close, does not pull the channel out from under
+  // HandleEvent. The owner must outlive the channel's registration.
+  void Tie(const RefCounted* owner) { tie_ = owner; }
+
   int fd() const { return fd_; }
   int events() const { return events_; }
   bool IsNoneEvent() const { return events_ == kNoneEvent; }
 
-  void EnableReading() const { events_ |= kReadEvent; Update(); }
-  void DisableReading() const { events_ &= ~kReadEvent; Update(); }
-  void EnableWriting() const { events_ |= kWriteEvent; Update(); }
-  void DisableReading() const { events_ &= ~kWriteEvent; Update(); }
-  void DisableAll() const { events_ = kNoneEvent; Update(); }
-  bool IsWriting() const { return events_ & kWriteEvent; }
-
-  //For poll.
-  int Index() const { return index_; }
-  void SetIndex(int index) { index_ = index; }
-
-  void DoNotLogHup() { log_hup_ = false; }
+  void EnableReading() { events_ |= kReadEvent; Update(); }
+  void DisableReading() { events_ &= ~kReadEvent; Update(); }
+  void EnableWriting() { events_ |= kWriteEvent; Update(); }
+  void DisableWriting() { events_ &= ~kWriteEvent; Update(); }
+  void DisableAll() { events_ = kNoneEvent; Update(); }
+  bool IsWriting() const { return (events_ & kWriteEvent) != 0; }
+  bool IsReading() const { return (events_ & kReadEvent) != 0; }
 
   EventLoop& OwnerLoop() { return loop_; }
   void Remove();
 
+  // SE file event proc of every channel, client is the Channel.
+  static void OnEvent(SeEventLoop* loop, int fd, void* client, int mask);
+
 private:
   void Update();
-  void HandleEventWithGuard(Timestamp receive_time);
+  void HandleEventWithGuard(int revents, long long receive_time);
 
 private:
   static const int kNoneEvent;
@@ -64,19 +68,12 @@ private:
   EventLoop& loop_;
   const int fd_;
   int events_;
-  int revents_;
-  int index_;
-  bool log_hup_;
-
-  std::weak_ptr<void> tie_;
-  bool tied_;
+  const RefCounted* tie_;
   bool event_handling_;
   bool add_to_loop_;
 
   ReadEventCallback read_cb_;
   EventCallback write_cb_;
-  EventCallback close_cb_;
-  EventCallback error_cb_;
 };
 
 }//end-cromwell.
@@ -0,0 +1,79 @@
+#include "connection_pool.h"
+
+#include <string>
+#include <stdexcept>
+
+#include "event_loop.h"
+#include "tcp_connection.h"
+
+namespace cromwell {
+
+ConnectionPool::ConnectionPool(EventLoop& loop, uint32_t capacity)
+  : loop_(loop) {
+  if (!pool_.Initialize(static_cast<uint32_t>(sizeof(TcpConnection)), capacity)) {
+    throw std::runtime_error("ConnectionPool allocation failed.");
+  }
+}
+
+ConnectionPool::~ConnectionPool() {
+}
+
+TcpConnection* ConnectionPool::New(int sockfd, const char* peer_ip, int peer_port) {
+  loop_.AssertInLoopThread();
+  void* block = pool_.Alloc();
+  if (!block) return nullptr;
+  TcpConnection* conn;
+  try {
+    conn = new(block) TcpConnection(loop_, sockfd, peer_ip, peer_port);
+  } catch (...) {
+    pool_.Free(block);
+    throw;
+  }
+  conn->pool_ = this;
+  conn->handle_ = pool_.GetKey(block);
+  conn->AddRef();
+  return conn;
+}
+
+TcpConnection* ConnectionPool::Find(Handle handle) const {
+  return static_cast<TcpConnection*>(pool_.GetBlock(handle));
+}
+
+void ConnectionPool::Remove(TcpConnection* conn) {
+  loop_.AssertInLoopThread();
+  conn->ConnectDestroyed();
+  conn->Release();
+}
+
+// From the last Release.
+void ConnectionPool::Free(TcpConnection* conn) {
+  conn->~TcpConnection();
+  pool_.Free(conn);
+}
+
+void ConnectionPool::RunWith(Handle handle, const ConnectionFunctor& fn) {
+  if (loop_.IsInLoopThread()) {
+    TcpConnection* conn = Find(handle);
+    if (conn) fn(conn);
+    return;
+  }
+  loop_.QueueInLoop([this, handle, fn]() {
+    TcpConnection* conn = Find(handle);
+    if (conn) fn(conn);
+  });
+}
+
+void ConnectionPool::Send(Handle handle, const void* data, size_t len) {
+  if (loop_.IsInLoopThread()) {
+    TcpConnection* conn = Find(handle);
+    if (conn) conn->Send(data, len);
+    return;
+  }
+  std::string copy(static_cast<const char*>(data), len);
+  loop_.QueueInLoop([this, handle, copy]() {
+    TcpConnection* conn = Find(handle);
+    if (conn) conn->Send(copy.data(), copy.size());
+  });
+}
+
+}//end-cromwell.
@@ -0,0 +1,66 @@
+#ifndef __CROMWELL_CONNECTION_POOL_H
+#define __CROMWELL_CONNECTION_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <functional>
+
+#include "fixed_mempool.h"
+#include "mutex.h"
+#include "noncopyable.h"
+
+namespace cromwell {
+
+class EventLoop;
+class TcpConnection;
+
+// The connections of one loop, allocated from a FixedSizeMemPool. Each
+// one is known by its pool key, a Handle: other threads, timers and
+// worker replies keep the handle instead of a reference and resolve it in
+// the loop with Find, one array lookup that returns NULL once the
+// connection is gone, even if its slot was reused since. No atomic
+// reference traffic is involved.
+//
+// The pool holds one reference to every connection until Remove. The
+// pool and the references to its connections belong to the loop thread;
+// only RunWith and Send may be called from anywhere. Remove every
+// connection before destroying the pool.
+class ConnectionPool : noncopyable {
+public:
+  typedef uint64_t Handle;
+  typedef std::function<void(TcpConnection* conn)> ConnectionFunctor;
+
+  // Throws if the pool cannot be allocated.
+  ConnectionPool(EventLoop& loop, uint32_t capacity);
+  ~ConnectionPool();
+
+  // A new connection for sockfd, NULL if the pool is full.
+  TcpConnection* New(int sockfd, const char* peer_ip, int peer_port);
+  TcpConnection* Find(Handle handle) const;
+  // Unregister the connection and drop the pool's reference. It is freed
+  // as soon as nobody else holds one, e.g. a callback still running.
+  void Remove(TcpConnection* conn);
+
+  // Run fn on the connection in the loop, or not at all if it is gone by
+  // then. Any thread.
+  void RunWith(Handle handle, const ConnectionFunctor& fn);
+  // Copy data and send it on the connection. Any thread.
+  void Send(Handle handle, const void* data, size_t len);
+
+  EventLoop& GetLoop() const { return loop_; }
+  uint32_t Size() const { return pool_.GetUsedCount(); }
+  uint32_t Capacity() const { return pool_.GetBlockCount(); }
+
+private:
+  friend class TcpConnection;
+  void Free(TcpConnection* conn);
+
+private:
+  EventLoop& loop_;
+  FixedSizeMemPool<NullMutex, NullMutex> pool_;
+};
+
+}//end-cromwell.
+
+#endif
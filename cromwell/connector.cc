@@ -1,118 +1,193 @@
 #include "connector.h"
 
+#include <assert.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#include <algorithm>
+
+#include "async_resolver.h"
+#include "channel.h"
 #include "event_loop.h"
 #include "socket_opt.h"
 
-#include <errno.h>
-
 namespace cromwell {
 
 const int Connector::kMaxRetryDelayMs = 30 * 1000;
 const int Connector::kInitRetryDelayMs = 500;
+const long long Connector::kStableConnectionNs = 10 * 1000000000LL;
+
+static bool IsNumericHost(const char* host) {
+  unsigned char addr[sizeof(struct in6_addr)];
+  return inet_pton(AF_INET, host, addr) == 1 || inet_pton(AF_INET6, host, addr) == 1;
+}
 
 Connector::Connector(EventLoop& loop, const char* ip, int port)
   : loop_(loop),
-  port_(port),
+  server_port_(port),
+  unix_(false),
+  connect_(false),
+  fastopen_(false),
+  state_(kDisconnected),
+  retry_delay_ms_(kInitRetryDelayMs),
+  retry_timer_(-1),
+  connected_at_(0),
+  resolver_(nullptr) {
+  strncpy(server_ip_, ip, sizeof(server_ip_) - 1);
+  server_ip_[sizeof(server_ip_) - 1] = '\0';
+}
+
+Connector::Connector(EventLoop& loop, const char* path)
+  : loop_(loop),
+  server_port_(0),
+  unix_(true),
   connect_(false),
-  state_(kDisconnect) {
-  strncpy(server_ip_, 16, ip);
+  fastopen_(false),
+  state_(kDisconnected),
+  retry_delay_ms_(kInitRetryDelayMs),
+  retry_timer_(-1),
+  connected_at_(0),
+  resolver_(nullptr) {
+  strncpy(server_ip_, path, sizeof(server_ip_) - 1);
+  server_ip_[sizeof(server_ip_) - 1] = '\0';
 }
 
 Connector::~Connector() {
-  //To-Do.
+  assert(!channel_);
 }
 
 void Connector::Start() {
   connect_ = true;
-  loop_.Running(std::bind(&Connector::StartInLoop, this));
+  loop_.RunInLoop(std::bind(&Connector::StartInLoop, shared_from_this()));
 }
 
-//Action func for start.
 void Connector::StartInLoop() {
   loop_.AssertInLoopThread();
-  assert(state_ == kDisconnect);
-  if (connect_) {
+  retry_timer_ = -1;
+  if (connect_ && state_ == kDisconnected) {
     this->Connect();
-  }else {
-    //To-Do.
   }
 }
 
 void Connector::Stop() {
   connect_ = false;
-  loop_.QueueInLoop(std::bind(&Connector::StopInLoop, this));
-  //FIXME: unsafe, cancel time.
+  loop_.QueueInLoop(std::bind(&Connector::StopInLoop, shared_from_this()));
 }
 
-// Action Func for stop.
 void Connector::StopInLoop() {
   loop_.AssertInLoopThread();
-  if (state_ == kConnecting) {
-    SetState(kDisconnect);
-    int sockfd = this->RemoveAndResetChannel();
-    Retry(sockfd);
+  if (retry_timer_ != -1) {
+    loop_.Cancel(retry_timer_);
+    retry_timer_ = -1;
+  }
+  if (state_ == kResolving) {
+    SetState(kDisconnected); // the answer is ignored
+  } else if (state_ == kConnecting) {
+    SetState(kDisconnected);
+    close(this->RemoveAndResetChannel());
   }
 }
 
 void Connector::Connect() {
-  int sockfd = tcp_connect(nullptr, server_ip_, server_port_);
-  //to-do.
+  if (resolver_ && !unix_ && !IsNumericHost(server_ip_)) {
+    SetState(kResolving);
+    std::shared_ptr<Connector> self = shared_from_this();
+    resolver_->Resolve(server_ip_, [self](const char* ip) { self->Resolved(ip); });
+    return;
+  }
+  ConnectTo(server_ip_);
+}
+
+void Connector::Resolved(const char* ip) {
+  if (state_ != kResolving) return;
+  SetState(kDisconnected);
+  if (!connect_) return;
+  if (ip) {
+    ConnectTo(ip);
+  } else {
+    this->Retry(-1);
+  }
+}
+
+void Connector::ConnectTo(const char* ip) {
+  int sockfd;
+  if (unix_) {
+    sockfd = unix_nonblock_connect(nullptr, ip);
+  } else if (fastopen_) {
+    sockfd = tcp_nonblock_fastopen_connect(nullptr, ip, server_port_);
+  } else {
+    sockfd = tcp_nonblock_connect(nullptr, ip, server_port_);
+  }
+  if (sockfd < 0) {
+    this->Retry(-1);
+  } else {
+    this->Connecting(sockfd);
+  }
 }
 
 void Connector::Restart() {
   loop_.AssertInLoopThread();
-  SetState(kDisconnect);
+  SetState(kDisconnected);
+  retry_delay_ms_ = kInitRetryDelayMs;
   connect_ = true;
   StartInLoop();
 }
 
-void Connector::Connecting() {
+void Connector::Reconnect() {
+  loop_.AssertInLoopThread();
+  if (state_ != kConnected) return;
+  if (loop_.Now() - connected_at_ >= kStableConnectionNs) retry_delay_ms_ = kInitRetryDelayMs;
+  connect_ = true;
+  this->Retry(-1);
+}
+
+// The connect completes, or fails, once the socket turns writable; hangups
+// and errors are reported as readable and writable, and the channel only
+// listens to the latter.
+void Connector::Connecting(int sockfd) {
   SetState(kConnecting);
   assert(!channel_);
   channel_.reset(new Channel(loop_, sockfd));
-  channel_.SetWriteCallback(std::bind(&Connector::HandleWrite, this));
-  channel_.EnableWriting();
+  channel_->SetWriteCallback([this]() { HandleWrite(); });
+  channel_->EnableWriting();
 }
 
+// The channel is still running its callback, so it is only deleted from
+// the task queue. The task takes that channel along: by the time it runs
+// the connector may be connecting again with a new one.
 int Connector::RemoveAndResetChannel() {
-  channel_.DisableAll();
-  channel_.Remove();
-  int sockfd = channel_.fd();
-  loop_.QueueInLoop(std::bind(&Connector::ResetChannel, this));
+  channel_->DisableAll();
+  channel_->Remove();
+  int sockfd = channel_->fd();
+  Channel* channel = channel_.release();
+  loop_.QueueInLoop([channel]() { delete channel; });
   return sockfd;
 }
 
-void Connector::ResetChannel() {
-  channel_.Reset();
-}
-
 void Connector::HandleWrite() {
-  if (state_ == kConnecting) {
-    int sockfd = this->RemoveAndResetChannel();
-    this->SetState(kConnected);
-    if (connect_) {
-      this->NewConnectionCallback(sockfd);
-    }else {
-      close(sockfd);
-    }
-  }else {
-    assert(state_ == kDisconnect);
-  }
-}
-
-void Connector::HandleError() {
-  if (state_ == kConnecting) {
-    int sockfd = this->RemoveAndResetChannel();
-    int err = GetSocketError(sockfd);
+  if (state_ != kConnecting) return;
+  int sockfd = this->RemoveAndResetChannel();
+  if (socket_error(sockfd) != 0) {
     this->Retry(sockfd);
+    return;
+  }
+  SetState(kConnected);
+  connected_at_ = loop_.Now();
+  if (connect_ && new_conn_cb_) {
+    new_conn_cb_(sockfd);
+  } else {
+    close(sockfd);
   }
 }
 
 void Connector::Retry(int sockfd) {
-  close(sockfd);
-  SetState(kDisconnect);
+  if (sockfd >= 0) close(sockfd);
+  SetState(kDisconnected);
   if (connect_) {
-    loop_.RunAfter(retry_delay_ms_ / 1000, std::bind(&Connector::StartInLoop, shared_from_this()));
+    retry_timer_ = loop_.RunAfter(retry_delay_ms_ / 1000.0,
+        std::bind(&Connector::StartInLoop, shared_from_this()));
     retry_delay_ms_ = std::min(retry_delay_ms_ * 2, kMaxRetryDelayMs);
   }
 }
@@ -1,56 +1,98 @@
 #ifndef _CROMWELL_CONNECTOR_H
-#define _CROMWELL_CRNNECTOR_H
+#define _CROMWELL_CONNECTOR_H
 
 #include <functional>
 #include <memory>
 
+#include "noncopyable.h"
+
 namespace cromwell {
 
+class AsyncResolver;
 class Channel;
 class EventLoop;
 
+// Connects to ip:port without blocking the loop, retrying with an
+// exponential backoff until Stop. The connected fd goes to the new
+// connection callback, which owns it from then on. Must be held by a
+// shared_ptr: pending retries keep it alive.
+//
+// The server may be a host name. With a resolver it is looked up again
+// for every attempt without blocking; without one getaddrinfo blocks the
+// loop for as long as the lookup takes.
+//
+// Or the server is an AF_UNIX path, which connects at once or is retried.
+//
+// With fast open, once the kernel holds a TFO cookie for the server the
+// connect is deferred: the callback runs at once and the first write goes
+// out in the SYN, so send the request right there. A deferred connect
+// that fails shows up as an error on the connection, not as a retry here.
 class Connector : noncopyable, public std::enable_shared_from_this<Connector> {
 public:
   typedef std::function<void(int sockfd)> NewConnectionCallback;
 
   Connector(EventLoop& loop, const char* ip, int port);
+  // AF_UNIX stream socket at path, '@' first for the abstract namespace.
+  Connector(EventLoop& loop, const char* path);
   ~Connector();
 
   void SetNewConnectionCallback(const NewConnectionCallback& cb) {
     new_conn_cb_ = cb;
   }
+  // Must outlive the connector. Before Start.
+  void SetResolver(AsyncResolver* resolver) {
+    resolver_ = resolver;
+  }
+
+  // TCP_FASTOPEN_CONNECT on every attempt. Before Start.
+  void SetFastOpen(bool on) {
+    fastopen_ = on;
+  }
 
-  void Start();
-  void Restart();
-  void Stop();
+  void Start();   // any thread
+  void Restart(); // loop thread
+  void Stop();    // any thread
+  // The connection handed out last went down: connect again after the
+  // backoff, which only starts over if that connection stayed up for a
+  // while, so a server that accepts and drops at once is not hammered.
+  // Loop thread.
+  void Reconnect();
 
   const char* ServerIp() const { return server_ip_; }
-  int ServerPort const { return server_port_; }
+  int ServerPort() const { return server_port_; } // 0 for AF_UNIX
 
 private:
-  enum ConnectorState { kDisconnect, kConnecting, kConnected, }
+  enum ConnectorState { kDisconnected, kResolving, kConnecting, kConnected, };
 
   void SetState(ConnectorState s) { state_ = s; }
   void StartInLoop();
   void StopInLoop();
   void Connect();
+  void ConnectTo(const char* ip);
+  void Resolved(const char* ip);
   void Connecting(int sockfd);
   void HandleWrite();
-  void HandleError();
   void Retry(int sockfd);
   int RemoveAndResetChannel();
-  void ResetChannel();
 
 private:
   static const int kMaxRetryDelayMs;
   static const int kInitRetryDelayMs;
+  static const long long kStableConnectionNs;
 
 private:
   EventLoop& loop_;
-  char server_ip_[16];
+  char server_ip_[256]; // or host name, or AF_UNIX path
   int server_port_;
+  bool unix_;
+  bool connect_;
+  bool fastopen_;
   ConnectorState state_;
+  int retry_delay_ms_;
+  long long retry_timer_;
+  long long connected_at_; // loop time the last connect completed
   std::unique_ptr<Channel> channel_;
+  AsyncResolver* resolver_;
   NewConnectionCallback new_conn_cb_;
 };
 
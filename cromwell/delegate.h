@@ -0,0 +1,99 @@
+#ifndef __CROMWELL_DELEGATE_H
+#define __CROMWELL_DELEGATE_H
+
+#include <stddef.h>
+#include <string.h>
+
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace cromwell {
+
+// A callable stored inline, for callbacks that fire on every event. Unlike
+// std::function it never allocates: the callable (a lambda capturing a few
+// pointers, a std::bind of a member function and its object, a function
+// pointer) is kept in a buffer of kStorage bytes, and one that does not
+// fit is rejected at compile time. Trivially copyable callables are
+// copied with memcpy, others through a small manager.
+template <typename Signature>
+class Delegate;
+
+template <typename R, typename... Args>
+class Delegate<R(Args...)> {
+public:
+  static const size_t kStorage = 4 * sizeof(void*);
+
+  Delegate() : invoke_(nullptr), manage_(nullptr) {}
+  Delegate(std::nullptr_t) : invoke_(nullptr), manage_(nullptr) {}
+
+  template <typename F, typename = typename std::enable_if<
+      !std::is_same<typename std::decay<F>::type, Delegate>::value>::type>
+  Delegate(F&& f) {
+    typedef typename std::decay<F>::type Fn;
+    static_assert(sizeof(Fn) <= kStorage, "callable too large for a Delegate");
+    static_assert(alignof(Fn) <= alignof(Storage), "callable over-aligned for a Delegate");
+    new (&storage_) Fn(std::forward<F>(f));
+    invoke_ = &Invoke<Fn>;
+    manage_ = std::is_trivially_copyable<Fn>::value ? nullptr : &Manage<Fn>;
+  }
+
+  Delegate(const Delegate& other) : invoke_(nullptr), manage_(nullptr) {
+    CopyFrom(other);
+  }
+
+  Delegate& operator=(const Delegate& other) {
+    if (this != &other) {
+      Reset();
+      CopyFrom(other);
+    }
+    return *this;
+  }
+
+  ~Delegate() { Reset(); }
+
+  void Reset() {
+    if (manage_) manage_(&storage_, nullptr);
+    invoke_ = nullptr;
+    manage_ = nullptr;
+  }
+
+  explicit operator bool() const { return invoke_ != nullptr; }
+
+  R operator()(Args... args) const {
+    return invoke_(const_cast<Storage*>(&storage_), std::forward<Args>(args)...);
+  }
+
+private:
+  typedef typename std::aligned_storage<kStorage, alignof(void*)>::type Storage;
+  typedef R (*Invoker)(void* storage, Args... args);
+  // Copy-constructs src into dst, or destroys dst when src is null.
+  typedef void (*Manager)(void* dst, const void* src);
+
+  template <typename Fn>
+  static R Invoke(void* storage, Args... args) {
+    return (*static_cast<Fn*>(storage))(std::forward<Args>(args)...);
+  }
+
+  template <typename Fn>
+  static void Manage(void* dst, const void* src) {
+    if (src) new (dst) Fn(*static_cast<const Fn*>(src));
+    else static_cast<Fn*>(dst)->~Fn();
+  }
+
+  void CopyFrom(const Delegate& other) {
+    if (other.manage_) other.manage_(&storage_, &other.storage_);
+    else memcpy(&storage_, &other.storage_, sizeof(storage_));
+    invoke_ = other.invoke_;
+    manage_ = other.manage_;
+  }
+
+private:
+  Storage storage_;
+  Invoker invoke_;
+  Manager manage_;
+};
+
+}//end-cromwell.
+
+#endif
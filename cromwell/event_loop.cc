@@ -1,5 +1,200 @@
 #include "event_loop.h"
 
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <limits.h>
+#include <signal.h>
+
+#include <stdexcept>
+
+#include "channel.h"
+
 namespace cromwell {
 
+namespace {
+
+// A functor travelling through the loop's task queue.
+struct FunctorTask {
+  SeTask task;
+  EventLoop::Functor cb;
+};
+
+// A RunAfter/RunEvery callback, freed by the timer's finalizer.
+struct TimerTask {
+  EventLoop::Functor cb;
+  int interval; // in the unit the timer was created with, SE_NOMORE once
+};
+
+// sendfile and splice have no MSG_NOSIGNAL: a peer that reset the
+// connection would kill the process. Ignored once, by the first loop.
+struct IgnoreSigPipe {
+  IgnoreSigPipe() { ::signal(SIGPIPE, SIG_IGN); }
+};
+
+}
+
+const int EventLoop::kDefaultSetSize = 10240;
+
+EventLoop::EventLoop(int setsize)
+  : loop_(SeCreateEventLoop(setsize)),
+  pending_(0) {
+  static IgnoreSigPipe ignore_sigpipe;
+  if (!loop_) {
+    throw std::runtime_error("SeCreateEventLoop failed.");
+  }
+}
+
+EventLoop::~EventLoop() {
+  SeDeleteEventLoop(loop_);
+}
+
+void EventLoop::Loop() {
+  SeMain(loop_);
+}
+
+void EventLoop::Quit() {
+  if (IsInLoopThread()) {
+    SeStop(loop_);
+  } else {
+    SeTask* task = new SeTask;
+    task->proc = QuitInLoop;
+    task->client = task;
+    SeQueueInLoop(loop_, task);
+  }
+}
+
+void EventLoop::QuitInLoop(SeEventLoop* loop, void* client) {
+  delete static_cast<SeTask*>(client);
+  SeStop(loop);
+}
+
+void EventLoop::SetSignalCallback(int signo, const SignalCallback& cb) {
+  AssertInLoopThread();
+  if (SeCreateSignalEvent(loop_, signo, RunSignal, this) == SE_ERR) {
+    throw std::runtime_error("SeCreateSignalEvent failed.");
+  }
+  signal_cbs_[signo] = cb;
+}
+
+void EventLoop::RemoveSignalCallback(int signo) {
+  AssertInLoopThread();
+  SeDeleteSignalEvent(loop_, signo);
+  signal_cbs_.erase(signo);
+}
+
+void EventLoop::RunSignal(SeEventLoop* loop, int signo, void* client) {
+  EventLoop* self = static_cast<EventLoop*>(client);
+  std::map<int, SignalCallback>::iterator it = self->signal_cbs_.find(signo);
+  if (it != self->signal_cbs_.end()) {
+    SignalCallback cb = it->second; // may remove itself
+    cb(signo);
+  }
+}
+
+EventLoop::TimerId EventLoop::RunAfter(double seconds, const Functor& cb) {
+  return AddTimer(seconds, 0, cb);
+}
+
+EventLoop::TimerId EventLoop::RunEvery(double seconds, const Functor& cb) {
+  return AddTimer(seconds, seconds, cb);
+}
+
+// Timers are kept in nanoseconds while the interval fits the int a time
+// proc returns, about two seconds, and in milliseconds beyond.
+EventLoop::TimerId EventLoop::AddTimer(double seconds, double interval, const Functor& cb) {
+  AssertInLoopThread();
+  if (seconds < 0) seconds = 0;
+  TimerTask* task = new TimerTask;
+  task->cb = cb;
+  task->interval = SE_NOMORE;
+  long long id;
+  double ns = interval * 1e9;
+  if (interval <= 0 || ns <= INT_MAX) {
+    if (interval > 0) task->interval = ns < 1 ? 1 : static_cast<int>(ns);
+    id = SeCreateTimeEventNs(loop_, static_cast<long long>(seconds * 1e9),
+        RunTimer, task, FreeTimer);
+  } else {
+    double ms = interval * 1e3;
+    task->interval = ms < INT_MAX ? static_cast<int>(ms) : INT_MAX;
+    id = SeCreateTimeEvent(loop_, static_cast<long long>(seconds * 1e3),
+        RunTimer, task, FreeTimer);
+  }
+  if (id == SE_ERR) {
+    delete task;
+    throw std::runtime_error("SeCreateTimeEvent failed.");
+  }
+  return id;
+}
+
+void EventLoop::Cancel(TimerId id) {
+  AssertInLoopThread();
+  SeDeleteTimeEvent(loop_, id);
+}
+
+int EventLoop::RunTimer(SeEventLoop* loop, long long id, void* client) {
+  TimerTask* task = static_cast<TimerTask*>(client);
+  task->cb();
+  return task->interval;
+}
+
+void EventLoop::FreeTimer(SeEventLoop* loop, void* client) {
+  delete static_cast<TimerTask*>(client);
+}
+
+void EventLoop::UpdateChannel(Channel* channel) {
+  AssertInLoopThread();
+  int fd = channel->fd();
+  int have = SeGetFileEvents(loop_, fd);
+  int want = channel->events();
+  if (have & ~want) {
+    SeDeleteFileEvent(loop_, fd, have & ~want);
+  }
+  if (want & ~have) {
+    if (SeCreateFileEvent(loop_, fd, want & ~have, Channel::OnEvent, channel) == SE_ERR) {
+      throw std::runtime_error("SeCreateFileEvent failed.");
+    }
+  }
+}
+
+void EventLoop::RemoveChannel(Channel* channel) {
+  AssertInLoopThread();
+  if (HaveChannel(channel)) {
+    SeDeleteFileEvent(loop_, channel->fd(), SE_READABLE | SE_WRITABLE);
+  }
+}
+
+bool EventLoop::HaveChannel(Channel* channel) const {
+  return SeGetFileEventClient(loop_, channel->fd()) == channel;
+}
+
+void EventLoop::AssertInLoopThread() const {
+  if (!IsInLoopThread()) {
+    fprintf(stderr, "EventLoop %p used outside of its thread\n", static_cast<const void*>(this));
+    abort();
+  }
+}
+
+void EventLoop::RunInLoop(const Functor& cb) {
+  if (IsInLoopThread()) {
+    cb();
+  } else {
+    QueueInLoop(cb);
+  }
+}
+
+void EventLoop::QueueInLoop(const Functor& cb) {
+  FunctorTask* ft = new FunctorTask;
+  ft->task.proc = RunFunctor;
+  ft->task.client = ft;
+  ft->cb = cb;
+  SeQueueInLoop(loop_, &ft->task);
+}
+
+void EventLoop::RunFunctor(SeEventLoop* loop, void* client) {
+  FunctorTask* ft = static_cast<FunctorTask*>(client);
+  ft->cb();
+  delete ft;
+}
+
 }//end-cromwell.
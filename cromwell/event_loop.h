@@ -1,8 +1,100 @@
 #ifndef __CROMWELL_EVENT_LOOP_H
 #define __CROMWELL_EVENT_LOOP_H
 
+#include <functional>
+#include <map>
+
+#include <pthread.h>
+
+#include "noncopyable.h"
+#include "se.h"
+
 namespace cromwell {
 
+// One reactor: an SeEventLoop plus the thread that runs it. Everything
+// but RunInLoop, QueueInLoop, Quit and Load must be called from the loop
+// thread. The first loop created sets SIGPIPE to SIG_IGN for the process,
+// so writes to a reset connection fail with EPIPE instead.
+class Channel;
+
+class EventLoop : noncopyable {
+public:
+  typedef std::function<void(void)> Functor;
+  typedef std::function<void(int signo)> SignalCallback;
+  typedef long long TimerId;
+
+  explicit EventLoop(int setsize = kDefaultSetSize);
+  ~EventLoop();
+
+  // Run until Quit, the calling thread becomes the loop thread.
+  void Loop();
+  void Quit();
+
+  void RunInLoop(const Functor& cb);
+  void QueueInLoop(const Functor& cb);
+
+  // Run cb once after, or every, the given seconds. Cancel is a no-op
+  // for a timer that already ran out.
+  TimerId RunAfter(double seconds, const Functor& cb);
+  TimerId RunEvery(double seconds, const Functor& cb);
+  void Cancel(TimerId id);
+  // Loop time, monotonic nanoseconds, see SeGetLoopTime.
+  long long Now() const { return SeGetLoopTime(loop_); }
+
+  // Bring the fd registration in line with channel->events().
+  void UpdateChannel(Channel* channel);
+  void RemoveChannel(Channel* channel);
+  bool HaveChannel(Channel* channel) const;
+
+  // Run cb in the loop whenever signo arrives, see SeCreateSignalEvent for
+  // the signal mask this relies on. Throws if signalfd is unavailable.
+  void SetSignalCallback(int signo, const SignalCallback& cb);
+  void RemoveSignalCallback(int signo);
+
+  bool IsInLoopThread() const { return SeInLoopThread(loop_) != 0; }
+  void AssertInLoopThread() const;
+
+  // Registered fds plus connections handed over but not registered yet.
+  int Load() const {
+    return SeGetFileEventCount(loop_) + __atomic_load_n(&pending_, __ATOMIC_RELAXED);
+  }
+  void AddPending(int n) { __atomic_add_fetch(&pending_, n, __ATOMIC_RELAXED); }
+
+  // Spin before blocking, see SeSetBusyPoll. Loop thread or before Loop.
+  void SetBusyPoll(long long ns, bool adaptive) {
+    SeSetBusyPoll(loop_, ns, adaptive ? 1 : 0);
+  }
+  SePollStats PollStats() const {
+    SePollStats stats;
+    SeGetPollStats(loop_, &stats);
+    return stats;
+  }
+  // Any thread, see SeLoopMetrics.
+  SeLoopMetrics Metrics() const {
+    SeLoopMetrics metrics;
+    SeGetMetrics(loop_, &metrics);
+    return metrics;
+  }
+
+  SeEventLoop* se_loop() const { return loop_; }
+
+private:
+  static void RunFunctor(SeEventLoop* loop, void* client);
+  static void QuitInLoop(SeEventLoop* loop, void* client);
+  static void RunSignal(SeEventLoop* loop, int signo, void* client);
+  static int RunTimer(SeEventLoop* loop, long long id, void* client);
+  static void FreeTimer(SeEventLoop* loop, void* client);
+  TimerId AddTimer(double seconds, double interval, const Functor& cb);
+
+private:
+  static const int kDefaultSetSize;
+
+private:
+  SeEventLoop* loop_;
+  int pending_;
+  std::map<int, SignalCallback> signal_cbs_;
+};
+
 }//end-cromwell
 
 #endif
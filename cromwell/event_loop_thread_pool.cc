@@ -0,0 +1,150 @@
+#include "event_loop_thread_pool.h"
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include <stdexcept>
+
+#include "event_loop.h"
+#include "sema.h"
+#include "thread.h"
+
+namespace cromwell {
+
+struct EventLoopThreadPool::LoopThread {
+  LoopThread() : loop(nullptr), started(0) {}
+
+  std::unique_ptr<Thread> thread;
+  EventLoop* loop; // owned by the thread, valid while it runs
+  SemaType started;
+  int index;
+  int cpu;
+};
+
+EventLoopThreadPool::EventLoopThreadPool(EventLoop& base_loop, int num_threads)
+  : base_loop_(base_loop),
+  num_threads_(num_threads),
+  first_cpu_(0),
+  setsize_(10240),
+  strategy_(kRoundRobin),
+  started_(false),
+  next_(0) {
+
+}
+
+EventLoopThreadPool::~EventLoopThreadPool() {
+  Stop();
+}
+
+void EventLoopThreadPool::Start() {
+  base_loop_.AssertInLoopThread();
+  if (started_) return;
+
+  long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+  if (ncpus < 1) ncpus = 1;
+
+  for (int i = 0; i < num_threads_; ++i) {
+    std::unique_ptr<LoopThread> lt(new LoopThread);
+    ThreadFactory factory;
+    lt->index = i;
+    lt->cpu = first_cpu_ < 0 ? -1 : static_cast<int>((first_cpu_ + i) % ncpus);
+    lt->thread.reset(factory.CreateThread(
+          std::bind(&EventLoopThreadPool::ThreadMain, this, std::placeholders::_1)));
+    if (!lt->thread) {
+      throw std::runtime_error("EventLoopThreadPool: cannot create thread.");
+    }
+    lt->thread->Start(lt.get());
+    threads_.push_back(std::move(lt));
+  }//end-for.
+
+  for (size_t i = 0; i < threads_.size(); ++i) {
+    threads_[i]->started.Wait(-1);
+    loops_.push_back(threads_[i]->loop);
+  }//end-for.
+  started_ = true;
+}
+
+void EventLoopThreadPool::ThreadMain(void* arg) {
+  LoopThread* lt = static_cast<LoopThread*>(arg);
+  char name[16];
+
+  // Best effort: a cpu outside our cgroup's set just leaves us floating.
+  if (lt->cpu >= 0) Thread::SetAffinity(lt->cpu);
+  snprintf(name, sizeof(name), "loop-%d", lt->index);
+  Thread::SetName(name);
+
+  EventLoop loop(setsize_);
+  if (init_cb_) init_cb_(loop);
+  lt->loop = &loop;
+  lt->started.Post();
+  loop.Loop();
+
+  ScopedMutex<MutexType> lock(exit_mutex_);
+  for (size_t i = 0; i < exit_cbs_.size(); ++i) {
+    exit_cbs_[i].second(loop);
+  }//end-for.
+}
+
+void EventLoopThreadPool::AddThreadExitCallback(const void* key, const ThreadExitCallback& cb) {
+  ScopedMutex<MutexType> lock(exit_mutex_);
+  exit_cbs_.push_back(std::make_pair(key, cb));
+}
+
+void EventLoopThreadPool::RemoveThreadExitCallback(const void* key) {
+  ScopedMutex<MutexType> lock(exit_mutex_);
+  for (size_t i = 0; i < exit_cbs_.size(); ) {
+    if (exit_cbs_[i].first == key) {
+      exit_cbs_.erase(exit_cbs_.begin() + static_cast<long>(i));
+    } else {
+      ++i;
+    }
+  }//end-for.
+}
+
+void EventLoopThreadPool::Stop() {
+  for (size_t i = 0; i < loops_.size(); ++i) {
+    loops_[i]->Quit();
+  }
+  for (size_t i = 0; i < threads_.size(); ++i) {
+    threads_[i]->thread->Join();
+  }
+  loops_.clear();
+  threads_.clear();
+  started_ = false;
+}
+
+EventLoop* EventLoopThreadPool::GetNextLoop() {
+  base_loop_.AssertInLoopThread();
+  if (loops_.empty()) return &base_loop_;
+
+  if (strategy_ == kLeastLoad) {
+    // Ties go round-robin so a burst of accepts does not pile onto the
+    // first idle loop before any of them registered.
+    size_t n = loops_.size();
+    size_t best = next_ % n;
+    int best_load = loops_[best]->Load();
+    for (size_t i = 1; i < n; ++i) {
+      size_t k = (next_ + i) % n;
+      int load = loops_[k]->Load();
+      if (load < best_load) {
+        best = k;
+        best_load = load;
+      }
+    }//end-for.
+    next_ = best + 1;
+    return loops_[best];
+  }
+  return loops_[next_++ % loops_.size()];
+}
+
+EventLoop* EventLoopThreadPool::GetLoopForHash(size_t hash) {
+  if (loops_.empty()) return &base_loop_;
+  return loops_[hash % loops_.size()];
+}
+
+std::vector<EventLoop*> EventLoopThreadPool::GetAllLoops() {
+  if (loops_.empty()) return std::vector<EventLoop*>(1, &base_loop_);
+  return loops_;
+}
+
+}//end-cromwell
@@ -0,0 +1,81 @@
+#ifndef __CROMWELL_EVENT_LOOP_THREAD_POOL_H
+#define __CROMWELL_EVENT_LOOP_THREAD_POOL_H
+
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "mutex.h"
+#include "noncopyable.h"
+
+namespace cromwell {
+
+class EventLoop;
+class Thread;
+
+// N threads, each running its own EventLoop, optionally pinned one per
+// cpu. The base loop (usually the one accepting connections) hands work
+// out with GetNextLoop; with no threads everything stays on the base loop.
+class EventLoopThreadPool : noncopyable {
+public:
+  typedef std::function<void(EventLoop& loop)> ThreadInitCallback;
+  typedef std::function<void(EventLoop& loop)> ThreadExitCallback;
+
+  enum Strategy {
+    kRoundRobin = 0,
+    kLeastLoad, // fewest registered fds, see EventLoop::Load
+  };
+
+  EventLoopThreadPool(EventLoop& base_loop, int num_threads);
+  ~EventLoopThreadPool();
+
+  void SetStrategy(Strategy strategy) { strategy_ = strategy; }
+  // Pin thread i to cpu (first_cpu + i) % cpus, -1 disables pinning.
+  void SetFirstCpu(int first_cpu) { first_cpu_ = first_cpu; }
+  void SetLoopSetSize(int setsize) { setsize_ = setsize; }
+  // Runs in each new thread before its loop starts.
+  void SetThreadInitCallback(const ThreadInitCallback& cb) { init_cb_ = cb; }
+  // Runs in each thread once its loop quit, before the loop is destroyed,
+  // e.g. to remove the channels a user of the pool still has there. key
+  // names the callback for RemoveThreadExitCallback. The callbacks run
+  // under a lock and must not add or remove any.
+  void AddThreadExitCallback(const void* key, const ThreadExitCallback& cb);
+  void RemoveThreadExitCallback(const void* key);
+
+  // Returns once every loop is running.
+  void Start();
+  // Quits the loops and joins the threads.
+  void Stop();
+
+  // Base loop thread only.
+  EventLoop* GetNextLoop();
+  EventLoop* GetLoopForHash(size_t hash);
+  std::vector<EventLoop*> GetAllLoops();
+
+  int NumThreads() const { return num_threads_; }
+  bool Started() const { return started_; }
+
+private:
+  struct LoopThread;
+
+  void ThreadMain(void* arg);
+
+private:
+  EventLoop& base_loop_;
+  int num_threads_;
+  int first_cpu_;
+  int setsize_;
+  Strategy strategy_;
+  bool started_;
+  size_t next_;
+  ThreadInitCallback init_cb_;
+  MutexType exit_mutex_;
+  std::vector<std::pair<const void*, ThreadExitCallback> > exit_cbs_;
+  std::vector<std::unique_ptr<LoopThread> > threads_;
+  std::vector<EventLoop*> loops_;
+};
+
+}//end-cromwell
+
+#endif
@@ -10,17 +10,17 @@ void FastBuffer::DestroyAll() {
 }
 
 size_t FastBuffer::FindBytes(const void* pattern, size_t len, int from) {
-	if (from < 0 || len <= 0) return -1;
+	if (from < 0 || len == 0 || len > GetReadingSize()) return npos;
 
-	const char *p = (const char *)pattern;
-	size_t dLen = pos_writing_ - pos_reading_ - len;
+	const char *p = static_cast<const char *>(pattern);
+	size_t dLen = GetReadingSize() - len;
 
-	for (size_t i = from; i <= dLen; ++i) {
+	for (size_t i = static_cast<size_t>(from); i <= dLen; ++i) {
 		if (pos_reading_[i] == p[0] && memcmp(pos_reading_ + i, p, len) == 0) {
 			return i;
 		}
 	}
-	return -1;
+	return npos;
 }
 
 bool FastBuffer::ShrinkSpace(size_t max_size) {
@@ -32,10 +32,9 @@ bool FastBuffer::ShrinkSpace(size_t max_size) {
 	// is the data space too big?
 	if (pos_writing_ > pos_reading_ + max_size) return true;
 
-	size_t dlen = pos_writing_ - pos_reading_;
-	if (dlen < 0) dlen = 0; // impossible!
+	size_t dlen = GetReadingSize();
 
-	char *newbuf = (char *)malloc(max_size);
+	char *newbuf = static_cast<char *>(malloc(max_size));
 	if (!newbuf) return false;
 
 	if (dlen > 0) {
@@ -54,7 +53,7 @@ bool FastBuffer::EnsureSize(size_t need) {
 		size_t len = 256;
 		while (len < need) len <<= 1;
 
-		pos_begin_ = (char *)malloc(len);
+		pos_begin_ = static_cast<char *>(malloc(len));
 		if (!pos_begin_) return false;
 
 		pos_writing_ = pos_reading_ = pos_begin_;
@@ -65,16 +64,16 @@ bool FastBuffer::EnsureSize(size_t need) {
 	// is the writing size big enough?
 	if (pos_end_ >= pos_writing_ + need) return true;
 
-	size_t flen = (pos_end_ - pos_writing_) + \
-		(pos_reading_ - pos_begin_);
-	size_t dlen = pos_writing_ - pos_reading_;
+	size_t flen = GetWritingSize() + \
+		static_cast<size_t>(pos_reading_ - pos_begin_);
+	size_t dlen = GetReadingSize();
 
 	// not enough, or the idle is below 20%:
 	if (flen < need || flen * 4 < dlen) {
-		size_t bufsize = (pos_end_ - pos_begin_) * 2;
+		size_t bufsize = GetCapacity() * 2;
 		while (bufsize - dlen < need) bufsize <<= 1;
 
-		char *newbuf = (char *)malloc(bufsize);
+		char *newbuf = static_cast<char *>(malloc(bufsize));
 		if (!newbuf) return false;
 
 		if (dlen > 0) {
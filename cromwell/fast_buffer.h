@@ -1,6 +1,10 @@
 #ifndef __CROMWELL_FASTBUFFER_H
 #define __CROMWELL_FASTBUFFER_H
 
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
 namespace cromwell {
 
 class FastBuffer {
@@ -30,7 +34,7 @@ public:
 	}
 
 	inline size_t GetReadingSize() const {
-		return (pos_writing_ - pos_reading_);
+		return static_cast<size_t>(pos_writing_ - pos_reading_);
 	}
 
 	inline char* GetWriting() const {
@@ -38,11 +42,11 @@ public:
 	}
 
 	inline size_t GetWritingSize() const {
-		return (pos_end_ - pos_writing_);
+		return static_cast<size_t>(pos_end_ - pos_writing_);
 	}
 
 	inline size_t GetCapacity() const {
-		return (pos_end_ - pos_begin_);
+		return static_cast<size_t>(pos_end_ - pos_begin_);
 	}
 
 	/// Move the data-reading cursor
@@ -74,6 +78,15 @@ public:
 		pos_reading_ = pos_writing_ = pos_begin_;
 	}
 
+	/// Exchange memory and cursors with other, nothing is copied
+	inline void Swap(FastBuffer& other) {
+		char *p;
+		p = pos_begin_; pos_begin_ = other.pos_begin_; other.pos_begin_ = p;
+		p = pos_end_; pos_end_ = other.pos_end_; other.pos_end_ = p;
+		p = pos_reading_; pos_reading_ = other.pos_reading_; other.pos_reading_ = p;
+		p = pos_writing_; pos_writing_ = other.pos_writing_; other.pos_writing_ = p;
+	}
+
 	/// Release memory allocated
 	void DestroyAll();
 
@@ -83,9 +96,11 @@ public:
 	/// Ensure (expand) the size of free space
 	bool EnsureSize(size_t need);
 
-	/// The binary-safe strstr()!
+	/// The binary-safe strstr()! npos if not found
 	size_t FindBytes(const void *pattern, size_t len, int from = 0);
 
+	static const size_t npos = static_cast<size_t>(-1);
+
 private:
 	char *pos_begin_;
 	char *pos_end_;
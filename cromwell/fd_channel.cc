@@ -0,0 +1,128 @@
+#include "fd_channel.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "event_loop.h"
+#include "socket_opt.h"
+
+namespace cromwell {
+
+const size_t FdChannel::kMaxTag;
+const int FdChannel::kReadBatch = 64;
+
+FdChannel::FdChannel(EventLoop& loop, int sockfd)
+  : loop_(loop),
+  sockfd_(sockfd),
+  channel_(loop, sockfd),
+  partial_len_(0),
+  partial_fd_(-1) {
+  nonblock(nullptr, sockfd_);
+  channel_.SetReadCallback([this](long long receive_time) { HandleRead(); });
+  channel_.SetWriteCallback([this]() { HandleWrite(); });
+}
+
+FdChannel::~FdChannel() {
+  close_cb_ = CloseCallback();
+  Close();
+}
+
+void FdChannel::Start() {
+  loop_.AssertInLoopThread();
+  if (sockfd_ >= 0 && !channel_.IsReading()) channel_.EnableReading();
+}
+
+bool FdChannel::Send(int fd, const char* tag) {
+  loop_.AssertInLoopThread();
+  if (sockfd_ < 0) return false;
+  Message msg;
+  memset(&msg, 0, sizeof(msg));
+  strncpy(msg.tag, tag, kMaxTag);
+  msg.fd = fd;
+  msg.sent = 0;
+  if (queue_.empty()) {
+    if (SendMessage(&msg)) return true;
+    if (sockfd_ < 0) return false;
+  }
+  // The caller may close fd as soon as we return.
+  if (msg.sent > 0) msg.fd = -1; // passed already
+  if (msg.fd >= 0 && (msg.fd = fcntl(msg.fd, F_DUPFD_CLOEXEC, 0)) == -1) return false;
+  queue_.push_back(msg);
+  if (!channel_.IsWriting()) channel_.EnableWriting();
+  return true;
+}
+
+bool FdChannel::SendMessage(Message* msg) {
+  while (msg->sent < sizeof(msg->tag)) {
+    // The fd goes with the first byte, the rest of the record follows
+    // without it.
+    int n = send_fds(nullptr, sockfd_, &msg->fd, msg->fd >= 0 && msg->sent == 0 ? 1 : 0,
+        msg->tag + msg->sent, sizeof(msg->tag) - msg->sent);
+    if (n <= 0) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK) Close();
+      return false;
+    }
+    msg->sent += static_cast<size_t>(n);
+  }//end-while.
+  return true;
+}
+
+void FdChannel::HandleWrite() {
+  while (!queue_.empty()) {
+    Message& msg = queue_.front();
+    if (!SendMessage(&msg)) return;
+    if (msg.fd >= 0) close(msg.fd);
+    queue_.pop_front();
+  }//end-while.
+  channel_.DisableWriting();
+}
+
+void FdChannel::HandleRead() {
+  for (int i = 0; i < kReadBatch && sockfd_ >= 0; ++i) {
+    int fd = -1;
+    int nfds = 1;
+    int n = recv_fds(nullptr, sockfd_, &fd, &nfds, partial_ + partial_len_,
+        sizeof(partial_) - partial_len_);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+    if (n <= 0 || (nfds > 0 && partial_len_ > 0)) {
+      // EOF, an error, a truncated record or an fd in mid record.
+      if (nfds > 0) close(fd);
+      Close();
+      return;
+    }
+    if (nfds > 0) partial_fd_ = fd;
+    partial_len_ += static_cast<size_t>(n);
+    if (partial_len_ < sizeof(partial_)) continue;
+    char tag[kMaxTag + 1];
+    memcpy(tag, partial_, sizeof(tag));
+    tag[kMaxTag] = '\0';
+    fd = partial_fd_;
+    partial_len_ = 0;
+    partial_fd_ = -1;
+    if (fd_cb_) {
+      fd_cb_(fd, tag);
+    } else if (fd >= 0) {
+      close(fd);
+    }
+  }//end-for.
+}
+
+void FdChannel::Close() {
+  if (sockfd_ < 0) return;
+  channel_.DisableAll();
+  channel_.Remove();
+  close(sockfd_);
+  sockfd_ = -1;
+  for (size_t i = 0; i < queue_.size(); ++i) {
+    if (queue_[i].fd >= 0) close(queue_[i].fd);
+  }//end-for.
+  queue_.clear();
+  if (partial_fd_ >= 0) close(partial_fd_);
+  partial_fd_ = -1;
+  partial_len_ = 0;
+  if (close_cb_) close_cb_();
+}
+
+}//end-cromwell.
@@ -0,0 +1,83 @@
+#ifndef __CROMWELL_FD_CHANNEL_H
+#define __CROMWELL_FD_CHANNEL_H
+
+#include <stddef.h>
+
+#include <deque>
+#include <functional>
+
+#include "channel.h"
+#include "noncopyable.h"
+
+namespace cromwell {
+
+class EventLoop;
+
+// Passes fds between processes over a connected AF_UNIX socket, each with
+// a short tag saying what it is: a master handing listeners or accepted
+// connections to its workers (see Prefork), or a running binary handing
+// its listeners to the one replacing it, over a Connector and Acceptor on
+// a unix path. The receiver gets its own copy of the fd, so a listener
+// keeps its accept queue and nothing is dropped on the way.
+//
+// Messages are fixed size records. A seqpacket pair keeps them apart; on
+// a stream socket a record may go out and come in pieces, which are put
+// back together, the fd travelling with the first one. Loop thread only,
+// and not to be destroyed from its own callbacks.
+class FdChannel : noncopyable {
+public:
+  // fd is the receiver's, close-on-exec, or -1 for a tag alone.
+  typedef std::function<void(int fd, const char* tag)> FdCallback;
+  // The peer went away, or the socket failed.
+  typedef std::function<void()> CloseCallback;
+
+  static const size_t kMaxTag = 63;
+
+  // Owns sockfd.
+  FdChannel(EventLoop& loop, int sockfd);
+  ~FdChannel();
+
+  void SetFdCallback(const FdCallback& cb) { fd_cb_ = cb; }
+  void SetCloseCallback(const CloseCallback& cb) { close_cb_ = cb; }
+
+  // Start receiving.
+  void Start();
+  // Pass a copy of fd, -1 for none, with tag, cut to kMaxTag. The caller
+  // keeps fd. Queued while the socket is full; false once closed.
+  bool Send(int fd, const char* tag);
+
+  bool Closed() const { return sockfd_ < 0; }
+  size_t Queued() const { return queue_.size(); }
+
+private:
+  struct Message {
+    int fd; // our dup while queued
+    size_t sent; // bytes of tag already out
+    char tag[kMaxTag + 1];
+  };
+
+  // Pass what is left of msg. False once the socket is full or closed.
+  bool SendMessage(Message* msg);
+  void HandleRead();
+  void HandleWrite();
+  void Close();
+
+private:
+  static const int kReadBatch;
+
+private:
+  EventLoop& loop_;
+  int sockfd_;
+  Channel channel_;
+  std::deque<Message> queue_;
+  // The record being received, and the fd that came with it.
+  char partial_[kMaxTag + 1];
+  size_t partial_len_;
+  int partial_fd_;
+  FdCallback fd_cb_;
+  CloseCallback close_cb_;
+};
+
+}//end-cromwell.
+
+#endif
@@ -4,11 +4,17 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <new>
+#include <utility>
 
 #include "mutex.h"
 
 namespace cromwell {
 
+// A fixed number of equally sized blocks in one allocation. Every block
+// handed out gets a 64-bit key, its index plus a magic number that changes
+// with each Alloc: GetBlock resolves a key with one array lookup and
+// returns NULL once the block was freed, even if it has been reused
+// since. Blocks are 8-byte aligned.
 template <class AllocLock=MutexType, class FreeLock=MutexType>
 class FixedSizeMemPool {
 public:
@@ -30,23 +36,24 @@ public:
   void* GetBlock(uint64_t key) const;
 
 public:
+  static const uint32_t kAlign = 8;
+
   static uint32_t GetId(uint64_t key) {
-    BlockHeader* bh = (BlockHeader*)&key;
-    return hb->id;
+    return static_cast<uint32_t>(key);
   }
   static uint64_t TotalSize(uint32_t block_size, uint32_t block_count) {
-    return sizeof(GlobalHeader) + (sizeof(uint32_t) + sizeof(BlockHeader) + block_size) * block_count;
+    return BlocksOffset(block_count) + static_cast<uint64_t>(Stride(block_size)) * block_count;
   }
 
 protected:
   #pragma pack(push, 1)
   struct GlobalHeader {
-    uint32_t block_size;
+    uint32_t block_size; // stride, header included
     uint32_t block_count;
     uint32_t begin;
     uint32_t end;
     uint32_t next_magic;
-    uint32_t ids[1];
+    uint32_t ids[1]; // ring of free ids, block_count + 1 slots
   };
 
   struct BlockHeader {
@@ -55,25 +62,33 @@ protected:
       struct {
         uint32_t id;
         uint32_t magic;
-      }
+      } k;
     };
     uint8_t data[0];
   };
   #pragma pack(pop)
 
+  static uint32_t Stride(uint32_t block_size) {
+    return static_cast<uint32_t>(sizeof(BlockHeader)) + (block_size + kAlign - 1) / kAlign * kAlign;
+  }
+  static uint64_t BlocksOffset(uint32_t block_count) {
+    uint64_t offset = sizeof(GlobalHeader) + sizeof(uint32_t) * static_cast<uint64_t>(block_count);
+    return (offset + kAlign - 1) / kAlign * kAlign;
+  }
+
   inline BlockHeader* get_block_header(uint32_t idx) const;
 
   inline bool check_id(BlockHeader* header) const;
 
   inline static BlockHeader* block_header(void* data) {
-    uint8_t* p = (uint8_t*)data;
+    uint8_t* p = static_cast<uint8_t*>(data);
     p -= sizeof(BlockHeader);
-    return (BlockHeader*)p;
+    return reinterpret_cast<BlockHeader*>(p);
   }
 
 private:
   FixedSizeMemPool(const FixedSizeMemPool &);
-  FixedSizeMemPool& operator==(const FixedSizeMemPool &);
+  FixedSizeMemPool& operator=(const FixedSizeMemPool &);
 
 private:
   GlobalHeader* mem_;
@@ -81,12 +96,152 @@ private:
   FreeLock free_locker_;
 };
 
+template <class AllocLock, class FreeLock>
+FixedSizeMemPool<AllocLock, FreeLock>::FixedSizeMemPool()
+: mem_(nullptr) {
+
+}
+
+template <class AllocLock, class FreeLock>
+FixedSizeMemPool<AllocLock, FreeLock>::~FixedSizeMemPool() {
+  Destory();
+}
+
+template <class AllocLock, class FreeLock>
+void FixedSizeMemPool<AllocLock, FreeLock>::Destory() {
+  if (mem_) {
+    ::free(mem_);
+    mem_ = nullptr;
+  }
+}
+
+template <class AllocLock, class FreeLock>
+bool FixedSizeMemPool<AllocLock, FreeLock>::Initialize(uint32_t block_size, uint32_t block_count) {
+  uint64_t size = TotalSize(block_size, block_count);
+  void* p = mem_ ? ::realloc(mem_, size) : ::malloc(size);
+  if (!p) return false;
+  mem_ = static_cast<GlobalHeader*>(p);
+  mem_->block_size = Stride(block_size);
+  mem_->block_count = block_count;
+  mem_->begin = 0;
+  mem_->end = block_count;
+  mem_->next_magic = 0;
+
+  for (uint32_t i = 0; i < block_count; ++i) {
+    mem_->ids[i] = i;
+    get_block_header(i)->key = 0;
+  }//end-for.
+
+  return true;
+}
+
+template <class AllocLock, class FreeLock>
+void* FixedSizeMemPool<AllocLock, FreeLock>::Alloc() {
+  uint32_t id = 0, magic = 0;
+  bool okay = false;
+
+  {
+    ScopedMutex<AllocLock> locker(alloc_locker_);
+    uint32_t b = mem_->begin;
+    if (b != mem_->end) {
+      okay = true;
+      id = mem_->ids[b];
+      b = (b == mem_->block_count ? 0 : b+1);
+      mem_->begin = b;
+      magic = mem_->next_magic + 1;
+      if (magic == 0) magic = 1;
+      mem_->next_magic = magic;
+    }//end-if.
+  }
+
+  if (okay) {
+    BlockHeader* header = get_block_header(id);
+    header->k.magic = magic;
+    header->k.id = id;
+    return header->data;
+  }
+  return nullptr;
+}
+
+template <class AllocLock, class FreeLock>
+bool FixedSizeMemPool<AllocLock, FreeLock>::Free(void* block) {
+  BlockHeader* bh = block_header(block);
+  if (check_id(bh) && bh->k.magic != 0) {
+    uint32_t id = bh->k.id;
+    bh->key = 0;
+    {
+      ScopedMutex<FreeLock> locker(free_locker_);
+      uint32_t e = mem_->end;
+      mem_->ids[e] = id;
+      e = (e == mem_->block_count ? 0 : e+1);
+      mem_->end = e;
+    }
+    return true;
+  }//end-if
+  return false;
+}
+
+template <class AllocLock, class FreeLock>
+uint32_t FixedSizeMemPool<AllocLock, FreeLock>::GetBlockSize() const {
+  return mem_->block_size - static_cast<uint32_t>(sizeof(BlockHeader));
+}
+
+template <class AllocLock, class FreeLock>
+uint32_t FixedSizeMemPool<AllocLock, FreeLock>::GetBlockCount() const {
+  return mem_->block_count;
+}
+
+template <class AllocLock, class FreeLock>
+uint32_t FixedSizeMemPool<AllocLock, FreeLock>::GetUsedCount() const {
+  return mem_->block_count - GetFreeCount();
+}
+
+// The free ring has block_count + 1 slots.
+template <class AllocLock, class FreeLock>
+uint32_t FixedSizeMemPool<AllocLock, FreeLock>::GetFreeCount() const {
+  uint32_t b = mem_->begin, e = mem_->end;
+  return e >= b ? e - b : mem_->block_count + 1 - b + e;
+}
+
+template <class AllocLock, class FreeLock>
+uint64_t FixedSizeMemPool<AllocLock, FreeLock>::GetKey(void* block) const {
+  BlockHeader* header = block_header(block);
+  if (check_id(header) && header->k.magic != 0) return header->key;
+  return 0;
+}
+
+template <class AllocLock, class FreeLock>
+void* FixedSizeMemPool<AllocLock, FreeLock>::GetBlock(uint64_t key) const {
+  uint32_t id = static_cast<uint32_t>(key);
+  if ((key >> 32) == 0) return nullptr;
+  if (!mem_ || id >= mem_->block_count) return nullptr;
+  BlockHeader* header = get_block_header(id);
+  return (header->key == key ? header->data : nullptr);
+}
 
-template <class T, class AlockLock=MutexType, class FreeLock=MutexType>
+template <class AllocLock, class FreeLock>
+typename FixedSizeMemPool<AllocLock, FreeLock>::BlockHeader*
+FixedSizeMemPool<AllocLock, FreeLock>::get_block_header(uint32_t idx) const {
+  uint8_t* p = reinterpret_cast<uint8_t*>(mem_);
+  p += BlocksOffset(mem_->block_count) + static_cast<uint64_t>(idx) * mem_->block_size;
+  return reinterpret_cast<BlockHeader*>(p);
+}
+
+template <class AllocLock, class FreeLock>
+bool FixedSizeMemPool<AllocLock, FreeLock>::check_id(BlockHeader* header) const {
+  return (header->k.id < mem_->block_count) && (header == get_block_header(header->k.id));
+}
+
+
+// Objects of type T in a FixedSizeMemPool, see there for the keys.
+template <class T, class AllocLock=MutexType, class FreeLock=MutexType>
 class FixedSizeAllocator {
 public:
-  bool Initialze(uint32_t count) {
-    return mem_pool_.Initialze(sizeof(T), count);
+  static_assert(alignof(T) <= FixedSizeMemPool<AllocLock, FreeLock>::kAlign,
+      "type over-aligned for FixedSizeMemPool");
+
+  bool Initialize(uint32_t count) {
+    return mem_pool_.Initialize(static_cast<uint32_t>(sizeof(T)), count);
   }
 
   inline uint32_t Capacity() const {
@@ -97,12 +252,12 @@ public:
     return mem_pool_.GetUsedCount();
   }
 
-  inline uint32_t GetKey(T* block) const {
+  inline uint64_t GetKey(T* block) const {
     return mem_pool_.GetKey(block);
   }
 
   inline T* GetBlock(uint64_t key) const {
-    return (T*)(mem_pool_.GetBlock(key));
+    return static_cast<T*>(mem_pool_.GetBlock(key));
   }
 
   inline bool Check(T* block) const {
@@ -114,17 +269,16 @@ public:
     return mem_pool_.Free(obj);
   }
 
-  inline T* Allocate() {
-    void* obj = mem_pool_.Alloc();
-    if (obj) return new(obj) T();
-    return nullptr;
-  }
-
-  template <class P>
-  inline T* Allocate(const P& p) {
+  template <class... Args>
+  inline T* Allocate(Args&&... args) {
     void* obj = mem_pool_.Alloc();
-    if (obj) return new(obj) T(p);
-    return nullptr;
+    if (!obj) return nullptr;
+    try {
+      return new(obj) T(std::forward<Args>(args)...);
+    } catch (...) {
+      mem_pool_.Free(obj);
+      throw;
+    }
   }
 
 private:
@@ -17,6 +17,22 @@ namespace cromwell {
 #define HAVE_EPOLL 1
 #endif
 
+/* Loop wakeups, a pipe elsewhere */
+#ifdef __linux__
+#define HAVE_EVENTFD 1
+#endif
+
+/* Signals as file events, see SeCreateSignalEvent */
+#ifdef __linux__
+#define HAVE_SIGNALFD 1
+#endif
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define HAVE_IO_URING 1
+#endif
+#endif
+
 #if (defined(__APPLE__) && defined(MAC_OS_X_VERSION_10_6)) || defined(__FreeBSD__) || defined(__OpenBSD__) || defined (__NetBSD__)
 #define HAVE_KQUEUE 1
 #endif
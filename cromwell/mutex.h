@@ -23,7 +23,7 @@ public:
 class MutexType {
 public:
 	MutexType() {
-		pthread_mutex_init(&mutex_);
+		pthread_mutex_init(&mutex_, NULL);
 	}
 
 	~MutexType() {
@@ -0,0 +1,18 @@
+#ifndef __CROMWELL_NONCOPYABLE_H
+#define __CROMWELL_NONCOPYABLE_H
+
+namespace cromwell {
+
+class noncopyable {
+protected:
+  noncopyable() {}
+  ~noncopyable() {}
+
+private:
+  noncopyable(const noncopyable&);
+  const noncopyable& operator=(const noncopyable&);
+};
+
+}//end-cromwell.
+
+#endif
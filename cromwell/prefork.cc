@@ -0,0 +1,80 @@
+#include "prefork.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "socket_opt.h"
+#include "thread.h"
+
+namespace cromwell {
+
+Prefork::Prefork(int workers)
+  : first_cpu_(-1),
+  workers_(static_cast<size_t>(workers > 0 ? workers : 1)) {
+  for (size_t i = 0; i < workers_.size(); ++i) {
+    workers_[i].pid = -1;
+    workers_[i].fd = -1;
+  }//end-for.
+}
+
+Prefork::~Prefork() {
+}
+
+bool Prefork::Start(const WorkerMain& main) {
+  long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+  if (ncpus < 1) ncpus = 1;
+  for (size_t i = 0; i < workers_.size(); ++i) {
+    int pair[2];
+    if (socket_create_seqpacket_pair(nullptr, pair) == -1) return false;
+    // Whatever is buffered would be written twice.
+    fflush(nullptr);
+    pid_t pid = fork();
+    if (pid == -1) {
+      close(pair[0]);
+      close(pair[1]);
+      return false;
+    }
+    if (pid == 0) {
+      close(pair[0]);
+      for (size_t j = 0; j < i; ++j) close(workers_[j].fd);
+      // Best effort, as for loop threads.
+      if (first_cpu_ >= 0) Thread::SetAffinity(static_cast<int>((first_cpu_ + static_cast<long>(i)) % ncpus));
+      int status = main(static_cast<int>(i), pair[1]);
+      fflush(nullptr);
+      // The master's atexit handlers and static objects are not ours.
+      _exit(status);
+    }
+    close(pair[1]);
+    workers_[i].pid = pid;
+    workers_[i].fd = pair[0];
+  }//end-for.
+  return true;
+}
+
+void Prefork::Signal(int sig) {
+  for (size_t i = 0; i < workers_.size(); ++i) {
+    if (workers_[i].pid > 0) kill(workers_[i].pid, sig);
+  }//end-for.
+}
+
+int Prefork::Reap(bool block) {
+  int running = 0;
+  for (size_t i = 0; i < workers_.size(); ++i) {
+    if (workers_[i].pid <= 0) continue;
+    pid_t pid;
+    do {
+      pid = waitpid(workers_[i].pid, nullptr, block ? 0 : WNOHANG);
+    } while (pid == -1 && errno == EINTR);
+    if (pid == 0) {
+      ++running;
+    } else {
+      workers_[i].pid = -1; // exited, or not our child after all
+    }
+  }//end-for.
+  return running;
+}
+
+}//end-cromwell.
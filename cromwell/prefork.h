@@ -0,0 +1,64 @@
+#ifndef __CROMWELL_PREFORK_H
+#define __CROMWELL_PREFORK_H
+
+#include <sys/types.h>
+
+#include <functional>
+#include <vector>
+
+#include "noncopyable.h"
+
+namespace cromwell {
+
+// Forks worker processes, each tied to the master by a seqpacket socket
+// pair to wrap in an FdChannel, and optionally pinned to a cpu. The master
+// passes them listeners, so every worker accepts for itself, or the
+// connections it accepted; a worker that crashes takes only its own
+// connections down.
+//
+// Start before the master creates loops or threads: a child gets a copy
+// of the forking thread only, and of every fd.
+class Prefork : noncopyable {
+public:
+  // The body of worker index, with its end of the pair; returns the exit
+  // status of the process.
+  typedef std::function<int(int index, int sockfd)> WorkerMain;
+
+  explicit Prefork(int workers);
+  // Leaves the workers running, see Signal and Reap.
+  ~Prefork();
+
+  // Pin worker i to cpu (first_cpu + i) % cpus, -1 (the default) disables
+  // pinning. Before Start.
+  void SetFirstCpu(int first_cpu) { first_cpu_ = first_cpu; }
+
+  // Fork every worker; returns in the master only, false if a fork failed
+  // (the workers forked so far keep running).
+  bool Start(const WorkerMain& main);
+
+  int Workers() const { return static_cast<int>(workers_.size()); }
+  pid_t Pid(int index) const { return workers_[index].pid; }
+  // The master's end of the pair to worker index, for an FdChannel, which
+  // then owns it.
+  int Fd(int index) const { return workers_[index].fd; }
+
+  // Send sig to every worker still running.
+  void Signal(int sig);
+  // Collect the workers that exited, waiting for all of them with block.
+  // Returns how many still run.
+  int Reap(bool block);
+
+private:
+  struct Worker {
+    pid_t pid; // -1 once reaped
+    int fd;
+  };
+
+private:
+  int first_cpu_;
+  std::vector<Worker> workers_;
+};
+
+}//end-cromwell.
+
+#endif
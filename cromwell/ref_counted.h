@@ -0,0 +1,74 @@
+#ifndef __CROMWELL_REF_COUNTED_H
+#define __CROMWELL_REF_COUNTED_H
+
+#include <stddef.h>
+
+#include "noncopyable.h"
+
+namespace cromwell {
+
+// Intrusive reference count: the count lives in the object, so taking a
+// reference is one atomic add with no control block to allocate or lock.
+// Objects are created with a count of 0 and deleted by the Release that
+// brings it back to 0; hold them in a RefPtr.
+class RefCounted : noncopyable {
+public:
+  void AddRef() const {
+    __atomic_add_fetch(&refs_, 1, __ATOMIC_RELAXED);
+  }
+  void Release() const {
+    if (__atomic_sub_fetch(&refs_, 1, __ATOMIC_ACQ_REL) == 0) Destroy();
+  }
+  int RefCount() const { return __atomic_load_n(&refs_, __ATOMIC_RELAXED); }
+
+protected:
+  RefCounted() : refs_(0) {}
+  virtual ~RefCounted() {}
+  // Called by the last Release; objects that do not come from new, e.g.
+  // from a pool, hand their memory back here.
+  virtual void Destroy() const { delete this; }
+
+private:
+  mutable int refs_;
+};
+
+template <typename T>
+class RefPtr {
+public:
+  RefPtr() : ptr_(nullptr) {}
+  RefPtr(T* ptr) : ptr_(ptr) { if (ptr_) ptr_->AddRef(); }
+  RefPtr(const RefPtr& other) : ptr_(other.ptr_) { if (ptr_) ptr_->AddRef(); }
+  RefPtr(RefPtr&& other) : ptr_(other.ptr_) { other.ptr_ = nullptr; }
+  template <typename U>
+  RefPtr(const RefPtr<U>& other) : ptr_(other.get()) { if (ptr_) ptr_->AddRef(); }
+  ~RefPtr() { if (ptr_) ptr_->Release(); }
+
+  RefPtr& operator=(RefPtr other) {
+    Swap(other);
+    return *this;
+  }
+
+  void Reset(T* ptr = nullptr) { RefPtr(ptr).Swap(*this); }
+  void Swap(RefPtr& other) {
+    T* tmp = ptr_;
+    ptr_ = other.ptr_;
+    other.ptr_ = tmp;
+  }
+
+  T* get() const { return ptr_; }
+  T* operator->() const { return ptr_; }
+  T& operator*() const { return *ptr_; }
+  explicit operator bool() const { return ptr_ != nullptr; }
+
+private:
+  T* ptr_;
+};
+
+template <typename T, typename U>
+inline bool operator==(const RefPtr<T>& a, const RefPtr<U>& b) { return a.get() == b.get(); }
+template <typename T, typename U>
+inline bool operator!=(const RefPtr<T>& a, const RefPtr<U>& b) { return a.get() != b.get(); }
+
+}//end-cromwell.
+
+#endif
@@ -9,81 +9,271 @@
 #include <string.h>
 #include <time.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+
+#include "macros.h"
+#include "se_timer.h"
+
+#ifdef HAVE_EVENTFD
+#include <sys/eventfd.h>
+#endif
+
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
+
+#ifdef HAVE_SIGNALFD
+#include <signal.h>
+#include <sys/signalfd.h>
+#endif
+
+namespace cromwell {
+
+/* The event of fd, or NULL if its page was never allocated. */
+static inline SeFileEvent* SeFileEventAt(SeEventLoop* event_loop, int fd) {
+    SeFileEvent* page;
+
+    if (fd < 0 || fd >= event_loop->setsize) return NULL;
+    page = event_loop->pages[fd >> SE_PAGE_BITS];
+    return page ? &page[fd & (SE_PAGE_SIZE - 1)] : NULL;
+}
+
+}//end-cromwell.
 
 /* Include the best multiplexing layer supported by this system.
  * The following should be ordered by performances, descending. */
 #ifdef HAVE_EPOLL
-	#include "se_epool.cc"
+	#include "se_epoll.cc"
 #else
 	#include "se_select.cc"
 #endif
 
+/* io_uring is opt-in per loop and falls back to the layer above. */
+#ifdef HAVE_IO_URING
+	#include "se_uring.cc"
+#endif
+
 namespace cromwell {
 
+/* Function set of a multiplexing layer. */
+typedef struct SeApi {
+    const char* (*name)(void);
+    int (*create)(SeEventLoop* event_loop);
+    int (*resize)(SeEventLoop* event_loop, int setsize);
+    void (*free)(SeEventLoop* event_loop);
+    int (*add_event)(SeEventLoop* event_loop, int fd, int mask);
+    void (*del_event)(SeEventLoop* event_loop, int fd, int delmask);
+    void (*mod_event)(SeEventLoop* event_loop, int fd, int mask);
+    int (*poll)(SeEventLoop* event_loop, long long timeout); /* ns, -1 blocks */
+    int flags; /* SE_EVENT_FLAGS the layer can honor */
+} SeApi;
+
+static const SeApi se_native_api = {
+    api_name, api_create, api_resize, api_free,
+    api_add_event, api_del_event, api_mod_event, api_poll,
+    api_flags,
+};
+
+#ifdef HAVE_IO_URING
+static const SeApi se_uring_api = {
+    uring_name, uring_create, uring_resize, uring_free,
+    uring_add_event, uring_del_event, uring_mod_event, uring_poll,
+    uring_flags,
+};
+#endif
+
+/* Timers run on CLOCK_MONOTONIC so wall clock steps (NTP, settimeofday)
+ * neither delay them nor fire them all at once. */
+static long long SeMonotonicNanoseconds(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<long long>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+static void SeHandleWakeup(SeEventLoop* event_loop, int fd, void* client, int mask);
+static void SeFreePages(SeEventLoop* event_loop);
+static void SeFreeSignals(SeEventLoop* event_loop);
+
+/* Open the fd other threads write to when they queue a task, and watch it
+ * in the loop. An eventfd needs one fd and one syscall per wakeup; the
+ * pipe fallback is only used where eventfd does not exist. */
+static int SeCreateWakeup(SeEventLoop* event_loop) {
+    int fd;
+#ifdef HAVE_EVENTFD
+    if ((fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1) return SE_ERR;
+    event_loop->wakeup_fd[0] = event_loop->wakeup_fd[1] = fd;
+#else
+    if (pipe(event_loop->wakeup_fd) == -1) return SE_ERR;
+    for (int i = 0; i < 2; ++i) {
+        fcntl(event_loop->wakeup_fd[i], F_SETFL, fcntl(event_loop->wakeup_fd[i], F_GETFL) | O_NONBLOCK);
+        fcntl(event_loop->wakeup_fd[i], F_SETFD, FD_CLOEXEC);
+    }
+    fd = event_loop->wakeup_fd[0];
+#endif
+    if (SeCreateFileEvent(event_loop, fd, SE_READABLE, SeHandleWakeup, NULL) == SE_OK)
+        return SE_OK;
+    close(event_loop->wakeup_fd[0]);
+    if (event_loop->wakeup_fd[1] != event_loop->wakeup_fd[0])
+        close(event_loop->wakeup_fd[1]);
+    return SE_ERR;
+}
+
+static void SeCloseWakeup(SeEventLoop* event_loop) {
+    SeDeleteFileEvent(event_loop, event_loop->wakeup_fd[0], SE_READABLE);
+    close(event_loop->wakeup_fd[0]);
+    if (event_loop->wakeup_fd[1] != event_loop->wakeup_fd[0])
+        close(event_loop->wakeup_fd[1]);
+}
+
 SeEventLoop* SeCreateEventLoop(int setsize) {
+    return SeCreateEventLoopWithApi(setsize, NULL);
+}
+
+/* Create a loop on the named multiplexing layer ("io_uring", or NULL for
+ * the native one). When the requested layer is not available, e.g. the
+ * kernel lacks io_uring or it is disabled by seccomp, the native layer is
+ * used instead; SeGetApiName tells which one the loop ended up with.
+ *
+ * setsize no longer bounds the fds the loop can watch: the event table
+ * starts with one page and grows with the highest fd registered. It only
+ * caps the number of events returned per poll, at most SE_POLL_BATCH. */
+SeEventLoop* SeCreateEventLoopWithApi(int setsize, const char* api) {
     SeEventLoop* event_loop;
-    int i;
-
-    if ((event_loop = malloc(sizeof(*event_loop))) == NULL) goto err;
-    event_loop->events = malloc(sizeof(SeFileEvent)*setsize);
-    event_loop->fired = malloc(sizeof(SeFiredEvent)*setsize);
-    if (event_loop->ievents == NULL || event_loop->fired == NULL) goto err;
-    event_loop->setsize = setsize;
-    event_loop->last_time = time(NULL);
-    event_loop->time_event_head = NULL;
-    event_loop->time_event_next_id = 0;
+
+    if ((event_loop = static_cast<SeEventLoop*>(calloc(1, sizeof(*event_loop)))) == NULL) goto err;
+    event_loop->batch = setsize < SE_POLL_BATCH ? (setsize > 0 ? setsize : 1) : SE_POLL_BATCH;
+    event_loop->setsize = SE_PAGE_SIZE;
+    event_loop->pages = static_cast<SeFileEvent**>(calloc(1, sizeof(SeFileEvent*)));
+    event_loop->fired = static_cast<SeFiredEvent*>(malloc(sizeof(SeFiredEvent) * event_loop->batch * 2));
+    event_loop->order = static_cast<int*>(malloc(sizeof(int) * event_loop->batch * 2));
+    event_loop->carry = NULL;
+    event_loop->carry_tail = &event_loop->carry;
+    event_loop->changes_size = 64;
+    event_loop->changes = static_cast<SeFileEvent**>(malloc(sizeof(SeFileEvent*) * event_loop->changes_size));
+    event_loop->now = SeMonotonicNanoseconds();
+    event_loop->timers = SeTimerCreate(event_loop->now);
+    event_loop->timer_slack = SE_TIMER_SLACK;
+    event_loop->metrics.callback_max_fd = -1;
+    if (event_loop->pages == NULL || event_loop->fired == NULL || event_loop->order == NULL ||
+        event_loop->changes == NULL || event_loop->timers == NULL) goto err;
+    event_loop->nchanges = 0;
+    event_loop->changes_saved = 0;
     event_loop->stop = 0;
     event_loop->maxfd = -1;
+    event_loop->registered = 0;
     event_loop->before_sleep = NULL;
-    if (api_create(event_loop) == -1) goto err;
-    /* Events with mask == SE_NONE are not set. So let's initialize the
-     * vector with it. */
-    for (i = 0; i < setsize; i++)
-        event_loop->events[i].mask = SE_NONE;
+    event_loop->flushes = NULL;
+    event_loop->signals = NULL;
+    event_loop->tasks = NULL;
+    event_loop->thread = pthread_self();
+    event_loop->api = &se_native_api;
+#ifdef HAVE_IO_URING
+    if (api && strcmp(api, uring_name()) == 0)
+        event_loop->api = &se_uring_api;
+#endif
+    if (event_loop->api->create(event_loop) == -1) {
+        if (event_loop->api == &se_native_api) goto err;
+        event_loop->api = &se_native_api;
+        if (event_loop->api->create(event_loop) == -1) goto err;
+    }
+    if (SeCreateWakeup(event_loop) == SE_ERR) {
+        event_loop->api->free(event_loop);
+        goto err;
+    }
     return event_loop;
 
 err:
     if (event_loop) {
-        free(eventLoop->events);
-        free(eventLoop->fired);
-        free(eventLoop);
+        SeFreePages(event_loop);
+        free(event_loop->fired);
+        free(event_loop->order);
+        free(event_loop->changes);
+        SeTimerFree(event_loop->timers);
+        free(event_loop);
     }
     return NULL;
 }
 
+static void SeFreePages(SeEventLoop* event_loop) {
+    if (!event_loop->pages) return;
+    for (int i = 0; i < (event_loop->setsize >> SE_PAGE_BITS); ++i)
+        free(event_loop->pages[i]);
+    free(event_loop->pages);
+}
+
+/* Make the table cover fd, at least doubling it so growth is amortized. */
+static int SeGrowTable(SeEventLoop* event_loop, int fd) {
+    int npages = event_loop->setsize >> SE_PAGE_BITS;
+    int want = (fd >> SE_PAGE_BITS) + 1;
+
+    if (want < npages * 2) want = npages * 2;
+    if (event_loop->api->resize(event_loop, want << SE_PAGE_BITS) == -1) return SE_ERR;
+    SeFileEvent** pages = static_cast<SeFileEvent**>(realloc(event_loop->pages, sizeof(SeFileEvent*) * want));
+    if (!pages) return SE_ERR;
+    memset(pages + npages, 0, sizeof(SeFileEvent*) * (want - npages));
+    event_loop->pages = pages;
+    event_loop->setsize = want << SE_PAGE_BITS;
+    return SE_OK;
+}
+
+/* The event of fd, allocating its page (and growing the table) on first
+ * use. Pages are never released before the loop, so pointers handed to
+ * the kernel or sitting in fired[] stay valid. */
+static SeFileEvent* SeFileEventSlot(SeEventLoop* event_loop, int fd) {
+    if (fd >= event_loop->setsize && SeGrowTable(event_loop, fd) == SE_ERR) return NULL;
+
+    SeFileEvent** page = &event_loop->pages[fd >> SE_PAGE_BITS];
+    if (*page == NULL) {
+        SeFileEvent* events = static_cast<SeFileEvent*>(malloc(sizeof(SeFileEvent) * SE_PAGE_SIZE));
+        if (!events) return NULL;
+        /* Events with mask == SE_NONE are not set. */
+        for (int i = 0; i < SE_PAGE_SIZE; ++i) {
+            events[i].fd = (fd & ~(SE_PAGE_SIZE - 1)) + i;
+            events[i].mask = SE_NONE;
+            events[i].kmask = SE_NONE;
+            events[i].changed = 0;
+            events[i].flags = 0;
+            events[i].prio = SE_PRIO_INTERACTIVE;
+            events[i].carry_mask = SE_NONE;
+            events[i].carried = 0;
+            events[i].budget = 0;
+            events[i].spent = 0;
+            events[i].carry_next = NULL;
+        }
+        *page = events;
+    }
+    return &(*page)[fd & (SE_PAGE_SIZE - 1)];
+}
+
 /* Return the current set size. */
 int SeGetSetSize(SeEventLoop *event_loop) {
     return event_loop->setsize;
 }
 
-/* Resize the maximum set size of the event loop.
- * If the requested set size is smaller than the current set size, but
- * there is already a file descriptor in use that is >= the requested
- * set size minus one, SE_ERR is returned and the operation is not
- * performed at all.
- *
- * Otherwise SE_OK is returned and the operation is successful. */
+/* The table grows by itself when an fd beyond it is registered, so this
+ * is only kept for callers that want to reserve room up front. Asking
+ * for less than the highest registered fd fails with SE_ERR; otherwise
+ * a smaller size is accepted and nothing is released. */
 int SeResizeSetSize(SeEventLoop* event_loop, int setsize) {
-
-    if (setsize == event_loop->setsize) return SE_OK;
     if (event_loop->maxfd >= setsize) return SE_ERR;
-    if (se_api_resize(event_loop, setsize) == -1) return SE_ERR;
-
-    event_loop->events = realloc(event_loop->events, sizeof(SeFileEvent) * setsize);
-    event_loop->fired = realloc(event_loop->fired, sizeof(SeFiredEvent) * setsize);
-    event_loop->setsize = setsize;
-
-    /* Make sure that if we created new slots, they are initialized with
-     * an SE_NONE mask. */
-    for (int i = event_loop->maxfd+1; i < setsize; ++i)
-        event_loop->events[i].mask = SE_NONE;
-    return SE_OK;
+    if (setsize <= event_loop->setsize) return SE_OK;
+    return SeGrowTable(event_loop, setsize - 1);
 }
 
+/* Tasks still queued at this point are dropped without being run. */
 void SeDeleteEventLoop(SeEventLoop* event_loop) {
-    api_free(event_loop);
-    free(event_loop->events);
+    /* Finalizers may still use the loop, run them while it is intact. */
+    SeTimerFinalizeAll(event_loop->timers, event_loop);
+    SeFreeSignals(event_loop);
+    SeCloseWakeup(event_loop);
+    event_loop->api->free(event_loop);
+    SeFreePages(event_loop);
     free(event_loop->fired);
+    free(event_loop->order);
+    free(event_loop->changes);
+    SeTimerFree(event_loop->timers);
     free(event_loop);
 }
 
@@ -91,15 +281,82 @@ void SeStop(SeEventLoop* event_loop) {
     event_loop->stop = 1;
 }
 
+/* Remember that the mask of fe changed. Every change counts as a saved
+ * syscall here and SeFlushChanges takes back the ones it really issues. */
+static void SeQueueChange(SeEventLoop* event_loop, SeFileEvent* fe) {
+    ++event_loop->changes_saved;
+    if (fe->changed) return;
+    if (event_loop->nchanges == event_loop->changes_size) {
+        int size = event_loop->changes_size * 2;
+        SeFileEvent** changes = static_cast<SeFileEvent**>(realloc(event_loop->changes, sizeof(SeFileEvent*) * size));
+        if (!changes) {
+            /* Out of memory: apply it now rather than lose it. */
+            event_loop->api->mod_event(event_loop, fe->fd, fe->mask);
+            fe->kmask = fe->mask;
+            return;
+        }
+        event_loop->changes = changes;
+        event_loop->changes_size = size;
+    }
+    fe->changed = 1;
+    event_loop->changes[event_loop->nchanges++] = fe;
+}
+
+/* Push the net mask change of every queued fd to the multiplexing layer.
+ * An fd whose writable interest was switched on and off by the same
+ * callback ends up with mask == kmask and costs nothing. */
+static void SeFlushChanges(SeEventLoop* event_loop) {
+    for (int i = 0; i < event_loop->nchanges; ++i) {
+        SeFileEvent* fe = event_loop->changes[i];
+
+        if (!fe->changed) continue; /* removed meanwhile */
+        fe->changed = 0;
+        if (fe->mask == fe->kmask) continue;
+        event_loop->api->mod_event(event_loop, fe->fd, fe->mask);
+        fe->kmask = fe->mask;
+        --event_loop->changes_saved;
+    }//end-for.
+    event_loop->nchanges = 0;
+}
+
 int SeCreateFileEvent(SeEventLoop *event_loop, int fd, int mask, SeFileProc *proc, void *client) {
-    if (fd >= event_loop->setsize) {
-        errno = ERANGE;
+    SeFileEvent *fe = SeFileEventSlot(event_loop, fd);
+    if (fe == NULL) {
+        errno = ENOMEM;
         return SE_ERR;
     }
-    SeFileEvent *fe = &event_loop->events[fd];
+    int flags = mask & SE_EVENT_FLAGS;
 
-    if (api_add_event(event_loop, fd, mask) == -1)
+    /* Better refused than registered with different semantics. */
+    if (flags & ~event_loop->api->flags) {
+        errno = EINVAL;
         return SE_ERR;
+    }
+    mask &= ~SE_EVENT_FLAGS;
+    /* A new registration goes to the kernel right away so errors such as
+     * EPERM on a regular file reach the caller. Changes to an fd that is
+     * already registered are deferred to SeFlushChanges. */
+    if (fe->mask == SE_NONE) {
+        fe->flags = flags;
+        if (event_loop->api->add_event(event_loop, fd, mask) == -1) {
+            fe->flags = 0;
+            return SE_ERR;
+        }
+        fe->kmask = mask;
+        __atomic_store_n(&event_loop->registered, event_loop->registered + 1, __ATOMIC_RELAXED);
+    } else if ((fe->flags | flags) != fe->flags) {
+        /* The kernel cannot turn a registration exclusive afterwards. */
+        if ((flags & SE_EXCLUSIVE) && !(fe->flags & SE_EXCLUSIVE)) {
+            errno = EINVAL;
+            return SE_ERR;
+        }
+        /* Rare enough to apply right away rather than track it. */
+        fe->flags |= flags;
+        event_loop->api->mod_event(event_loop, fd, fe->mask | mask);
+        fe->kmask = fe->mask | mask;
+    } else if ((fe->mask | mask) != fe->mask) {
+        SeQueueChange(event_loop, fe);
+    }
     fe->mask |= mask;
     if (mask & SE_READABLE) fe->rfile_proc = proc;
     if (mask & SE_WRITABLE) fe->wfile_proc = proc;
@@ -110,180 +367,355 @@ int SeCreateFileEvent(SeEventLoop *event_loop, int fd, int mask, SeFileProc *pro
 }//end-SeCreateFileEvent.
 
 void SeDeleteFileEvent(SeEventLoop *event_loop, int fd, int mask) {
-    if (fd >= event_loop->setsize) return;
-    SeFileEvent *fe = &event_loop->events[fd];
-    if (fe->mask == SE_NONE) return;
+    SeFileEvent *fe = SeFileEventAt(event_loop, fd);
+    if (fe == NULL || fe->mask == SE_NONE) return;
 
-    api_del_event(event_loop, fd, mask);
+    if ((fe->mask & ~mask) == SE_NONE) {
+        /* Full removal is never deferred: the caller is likely to close
+         * the fd next, and the number may be reused before we flush. */
+        event_loop->api->del_event(event_loop, fd, fe->mask | fe->kmask);
+        fe->kmask = SE_NONE;
+        fe->changed = 0;
+        fe->flags = 0;
+        /* Left on the carry list if it is there, SeTakeCarried drops it. */
+        fe->carry_mask = SE_NONE;
+        fe->prio = SE_PRIO_INTERACTIVE;
+        fe->budget = 0;
+        __atomic_store_n(&event_loop->registered, event_loop->registered - 1, __ATOMIC_RELAXED);
+    } else if (fe->mask & mask) {
+        SeQueueChange(event_loop, fe);
+    }
     fe->mask = fe->mask & (~mask);
     if (fd == event_loop->maxfd && fe->mask == SE_NONE) {
         /* Update the max fd */
         int j;
-        for (j = event_loop->maxfd-1; j >= 0; --j)
-            if (event_loop->events[j].mask != SE_NONE) break;
+        for (j = event_loop->maxfd-1; j >= 0; --j) {
+            SeFileEvent* e = SeFileEventAt(event_loop, j);
+            if (e == NULL) j &= ~(SE_PAGE_SIZE - 1); /* skip the whole page */
+            else if (e->mask != SE_NONE) break;
+        }
         event_loop->maxfd = j;
     }
 }//end-SeDeleteFileEvent.
 
-int SeGetFileEvents(SeEventLoop* event_loop, int fd) {
-    if (fd >= event_loop->setsize) return 0;
-    SeFileEvent* fe = &event_loop->events[fd];
+/* Re-enable an SE_ONESHOT fd after it reported an event. Only touches the
+ * kernel registration, so the worker thread the fd was handed to may call
+ * it as long as nobody changes the fd's events concurrently. SE_ONESHOT
+ * only registers on epoll, whose EPOLL_CTL_MOD is safe from any thread;
+ * on the other layers, and for an fd without the flag, this fails with
+ * EINVAL before it reaches state only the loop thread may touch. */
+int SeRearmFileEvent(SeEventLoop* event_loop, int fd) {
+    SeFileEvent* fe = SeFileEventAt(event_loop, fd);
+    if (fe == NULL || fe->kmask == SE_NONE) return SE_ERR;
+    if (!(fe->flags & SE_ONESHOT)) {
+        errno = EINVAL;
+        return SE_ERR;
+    }
 
-    return fe->mask;
-}//end-SeGetFileEvents.
+    event_loop->api->mod_event(event_loop, fd, fe->kmask);
+    return SE_OK;
+}//end-SeRearmFileEvent.
 
-static void SeGetTime(long *seconds, long *milliseconds) {
-    struct timeval tv;
+/* Put a registered fd in dispatch class prio (SE_PRIO_*) and give it a
+ * budget of units per dispatch, 0 for none. The units are whatever the
+ * callbacks charge with SeChargeFileEvent, typically bytes or messages.
+ * Both are reset when the fd is fully removed. */
+int SeSetFileEventClass(SeEventLoop* event_loop, int fd, int prio, long long budget) {
+    SeFileEvent* fe = SeFileEventAt(event_loop, fd);
 
-    gettimeofday(&tv, NULL);
-    *seconds = tv.tv_sec;
-    *milliseconds = tv.tv_usec/1000;
-}
+    if (fe == NULL || fe->mask == SE_NONE ||
+        prio < 0 || prio >= SE_PRIO_CLASSES || budget < 0) return SE_ERR;
+    fe->prio = prio;
+    fe->budget = budget;
+    return SE_OK;
+}//end-SeSetFileEventClass.
 
-static void SeAddMillisecondsToNow(long long milliseconds, long *sec, long *ms) {
-    long cur_sec, cur_ms, when_sec, when_ms;
+/* Charge units of work to fd from its callback. Returns 1 once the fd has
+ * used up its budget for this dispatch: the callback should return then
+ * even though more data may be waiting, and the loop dispatches mask again
+ * in its next iteration, after the other ready fds and without waiting
+ * for the kernel to report it, so edge triggered fds lose nothing.
+ * Returns 0 while the budget lasts or when the fd has none. */
+int SeChargeFileEvent(SeEventLoop* event_loop, int fd, int mask, long long units) {
+    SeFileEvent* fe = SeFileEventAt(event_loop, fd);
 
-    SeGetTime(&cur_sec, &cur_ms);
-    when_sec = cur_sec + milliseconds/1000;
-    when_ms = cur_ms + milliseconds%1000;
-    if (when_ms >= 1000) {
-        when_sec ++;
-        when_ms -= 1000;
+    if (fe == NULL || fe->mask == SE_NONE) return 0;
+    fe->spent += units;
+    if (fe->budget == 0 || fe->spent < fe->budget) return 0;
+    fe->carry_mask |= mask & fe->mask;
+    if (!fe->carried) {
+        fe->carried = 1;
+        fe->carry_next = NULL;
+        *event_loop->carry_tail = fe;
+        event_loop->carry_tail = &fe->carry_next;
     }
-    *sec = when_sec;
-    *ms = when_ms;
-}
+    return 1;
+}//end-SeChargeFileEvent.
 
-long long SeCreateTimeEvent(SeEventLoop* event_loop, long long milliseconds,
+/* Append the events carried over from the last iteration to the polled
+ * ones in fired[], at most batch of them; an fd that was polled ready too
+ * is only dispatched once. */
+static int SeTakeCarried(SeEventLoop* event_loop, int numevents) {
+    int limit = numevents + event_loop->batch;
+    SeFileEvent *fe, **link;
+
+    if (event_loop->carry == NULL) return numevents;
+    for (int j = 0; j < numevents; ++j) {
+        fe = event_loop->fired[j].fe;
+        event_loop->fired[j].mask |= fe->carry_mask;
+        fe->carry_mask = SE_NONE;
+    }//end-for.
+    link = &event_loop->carry;
+    while ((fe = *link) != NULL) {
+        if (fe->carry_mask != SE_NONE) {
+            if (numevents == limit) {
+                link = &fe->carry_next;
+                continue;
+            }
+            event_loop->fired[numevents].fd = fe->fd;
+            event_loop->fired[numevents].mask = fe->carry_mask;
+            event_loop->fired[numevents].fe = fe;
+            ++numevents;
+            fe->carry_mask = SE_NONE;
+        }
+        fe->carried = 0;
+        *link = fe->carry_next;
+    }//end-while.
+    event_loop->carry_tail = link;
+    return numevents;
+}//end-SeTakeCarried.
+
+/* Sort the indexes of fired[] by class into order[], stable within a
+ * class. Returns NULL when every event is in the same class and fired[]
+ * can be run as it is. */
+static int* SeOrderFired(SeEventLoop* event_loop, int numevents) {
+    int start[SE_PRIO_CLASSES + 1] = {0};
+
+    for (int j = 0; j < numevents; ++j)
+        ++start[event_loop->fired[j].fe->prio + 1];
+    for (int c = 0; c < SE_PRIO_CLASSES; ++c) {
+        if (start[c + 1] == numevents) return NULL;
+        start[c + 1] += start[c];
+    }//end-for.
+    for (int j = 0; j < numevents; ++j)
+        event_loop->order[start[event_loop->fired[j].fe->prio]++] = j;
+    return event_loop->order;
+}//end-SeOrderFired.
+
+int SeGetFileEvents(SeEventLoop* event_loop, int fd) {
+    SeFileEvent* fe = SeFileEventAt(event_loop, fd);
+
+    return fe ? fe->mask : SE_NONE;
+}//end-SeGetFileEvents.
+
+/* The client an fd was registered with, NULL if it is not registered. */
+void* SeGetFileEventClient(SeEventLoop* event_loop, int fd) {
+    SeFileEvent* fe = SeFileEventAt(event_loop, fd);
+
+    return fe && fe->mask != SE_NONE ? fe->client : NULL;
+}//end-SeGetFileEventClient.
+
+/* Schedule proc after delay units of unit nanoseconds. The value proc
+ * returns to be called again is counted in the same unit. */
+static long long SeAddTimeEvent(SeEventLoop* event_loop, long long delay, long long unit,
         SeTimeProc *proc, void *client, SeEventFinalizerProc *finalizer_proc) {
-    long long id = event_loop->time_event_next_id++;
-    SeTimeEvent *te;
+    SeTimeEvent *te = SeTimerAlloc(event_loop->timers);
 
-    te = malloc(sizeof(*te));
     if (te == NULL) return SE_ERR;
-    te->id = id;
-    SeAddMillisecondsToNow(milliseconds, &te->when_sec, &te->when_ms);
+    te->unit = unit;
     te->time_proc = proc;
     te->finalizer_proc = finalizer_proc;
     te->client = client;
-    te->next = event_loop->time_event_head;
-    event_loop->time_event_head = te;
-    return id;
-}
-
-int SeDeleteTimeEvent(SeEventLoop* eventLoop, long long id) {
-    SeTimeEvent *te, *prev = NULL;
-
-    te = eventLoop->time_event_head;
-    while(te) {
-        if (te->id == id) {
-            if (prev == NULL)
-                eventLoop->time_event_head = te->next;
-            else
-                prev->next = te->next;
-            if (te->finalizer_proc)
-                te->finalizer_proc(eventLoop, te->client);
-            free(te);
-            return SE_OK;
-        }
-        prev = te;
-        te = te->next;
+    if (SeTimerSchedule(event_loop->timers, te, event_loop->now + delay * unit) == SE_ERR) {
+        SeTimerRelease(event_loop->timers, te);
+        return SE_ERR;
     }
-    return SE_ERR; /* NO event with the specified ID found */
+    return te->id;
 }
 
-/* Search the first timer to fire.
- * This operation is useful to know how many time the select can be
- * put in sleep without to delay any event.
- * If there are no timers NULL is returned.
- *
- * Note that's O(N) since time events are unsorted.
- * Possible optimizations (not needed by Redis so far, but...):
- * 1) Insert the event in order, so that the nearest is just the head.
- *    Much better but still insertion or deletion of timers is O(N).
- * 2) Use a skiplist to have this operation as O(1) and insertion as O(log(N)).
- */
-static SeTimeEvent* SeSearchNearestTimer(SeEventLoop *event_loop) {
-    SeTimeEvent* te = event_loop->time_event_head;
-    SeTimeEvent* nearest = NULL;
-
-    while(te) {
-        if (!nearest || te->when_sec < nearest->when_sec ||
-                (te->when_sec == nearest->when_sec &&
-                 te->when_ms < nearest->when_ms))
-            nearest = te;
-        te = te->next;
+long long SeCreateTimeEvent(SeEventLoop* event_loop, long long milliseconds,
+        SeTimeProc *proc, void *client, SeEventFinalizerProc *finalizer_proc) {
+    return SeAddTimeEvent(event_loop, milliseconds, 1000000LL, proc, client, finalizer_proc);
+}
+
+/* Nanosecond variant of SeCreateTimeEvent. proc returns the next delay in
+ * nanoseconds too, so a periodic timer built on it is limited to about two
+ * seconds; use the millisecond API for anything longer. */
+long long SeCreateTimeEventNs(SeEventLoop* event_loop, long long nanoseconds,
+        SeTimeProc *proc, void *client, SeEventFinalizerProc *finalizer_proc) {
+    return SeAddTimeEvent(event_loop, nanoseconds, 1, proc, client, finalizer_proc);
+}
+
+int SeDeleteTimeEvent(SeEventLoop* event_loop, long long id) {
+    SeTimeEvent *te = SeTimerFind(event_loop->timers, id);
+
+    if (te == NULL) return SE_ERR; /* NO event with the specified ID found */
+    SeTimerCancel(event_loop->timers, te);
+    /* A timer deleted from its own callback is finalized by
+     * ProcessTimeEvents once the callback returns. */
+    if (te->state == SE_TIMER_DELETED) return SE_OK;
+    if (te->finalizer_proc)
+        te->finalizer_proc(event_loop, te->client);
+    SeTimerRelease(event_loop->timers, te);
+    return SE_OK;
+}
+
+/* Run proc once right before the loop polls again, typically to write
+ * out everything a connection produced during the iteration with a
+ * single syscall. Adding a flush that is already pending does nothing,
+ * so callers can mark on every write. Loop thread only. */
+void SeAddPendingFlush(SeEventLoop* event_loop, SeFlush* flush) {
+    if (flush->pprev) return;
+    flush->next = event_loop->flushes;
+    if (flush->next) flush->next->pprev = &flush->next;
+    flush->pprev = &event_loop->flushes;
+    event_loop->flushes = flush;
+}
+
+/* Take flush off the list, e.g. when its owner goes away. */
+void SeRemovePendingFlush(SeFlush* flush) {
+    if (!flush->pprev) return;
+    *flush->pprev = flush->next;
+    if (flush->next) flush->next->pprev = flush->pprev;
+    flush->next = NULL;
+    flush->pprev = NULL;
+}
+
+/* Run the pending flushes. Each is unlinked before its proc runs, so the
+ * proc may free it or add it (or others) again; those run next time,
+ * without the loop sleeping in between. */
+static void SeRunFlushes(SeEventLoop* event_loop) {
+    SeFlush* flush = event_loop->flushes;
+
+    if (flush == NULL) return;
+    event_loop->flushes = NULL;
+    flush->pprev = &flush;
+    while (flush) {
+        SeFlush* f = flush;
+        SeRemovePendingFlush(f);
+        f->proc(event_loop, f->client);
     }//end-while.
-    return nearest;
-}//end-SeSearchNearestTimer.
+}
+
+/* Loop-thread counter update that other threads may read concurrently. */
+static inline void SeStatAdd(long long* counter, long long n) {
+    __atomic_store_n(counter, *counter + n, __ATOMIC_RELAXED);
+}
+
+static inline void SeStatMax(long long* counter, long long n) {
+    if (n > *counter) __atomic_store_n(counter, n, __ATOMIC_RELAXED);
+}
+
+static void SeHistAdd(SeHistogram* hist, long long value) {
+    int bucket;
+
+    if (value < 0) value = 0;
+    bucket = 63 - __builtin_clzll(static_cast<unsigned long long>(value) | 1);
+    if (bucket >= SE_HIST_BUCKETS) bucket = SE_HIST_BUCKETS - 1;
+    SeStatAdd(&hist->count, 1);
+    SeStatAdd(&hist->sum, value);
+    SeStatMax(&hist->max, value);
+    SeStatAdd(&hist->buckets[bucket], 1);
+}
 
-/* Process time events */
-static int ProcessTimeEvents(SeEventLoop* event_loop) {
+/* A callback just returned; *mark is when it started and becomes now, so
+ * consecutive callbacks cost one clock read each. */
+static void SeNoteCallback(SeEventLoop* event_loop, int fd, long long* mark) {
+    long long now = SeMonotonicNanoseconds();
+    SeLoopMetrics* metrics = &event_loop->metrics;
+
+    if (now - *mark > metrics->callback_max_ns) {
+        __atomic_store_n(&metrics->callback_max_ns, now - *mark, __ATOMIC_RELAXED);
+        __atomic_store_n(&metrics->callback_max_fd, fd, __ATOMIC_RELAXED);
+    }
+    *mark = now;
+}
+
+/* Process time events, *mark as for SeNoteCallback */
+static int ProcessTimeEvents(SeEventLoop* event_loop, long long* mark) {
+    SeTimerWheel* timers = event_loop->timers;
+    long long now = event_loop->now;
     int processed = 0;
     SeTimeEvent *te;
-    long long max_id;
-    time_t now = time(NULL);
-
-    /* If the system clock is moved to the future, and then set back to the
-     * right value, time events may be delayed in a random way. Often this
-     * means that scheduled operations will not be performed soon enough.
-     *
-     * Here we try to detect system clock skews, and force all the time
-     * events to be processed ASAP when this happens: the idea is that
-     * processing events earlier is less dangerous than delaying them
-     * indefinitely, and practice suggests it is. */
-    if (now < event_loop->last_time) {
-        te = event_loop->time_event_head;
-        while(te) {
-            te->when_sec = 0;
-            te = te->next;
-        }//end-while.
-    }//end-if.
-    event_loop->last_time = now;
-
-    te = event_loop->time_event_head;
-    max_id = event_loop->time_event_next_id - 1;
-    while(te) {
-        long now_sec, now_ms;
-        long long id;
-
-        if (te->id > max_id) {
-            te = te->next;
+
+    SeTimerExpire(timers, now);
+
+    /* Only the timers that were due before we started are on the expired
+     * list, so timers created or rearmed by the callbacks below wait for
+     * the next iteration and we never loop forever. */
+    while ((te = SeTimerNextExpired(timers)) != NULL) {
+        SeHistAdd(&event_loop->metrics.timer_late_ns, *mark - te->when_ns);
+        int retval = te->time_proc(event_loop, te->id, te->client);
+        SeNoteCallback(event_loop, -1, mark);
+        ++processed;
+        if (retval != SE_NOMORE && te->state != SE_TIMER_DELETED &&
+            SeTimerSchedule(timers, te, now + retval * te->unit) == SE_OK)
             continue;
+        if (te->finalizer_proc)
+            te->finalizer_proc(event_loop, te->client);
+        SeTimerRelease(timers, te);
+    }//end-while.
+    return processed;
+}
+
+/* Wait up to timeout ns for file events and refresh the loop time. With
+ * busy polling on, the layer is first polled with a zero timeout for up
+ * to the spin budget, so an event arriving meanwhile is picked up without
+ * the wakeup latency of a sleeping thread. An adaptive budget halves when
+ * the loop still had to block for longer than the configured maximum
+ * (events are too sparse for spinning to pay off) and doubles back when a
+ * block ended with an event within it. */
+static int SePoll(SeEventLoop* event_loop, long long timeout) {
+    SePollStats* stats = &event_loop->poll_stats;
+    long long start, now;
+    int numevents;
+
+    if (timeout == 0) {
+        numevents = event_loop->api->poll(event_loop, 0);
+        SeUpdateTime(event_loop);
+        SeHistAdd(&event_loop->metrics.wait_ns, 0);
+        return numevents;
+    }
+    now = start = SeMonotonicNanoseconds();
+    if (stats->busy_poll > 0) {
+        long long end = start + (timeout >= 0 && timeout < stats->busy_poll ? timeout : stats->busy_poll);
+
+        do {
+            numevents = event_loop->api->poll(event_loop, 0);
+            now = SeMonotonicNanoseconds();
+        } while (numevents == 0 && now < end);
+        SeStatAdd(&stats->spin_ns, now - start);
+        event_loop->now = now;
+        if (numevents > 0) {
+            SeStatAdd(&stats->spin_hits, 1);
+            SeHistAdd(&event_loop->metrics.wait_ns, now - start);
+            return numevents;
         }
-        SeGetTime(&now_sec, &now_ms);
-        if (now_sec > te->when_sec ||
-            (now_sec == te->when_sec && now_ms >= te->when_ms)) {
-            int retval;
-
-            id = te->id;
-            retval = te->time_proc(eventLoop, id, te->clientData);
-            processed++;
-            /* After an event is processed our time event list may
-             * no longer be the same, so we restart from head.
-             * Still we make sure to don't process events registered
-             * by event handlers itself in order to don't loop forever.
-             * To do so we saved the max ID we want to handle.
-             *
-             * FUTURE OPTIMIZATIONS:
-             * Note that this is NOT great algorithmically. Redis uses
-             * a single time event so it's not a problem but the right
-             * way to do this is to add the new elements on head, and
-             * to flag deleted elements in a special way for later
-             * deletion (putting references to the nodes to delete into
-             * another linked list). */
-            if (retval != SE_NOMORE) {
-                SeAddMillisecondsToNow(retval, &te->when_sec, &te->when_ms);
-            } else {
-                SeDeleteTimeEvent(event_loop, id);
-            }
-            te = event_loop->time_event_head;
-        } else {
-            te = te->next;
+        SeStatAdd(&stats->spin_misses, 1);
+        if (timeout >= 0 && (timeout -= now - start) <= 0) {
+            SeHistAdd(&event_loop->metrics.wait_ns, now - start);
+            return 0;
         }
     }
-    return processed;
-}
+
+    numevents = event_loop->api->poll(event_loop, timeout);
+    event_loop->now = SeMonotonicNanoseconds();
+    SeStatAdd(&stats->blocked_ns, event_loop->now - now);
+    SeStatAdd(&stats->blocks, 1);
+    SeHistAdd(&event_loop->metrics.wait_ns, event_loop->now - start);
+    if (event_loop->busy_poll_adaptive) {
+        long long budget = stats->busy_poll;
+        if (event_loop->now - now > event_loop->busy_poll_max) {
+            budget /= 2;
+            if (budget < SE_BUSY_POLL_GROW) budget = 0;
+        } else if (numevents > 0) {
+            budget = budget ? budget * 2 : SE_BUSY_POLL_GROW;
+            if (budget > event_loop->busy_poll_max) budget = event_loop->busy_poll_max;
+        }
+        __atomic_store_n(&stats->busy_poll, budget, __ATOMIC_RELAXED);
+    }
+    return numevents;
+}//end-SePoll.
 
 /* Process every pending time event, then every pending file event
  * (that may be registered by time event callbacks just processed).
@@ -300,6 +732,7 @@ static int ProcessTimeEvents(SeEventLoop* event_loop) {
  * The function returns the number of events processed. */
 int SeProcessEvents(SeEventLoop *event_loop, int flags) {
     int processed = 0, numevents;
+    long long start, mark;
 
     /* Nothing to do? return ASAP */
     if (!(flags & SE_TIME_EVENTS) && !(flags & SE_FILE_EVENTS)) return 0;
@@ -311,47 +744,44 @@ int SeProcessEvents(SeEventLoop *event_loop, int flags) {
     if (event_loop->maxfd != -1 ||
         ((flags & SE_TIME_EVENTS) && !(flags & SE_DONT_WAIT))) {
         int j;
-        SeTimeEvent *shortest = NULL;
-        struct timeval tv, *tvp;
+        long long shortest = -1;
+        long long timeout;
 
+        SeRunFlushes(event_loop);
         if (flags & SE_TIME_EVENTS && !(flags & SE_DONT_WAIT))
-            shortest = SeSearchNearestTimer(event_loop);
-        if (shortest) {
-            long now_sec, now_ms;
-
-            /* Calculate the time missing for the nearest
-             * timer to fire. */
-            SeGetTime(&now_sec, &now_ms);
-            tvp = &tv;
-            tvp->tv_sec = shortest->when_sec - now_sec;
-            if (shortest->when_ms < now_ms) {
-                tvp->tv_usec = ((shortest->when_ms+1000) - now_ms)*1000;
-                tvp->tv_sec --;
-            } else {
-                tvp->tv_usec = (shortest->when_ms - now_ms)*1000;
-            }
-            if (tvp->tv_sec < 0) tvp->tv_sec = 0;
-            if (tvp->tv_usec < 0) tvp->tv_usec = 0;
+            shortest = SeTimerNearest(event_loop->timers);
+        if (shortest >= 0) {
+            /* Calculate the time missing for the nearest timer to fire.
+             * Callbacks ran since the cached time was taken, so read the
+             * clock again rather than oversleep. */
+            timeout = shortest - SeMonotonicNanoseconds();
+            if (timeout < 0) timeout = 0;
         } else {
             /* If we have to check for events but need to return
              * ASAP because of SE_DONT_WAIT we need to set the timeout
-             * to zero */
-            if (flags & SE_DONT_WAIT) {
-                tv.tv_sec = tv.tv_usec = 0;
-                tvp = &tv;
-            } else {
-                /* Otherwise we can block */
-                tvp = NULL; /* wait forever */
-            }
+             * to zero, otherwise we can block */
+            timeout = (flags & SE_DONT_WAIT) ? 0 : -1;
         }
+        /* Carried over events are ready already, and flushes added by
+         * the ones just run should not wait for the next wakeup. */
+        if (event_loop->carry || event_loop->flushes) timeout = 0;
 
-        numevents = api_poll(event_loop, tvp);
+        SeFlushChanges(event_loop);
+        /* One clock read per wakeup, shared by every callback below. */
+        numevents = SePoll(event_loop, timeout);
+        SeHistAdd(&event_loop->metrics.fired, numevents);
+        numevents = SeTakeCarried(event_loop, numevents);
+        int* order = SeOrderFired(event_loop, numevents);
+        mark = event_loop->now;
         for (j = 0; j < numevents; ++j) {
-            SeFileEvent *fe = &event_loop->events[event_loop->fired[j].fd];
-            int mask = event_loop->fired[j].mask;
-            int fd = event_loop->fired[j].fd;
+            int k = order ? order[j] : j;
+            SeFileEvent *fe = event_loop->fired[k].fe;
+            int mask = event_loop->fired[k].mask;
+            int fd = fe->fd;
             int rfired = 0;
 
+            fe->spent = 0;
+
 	        /* note the fe->mask & mask & ... code: maybe an already processed
              * event removed an element that fired and we still didn't
              * processed, so we check if the event is still valid. */
@@ -363,12 +793,19 @@ int SeProcessEvents(SeEventLoop *event_loop, int flags) {
                 if (!rfired || fe->wfile_proc != fe->rfile_proc)
                     fe->wfile_proc(event_loop, fd, fe->client, mask);
             }
+            SeNoteCallback(event_loop, fd, &mark);
             ++processed;
         }
+    } else {
+        SeUpdateTime(event_loop);
+        mark = event_loop->now;
     }
+    start = event_loop->now;
     /* Check time events */
     if (flags & SE_TIME_EVENTS)
-        processed += ProcessTimeEvents(event_loop);
+        processed += ProcessTimeEvents(event_loop, &mark);
+    SeHistAdd(&event_loop->metrics.busy_ns, mark - start);
+    SeStatAdd(&event_loop->metrics.iterations, 1);
 
     return processed; /* return the number of processed file/time events */
 }//end-SeProcessEvents.
@@ -384,7 +821,7 @@ int SeWait(int fd, int mask, long long milliseconds) {
     if (mask & SE_READABLE) pfd.events |= POLLIN;
     if (mask & SE_WRITABLE) pfd.events |= POLLOUT;
 
-    if ((retval = poll(&pfd, 1, milliseconds)) == 1) {
+    if ((retval = poll(&pfd, 1, static_cast<int>(milliseconds))) == 1) {
         if (pfd.revents & POLLIN) retmask |= SE_READABLE;
         if (pfd.revents & POLLOUT) retmask |= SE_WRITABLE;
         if (pfd.revents & POLLERR) retmask |= SE_WRITABLE;
@@ -396,6 +833,8 @@ int SeWait(int fd, int mask, long long milliseconds) {
 }//end-SeWait.
 
 void SeMain(SeEventLoop* event_loop) {
+    __atomic_store_n(&event_loop->thread, pthread_self(), __ATOMIC_RELEASE);
+    SeSetTimerSlack(event_loop, event_loop->timer_slack);
     event_loop->stop = 0;
     while (!event_loop->stop) {
         if (event_loop->before_sleep != NULL)
@@ -404,12 +843,305 @@ void SeMain(SeEventLoop* event_loop) {
     }//end-while.
 }//end-SeMain.
 
-const char* SeGetApiName(void) {
-    return api_name();
+const char* SeGetApiName(SeEventLoop* event_loop) {
+    return event_loop->api->name();
 }
 
 void SeSetBeforeSleepProc(SeEventLoop *event_loop, SeBeforeSleepProc* before_sleep) {
-    eventLoop->before_sleep = before_sleep;
+    event_loop->before_sleep = before_sleep;
+}
+
+/* How late a time event may fire, in nanoseconds. The layers poll with a
+ * millisecond timeout when rounding the deadline up stays within the
+ * slack and switch to a nanosecond wait (epoll_pwait2, or a timerfd on
+ * kernels before 5.11) otherwise. On Linux the value also becomes the
+ * timer slack of the loop thread, which bounds how long the kernel may
+ * defer the wakeup to batch it with others; it is applied right away from
+ * the loop thread and by SeMain otherwise. Larger values save wakeups,
+ * smaller ones tighten the timers. */
+void SeSetTimerSlack(SeEventLoop* event_loop, long long nanoseconds) {
+    if (nanoseconds < 0) nanoseconds = 0;
+    event_loop->timer_slack = nanoseconds;
+#ifdef __linux__
+    /* 0 would mean "back to the default" to the kernel. */
+    if (SeInLoopThread(event_loop))
+        prctl(PR_SET_TIMERSLACK, static_cast<unsigned long>(nanoseconds > 0 ? nanoseconds : 1));
+#endif
+}
+
+long long SeGetTimerSlack(SeEventLoop* event_loop) {
+    return event_loop->timer_slack;
+}
+
+/* Spin for up to nanoseconds with zero-timeout polls before blocking, 0
+ * turns it off. Spinning burns the cpu while idle in exchange for not
+ * paying the scheduler wakeup latency of a blocked thread; with adaptive
+ * set the budget shrinks while the loop is mostly idle and grows back
+ * under load, see SePoll. Call it from the loop thread or before the loop
+ * runs. Socket level busy polling (SO_BUSY_POLL) is set per socket, see
+ * busy_poll() in socket_opt.h. */
+void SeSetBusyPoll(SeEventLoop* event_loop, long long nanoseconds, int adaptive) {
+    if (nanoseconds < 0) nanoseconds = 0;
+    event_loop->busy_poll_max = nanoseconds;
+    event_loop->busy_poll_adaptive = nanoseconds > 0 && adaptive;
+    __atomic_store_n(&event_loop->poll_stats.busy_poll, nanoseconds, __ATOMIC_RELAXED);
+}
+
+void SeGetPollStats(SeEventLoop* event_loop, SePollStats* stats) {
+    SePollStats* st = &event_loop->poll_stats;
+
+    stats->spin_ns = __atomic_load_n(&st->spin_ns, __ATOMIC_RELAXED);
+    stats->blocked_ns = __atomic_load_n(&st->blocked_ns, __ATOMIC_RELAXED);
+    stats->spin_hits = __atomic_load_n(&st->spin_hits, __ATOMIC_RELAXED);
+    stats->spin_misses = __atomic_load_n(&st->spin_misses, __ATOMIC_RELAXED);
+    stats->blocks = __atomic_load_n(&st->blocks, __ATOMIC_RELAXED);
+    stats->busy_poll = __atomic_load_n(&st->busy_poll, __ATOMIC_RELAXED);
+}
+
+static void SeHistLoad(SeHistogram* dst, const SeHistogram* src) {
+    dst->count = __atomic_load_n(&src->count, __ATOMIC_RELAXED);
+    dst->sum = __atomic_load_n(&src->sum, __ATOMIC_RELAXED);
+    dst->max = __atomic_load_n(&src->max, __ATOMIC_RELAXED);
+    for (int i = 0; i < SE_HIST_BUCKETS; ++i)
+        dst->buckets[i] = __atomic_load_n(&src->buckets[i], __ATOMIC_RELAXED);
+}
+
+/* Copy the loop metrics, callable from any thread. */
+void SeGetMetrics(SeEventLoop* event_loop, SeLoopMetrics* metrics) {
+    SeLoopMetrics* m = &event_loop->metrics;
+
+    metrics->iterations = __atomic_load_n(&m->iterations, __ATOMIC_RELAXED);
+    SeHistLoad(&metrics->wait_ns, &m->wait_ns);
+    SeHistLoad(&metrics->busy_ns, &m->busy_ns);
+    SeHistLoad(&metrics->fired, &m->fired);
+    SeHistLoad(&metrics->timer_late_ns, &m->timer_late_ns);
+    metrics->callback_max_ns = __atomic_load_n(&m->callback_max_ns, __ATOMIC_RELAXED);
+    metrics->callback_max_fd = __atomic_load_n(&m->callback_max_fd, __ATOMIC_RELAXED);
+}
+
+/* Upper bound of the bucket holding the p-th percentile (0 < p <= 100),
+ * capped by the largest sample; 0 for an empty histogram. */
+long long SeHistogramPercentile(const SeHistogram* hist, double p) {
+    long long total = 0, rank, seen = 0;
+
+    for (int i = 0; i < SE_HIST_BUCKETS; ++i) total += hist->buckets[i];
+    if (total == 0) return 0;
+    rank = static_cast<long long>(static_cast<double>(total) * p / 100.0 + 0.5);
+    if (rank < 1) rank = 1;
+    for (int i = 0; i < SE_HIST_BUCKETS; ++i) {
+        seen += hist->buckets[i];
+        if (seen >= rank) {
+            long long bound = (2LL << i) - 1;
+            return i == SE_HIST_BUCKETS - 1 || bound > hist->max ? hist->max : bound;
+        }
+    }
+    return hist->max;
+}
+
+/* Number of interest updates absorbed by the change list, i.e. the
+ * epoll_ctl (or equivalent) calls that were never issued. */
+long long SeGetSavedChanges(SeEventLoop* event_loop) {
+    return event_loop->changes_saved;
+}
+
+/* Cross-thread task queue.
+ *
+ * Producers push onto an intrusive Treiber stack with a single CAS and
+ * only the push that finds the stack empty writes the wakeup fd, so a
+ * burst of tasks costs one write and one loop wakeup. The loop clears
+ * the wakeup fd first and then takes the whole stack with one exchange:
+ * a push that lands after the read is either taken by that exchange or
+ * finds the stack empty again and writes a fresh wakeup, so no task is
+ * ever left behind. The batch is reversed to run in queue order; tasks
+ * queued by the batch itself wait for the next iteration. */
+void SeQueueInLoop(SeEventLoop* event_loop, SeTask* task) {
+    SeTask* head = __atomic_load_n(&event_loop->tasks, __ATOMIC_RELAXED);
+
+    do {
+        task->next = head;
+    } while (!__atomic_compare_exchange_n(&event_loop->tasks, &head, task,
+                true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    if (head == NULL) {
+        uint64_t one = 1;
+        ssize_t nwritten = write(event_loop->wakeup_fd[1], &one, sizeof(one));
+        SE_NOTUSED(nwritten); /* EAGAIN: a wakeup is pending anyway */
+    }
+}//end-SeQueueInLoop.
+
+/* Run the task right away when called from the loop thread, otherwise
+ * queue it. */
+void SeRunInLoop(SeEventLoop* event_loop, SeTask* task) {
+    if (SeInLoopThread(event_loop))
+        task->proc(event_loop, task->client);
+    else
+        SeQueueInLoop(event_loop, task);
+}//end-SeRunInLoop.
+
+/* The loop belongs to the thread that created it until SeMain is called
+ * from another one. */
+int SeInLoopThread(SeEventLoop* event_loop) {
+    return pthread_equal(__atomic_load_n(&event_loop->thread, __ATOMIC_ACQUIRE), pthread_self());
+}
+
+/* Number of fds registered in the loop, including its own wakeup fd.
+ * Written by the loop thread only, any thread may read it as a measure
+ * of how busy the loop is. */
+int SeGetFileEventCount(SeEventLoop* event_loop) {
+    return __atomic_load_n(&event_loop->registered, __ATOMIC_RELAXED);
+}
+
+static void SeHandleWakeup(SeEventLoop* event_loop, int fd, void* client, int mask) {
+    char buf[64];
+#ifdef HAVE_EVENTFD
+    ssize_t nread = read(fd, buf, sizeof(uint64_t));
+    SE_NOTUSED(nread);
+#else
+    while (read(fd, buf, sizeof(buf)) > 0) {}
+#endif
+    SeTask* task = __atomic_exchange_n(&event_loop->tasks, static_cast<SeTask*>(NULL), __ATOMIC_ACQUIRE);
+    SeTask* batch = NULL;
+
+    while (task) {
+        SeTask* next = task->next;
+        task->next = batch;
+        batch = task;
+        task = next;
+    }//end-while.
+    while (batch) {
+        SeTask* next = batch->next;
+        batch->proc(event_loop, batch->client);
+        batch = next;
+    }//end-while.
+}//end-SeHandleWakeup.
+
+/* Signal events.
+ *
+ * Signals arrive through a signalfd watched like any other fd, so their
+ * callbacks run in the loop thread between other events instead of in an
+ * async handler, and nothing depends on EINTR. A signalfd only receives
+ * signals that are blocked: SeCreateSignalEvent blocks the signal in the
+ * calling thread, and it must be blocked in every other thread of the
+ * process as well, otherwise one of them takes it the old way. Threads
+ * created by ThreadFactory block all asynchronous signals, so creating
+ * the events from main() before it starts other threads is enough. */
+#ifdef HAVE_SIGNALFD
+typedef struct SeSignalEvent {
+    SeSignalProc* proc;
+    void* client;
+} SeSignalEvent;
+
+typedef struct SeSignalTable {
+    int fd;
+    sigset_t mask;
+    SeSignalEvent events[NSIG];
+} SeSignalTable;
+
+static void SeHandleSignals(SeEventLoop* event_loop, int fd, void* client, int mask) {
+    SeSignalTable* table = event_loop->signals;
+    struct signalfd_siginfo info[16];
+    ssize_t nread;
+
+    while ((nread = read(fd, info, sizeof(info))) > 0) {
+        for (size_t i = 0; i < static_cast<size_t>(nread) / sizeof(info[0]); ++i) {
+            int signo = static_cast<int>(info[i].ssi_signo);
+            if (signo > 0 && signo < NSIG && table->events[signo].proc)
+                table->events[signo].proc(event_loop, signo, table->events[signo].client);
+        }//end-for.
+    }//end-while.
+}//end-SeHandleSignals.
+#endif
+
+/* Call proc from the loop whenever signo is delivered; several instances
+ * arriving between two polls may be merged into one call. Replaces the
+ * previous proc of signo. Fails with ENOSYS where signalfd is missing. */
+int SeCreateSignalEvent(SeEventLoop* event_loop, int signo, SeSignalProc* proc, void* client) {
+#ifdef HAVE_SIGNALFD
+    SeSignalTable* table = event_loop->signals;
+    sigset_t mask, one;
+    int fd;
+
+    if (signo <= 0 || signo >= NSIG || proc == NULL) {
+        errno = EINVAL;
+        return SE_ERR;
+    }
+    if (table == NULL) {
+        if ((table = static_cast<SeSignalTable*>(calloc(1, sizeof(*table)))) == NULL) {
+            errno = ENOMEM;
+            return SE_ERR;
+        }
+        table->fd = -1;
+        sigemptyset(&table->mask);
+        event_loop->signals = table;
+    }
+    mask = table->mask;
+    sigaddset(&mask, signo);
+    if ((fd = signalfd(table->fd, &mask, SFD_NONBLOCK | SFD_CLOEXEC)) == -1) return SE_ERR;
+    if (table->fd == -1) {
+        if (SeCreateFileEvent(event_loop, fd, SE_READABLE, SeHandleSignals, NULL) == SE_ERR) {
+            close(fd);
+            return SE_ERR;
+        }
+        table->fd = fd;
+    }
+    sigemptyset(&one);
+    sigaddset(&one, signo);
+    pthread_sigmask(SIG_BLOCK, &one, NULL);
+    table->mask = mask;
+    table->events[signo].proc = proc;
+    table->events[signo].client = client;
+    return SE_OK;
+#else
+    SE_NOTUSED(event_loop); SE_NOTUSED(signo); SE_NOTUSED(proc); SE_NOTUSED(client);
+    errno = ENOSYS;
+    return SE_ERR;
+#endif
+}//end-SeCreateSignalEvent.
+
+/* Stop watching signo. The signal stays blocked, so later instances stay
+ * pending until the next SeCreateSignalEvent for it (or an unblock by the
+ * caller) rather than killing the process behind the loop's back. */
+int SeDeleteSignalEvent(SeEventLoop* event_loop, int signo) {
+#ifdef HAVE_SIGNALFD
+    SeSignalTable* table = event_loop->signals;
+
+    if (table == NULL || signo <= 0 || signo >= NSIG || table->events[signo].proc == NULL)
+        return SE_ERR;
+    sigdelset(&table->mask, signo);
+    signalfd(table->fd, &table->mask, 0);
+    table->events[signo].proc = NULL;
+    table->events[signo].client = NULL;
+    return SE_OK;
+#else
+    SE_NOTUSED(event_loop); SE_NOTUSED(signo);
+    return SE_ERR;
+#endif
+}//end-SeDeleteSignalEvent.
+
+static void SeFreeSignals(SeEventLoop* event_loop) {
+#ifdef HAVE_SIGNALFD
+    SeSignalTable* table = event_loop->signals;
+
+    if (table == NULL) return;
+    if (table->fd != -1) {
+        SeDeleteFileEvent(event_loop, table->fd, SE_READABLE);
+        close(table->fd);
+    }
+    free(table);
+    event_loop->signals = NULL;
+#endif
+}
+
+/* Monotonic nanoseconds at the last wakeup of the loop. Callbacks should
+ * use this rather than reading the clock themselves; time events are
+ * scheduled relative to it. */
+long long SeGetLoopTime(SeEventLoop* event_loop) {
+    return event_loop->now;
+}
+
+/* Refresh the cached loop time. Only needed when time events are created
+ * from outside a callback after the loop has been idle for a while. */
+void SeUpdateTime(SeEventLoop* event_loop) {
+    event_loop->now = SeMonotonicNanoseconds();
 }
 
 }//end-cromwell.
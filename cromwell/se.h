@@ -1,5 +1,7 @@
 #pragma once
 
+#include <pthread.h>
+
 namespace cromwell {
 
 #define SE_OK 0
@@ -9,6 +11,34 @@ namespace cromwell {
 #define SE_READABLE 1
 #define SE_WRITABLE 2
 
+/* Registration flags, OR'ed into the mask given to SeCreateFileEvent.
+ * Only the epoll layer honors them; on select and io_uring a registration
+ * asking for any of them fails with EINVAL.
+ *
+ * SE_EDGE: edge triggered (EPOLLET). The callback is only invoked again
+ *   after new data arrives or buffer space frees up, so it must read (or
+ *   write) until the call fails with EAGAIN, otherwise the rest stays
+ *   unnoticed.
+ * SE_ONESHOT: the fd is disarmed after reporting one event (EPOLLONESHOT)
+ *   until SeRearmFileEvent, which may be called from another thread, e.g.
+ *   by the worker the fd was handed to. SeRearmFileEvent is epoll only
+ *   and fails with EINVAL on an fd registered without SE_ONESHOT.
+ * SE_EXCLUSIVE: when several loops watch the same fd, e.g. a shared
+ *   listening socket, only one of them is woken per event
+ *   (EPOLLEXCLUSIVE). Only allowed on the first registration of the fd
+ *   and not together with SE_ONESHOT. */
+#define SE_EDGE 4
+#define SE_ONESHOT 8
+#define SE_EXCLUSIVE 16
+#define SE_EVENT_FLAGS (SE_EDGE|SE_ONESHOT|SE_EXCLUSIVE)
+
+/* Dispatch classes, see SeSetFileEventClass. Of the events ready in one
+ * iteration, lower classes run first. */
+#define SE_PRIO_CONTROL 0
+#define SE_PRIO_INTERACTIVE 1 /* default */
+#define SE_PRIO_BULK 2
+#define SE_PRIO_CLASSES 3
+
 #define SE_FILE_EVENTS 1
 #define SE_TIME_EVENTS 2
 #define SE_ALL_EVENTS (SE_FILE_EVENTS|SE_TIME_EVENTS)
@@ -16,20 +46,50 @@ namespace cromwell {
 
 #define SE_NOMORE -1
 
+/* File events live in pages of SE_PAGE_SIZE, allocated the first time an
+ * fd in their range is registered, and one poll returns at most
+ * SE_POLL_BATCH events. */
+#define SE_PAGE_BITS 8
+#define SE_PAGE_SIZE (1 << SE_PAGE_BITS)
+#define SE_POLL_BATCH 1024
+
+/* Default timer slack: how late a time event may fire, in nanoseconds.
+ * Matches the kernel default of a new thread. */
+#define SE_TIMER_SLACK 50000
+
+/* Adaptive busy polling: the spin budget restarts from SE_BUSY_POLL_GROW
+ * nanoseconds after it shrank to nothing. */
+#define SE_BUSY_POLL_GROW 10000
+
 /* Macros */
 #define SE_NOTUSED(V) ((void) V)
 
 struct SeEventLoop;
+struct SeTimerWheel;
+struct SeApi;
+struct SeSignalTable;
 
 /* Types and data structures */
 typedef void SeFileProc(struct SeEventLoop *event_loop, int fd, void *client, int mask);
-typedef int SetTimeProc(struct SeEventLoop *event_loop, long long id, void *client);
+typedef int SeTimeProc(struct SeEventLoop *event_loop, long long id, void *client);
 typedef void SeEventFinalizerProc(struct SeEventLoop *event_loop, void *client);
 typedef void SeBeforeSleepProc(struct SeEventLoop *event_loop);
+typedef void SeTaskProc(struct SeEventLoop *event_loop, void *client);
+typedef void SeSignalProc(struct SeEventLoop *event_loop, int signo, void *client);
 
 /* File event structure */
 typedef struct SeFileEvent {
+    int fd;
     int mask; /* one of SE_(READABLE|WRITABLE) */
+    int kmask; /* mask currently registered with the multiplexing layer */
+    int changed; /* queued on the change list */
+    int flags; /* SE_(EDGE|ONESHOT|EXCLUSIVE) */
+    int prio; /* SE_PRIO_* dispatch class */
+    int carry_mask; /* events to dispatch again without polling */
+    int carried; /* linked on the carry list */
+    long long budget; /* units per dispatch, 0 for no limit */
+    long long spent; /* units charged since the last dispatch */
+    struct SeFileEvent* carry_next;
     SeFileProc* rfile_proc;
     SeFileProc* wfile_proc;
     void* client;
@@ -37,52 +97,157 @@ typedef struct SeFileEvent {
 
 /* Time event structure */
 typedef struct SeTimeEvent {
-    long long id; /* time event identifier. */
-    long when_sec; /* seconds */
-    long when_ms; /* milliseconds */
+    long long id; /* time event identifier: pool slot plus generation. */
+    long long when_ns; /* absolute deadline, monotonic nanoseconds */
+    long long unit; /* nanoseconds per unit of the time_proc return value */
     SeTimeProc* time_proc;
     SeEventFinalizerProc *finalizer_proc;
     void* client;
     struct SeTimeEvent *next;
+    struct SeTimeEvent **pprev; /* link of the slot or list we are on */
+    int index; /* wheel slot or heap position */
+    int state; /* one of SE_TIMER_* in se_timer.h */
 } SeTimeEvent;
 
+/* Work handed to a loop by SeQueueInLoop/SeRunInLoop. The node belongs to
+ * the caller and is typically embedded in a bigger object: the loop only
+ * links it and never touches it again once proc has been called, so proc
+ * may free or requeue it. */
+typedef struct SeTask {
+    struct SeTask* next;
+    SeTaskProc* proc;
+    void* client;
+} SeTask;
+
+/* Work deferred to the end of the iteration, see SeAddPendingFlush.
+ * Owned by the caller like SeTask; the loop links it through next and
+ * pprev so it can be taken off the list at any time. */
+typedef struct SeFlush {
+    struct SeFlush* next;
+    struct SeFlush** pprev; /* NULL while not pending */
+    SeTaskProc* proc;
+    void* client;
+} SeFlush;
+
 /* A fired event */
 typedef struct SeFiredEvent {
     int fd;
     int mask;
+    SeFileEvent* fe; /* dispatched without looking fd up again */
 } SeFiredEvent;
 
+/* Where the loop spent its waits, see SeSetBusyPoll. Written by the loop
+ * thread only, SeGetPollStats may be called from any thread. */
+typedef struct SePollStats {
+    long long spin_ns; /* spinning with zero-timeout polls */
+    long long blocked_ns; /* blocked in the multiplexing layer */
+    long long spin_hits; /* spins that found an event */
+    long long spin_misses; /* spins that ran out of budget and blocked */
+    long long blocks; /* polls that blocked */
+    long long busy_poll; /* current spin budget in ns */
+} SePollStats;
+
+/* Log2 histogram: bucket i counts samples in [2^i, 2^(i+1)), bucket 0
+ * also takes 0 and the last one everything from 2^(SE_HIST_BUCKETS-1) up. */
+#define SE_HIST_BUCKETS 32
+
+typedef struct SeHistogram {
+    long long count;
+    long long sum;
+    long long max;
+    long long buckets[SE_HIST_BUCKETS];
+} SeHistogram;
+
+/* Built-in loop instrumentation, times in nanoseconds. Every field is
+ * written by the loop thread with relaxed atomic stores and SeGetMetrics
+ * reads them the same way, so a snapshot costs no lock and never stalls
+ * the loop; fields of one snapshot may disagree by the iteration that was
+ * in progress. Compare two snapshots to get rates. */
+typedef struct SeLoopMetrics {
+    long long iterations;
+    SeHistogram wait_ns; /* time in the multiplexing layer per poll */
+    SeHistogram busy_ns; /* time in callbacks per iteration */
+    SeHistogram fired; /* file events per poll */
+    SeHistogram timer_late_ns; /* how late each time event ran */
+    long long callback_max_ns; /* longest single callback so far */
+    int callback_max_fd; /* its fd, -1 for a time event */
+} SeLoopMetrics;
+
 /* State of an event based program */
 typedef struct SeEventLoop {
     int maxfd;   /* highest file descriptor currently registered */
-    int setsize; /* max number of file descriptors tracked */
-    long long time_event_next_id;
-    time_t last_time;     /* Used to detect system clock skew */
-    SeFileEvent* events; /* Registered events */
-    SeFiredEvent* fired; /* Fired events */
-    SeTimeEvent* time_event_head;
+    int setsize; /* fds covered by the table, grown on demand */
+    int registered; /* fds with a non-empty mask, read by other threads */
+    long long now; /* Monotonic nanoseconds, cached once per iteration */
+    SeFileEvent** pages; /* Registered events, SE_PAGE_SIZE per page */
+    SeFiredEvent* fired; /* Fired events, polled then carried */
+    int* order; /* dispatch order of fired by class */
+    int batch; /* max events returned by one poll, fired holds twice that */
+    SeFileEvent* carry; /* fds that ran out of budget, oldest first */
+    SeFileEvent** carry_tail;
+    SeFileEvent** changes; /* events whose mask differs from kmask */
+    int nchanges;
+    int changes_size;
+    long long changes_saved; /* interest updates that needed no syscall */
+    struct SeTimerWheel* timers; /* Registered time events */
+    long long timer_slack; /* ns a time event may fire late, see SeSetTimerSlack */
+    long long busy_poll_max; /* spin budget configured with SeSetBusyPoll */
+    int busy_poll_adaptive;
+    SePollStats poll_stats;
+    SeLoopMetrics metrics;
     int stop;
+    const struct SeApi* api; /* Multiplexing layer in use */
     void* api_data; /* This is used for polling API specific data */
     SeBeforeSleepProc* before_sleep;
+    SeFlush* flushes; /* run right before the next poll, newest first */
+    SeTask* tasks; /* queued tasks, newest first, pushed by any thread */
+    int wakeup_fd[2]; /* eventfd in both slots, or a pipe */
+    struct SeSignalTable* signals; /* signal events, allocated on first use */
+    pthread_t thread; /* thread running the loop */
 } SeEventLoop;
 
 /* Prototypes */
 SeEventLoop *SeCreateEventLoop(int setsize);
+SeEventLoop *SeCreateEventLoopWithApi(int setsize, const char* api);
 void SeDeleteEventLoop(SeEventLoop *event_loop);
 void SeStop(SeEventLoop *event_loop);
 int SeCreateFileEvent(SeEventLoop *event_loop, int fd, int mask, SeFileProc* proc, void* client);
 void SeDeleteFileEvent(SeEventLoop *event_loop, int fd, int mask);
 int SeGetFileEvents(SeEventLoop *event_loop, int fd);
+void* SeGetFileEventClient(SeEventLoop *event_loop, int fd);
+int SeRearmFileEvent(SeEventLoop *event_loop, int fd);
+int SeSetFileEventClass(SeEventLoop *event_loop, int fd, int prio, long long budget);
+int SeChargeFileEvent(SeEventLoop *event_loop, int fd, int mask, long long units);
+int SeCreateSignalEvent(SeEventLoop *event_loop, int signo, SeSignalProc *proc, void *client);
+int SeDeleteSignalEvent(SeEventLoop *event_loop, int signo);
 long long SeCreateTimeEvent(SeEventLoop *event_loop, long long milliseconds,
         SeTimeProc *proc, void *client,
         SeEventFinalizerProc *finalizer_proc);
+long long SeCreateTimeEventNs(SeEventLoop *event_loop, long long nanoseconds,
+        SeTimeProc *proc, void *client,
+        SeEventFinalizerProc *finalizer_proc);
 int SeDeleteTimeEvent(SeEventLoop* event_loop, long long id);
+void SeSetTimerSlack(SeEventLoop* event_loop, long long nanoseconds);
+long long SeGetTimerSlack(SeEventLoop* event_loop);
+void SeSetBusyPoll(SeEventLoop* event_loop, long long nanoseconds, int adaptive);
+void SeAddPendingFlush(SeEventLoop* event_loop, SeFlush* flush);
+void SeRemovePendingFlush(SeFlush* flush);
+void SeGetPollStats(SeEventLoop* event_loop, SePollStats* stats);
+void SeGetMetrics(SeEventLoop* event_loop, SeLoopMetrics* metrics);
+long long SeHistogramPercentile(const SeHistogram* hist, double p);
 int SeProcessEvents(SeEventLoop* event_loop, int flags);
 int SeWait(int fd, int mask, long long milliseconds);
 void SeMain(SeEventLoop* event_loop);
-char *SeGetApiName(void);
+const char *SeGetApiName(SeEventLoop* event_loop);
 void SeSetBeforeSleepProc(SeEventLoop* event_loop, SeBeforeSleepProc* before_sleep);
+long long SeGetLoopTime(SeEventLoop* event_loop);
+void SeUpdateTime(SeEventLoop* event_loop);
 int SeGetSetSize(SeEventLoop* event_loop);
 int SeResizeSetSize(SeEventLoop* event_loop, int setsize);
+long long SeGetSavedChanges(SeEventLoop* event_loop);
+void SeQueueInLoop(SeEventLoop* event_loop, SeTask* task);
+void SeRunInLoop(SeEventLoop* event_loop, SeTask* task);
+int SeInLoopThread(SeEventLoop* event_loop);
+int SeGetFileEventCount(SeEventLoop* event_loop);
 
 }//end-cromwell.
\ No newline at end of file
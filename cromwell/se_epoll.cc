@@ -1,17 +1,34 @@
 #include <sys/epoll.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+#include <limits.h>
+
+#ifndef EPOLLEXCLUSIVE
+#define EPOLLEXCLUSIVE (1u << 28) /* Linux 4.5, missing in older headers */
+#endif
+
+/* epoll_pwait2 (Linux 5.11) takes a timespec timeout. It is called through
+ * syscall() since older libcs lack the wrapper; the kernel reads a 64-bit
+ * timespec, which is struct timespec on LP64 only. */
+#if defined(__NR_epoll_pwait2) && defined(__LP64__)
+#define HAVE_EPOLL_PWAIT2 1
+#endif
 
 namespace cromwell {
 
 typedef struct ApiState {
     int epfd;
     struct epoll_event* events;
+    int pwait2; /* epoll_pwait2 usable, cleared once it returns ENOSYS */
+    int tfd; /* timerfd standing in for it, -1 until needed, -2 if unavailable */
+    int tfd_armed; /* set until the timerfd is seen expiring or disarmed */
 } ApiState;
 
 static int api_create(SeEventLoop* event_loop) {
-    ApiState* state = malloc(sizeof(ApiState));
+    ApiState* state = static_cast<ApiState*>(malloc(sizeof(ApiState)));
 
     if (!state) return -1;
-    state->events = malloc(sizeof(struct epoll_event) * event_loop->setsize);
+    state->events = static_cast<struct epoll_event*>(malloc(sizeof(struct epoll_event) * event_loop->batch));
     if (!state->events) {
         free(state);
         return -1;
@@ -22,54 +39,77 @@ static int api_create(SeEventLoop* event_loop) {
         free(state);
         return -1;
     }
+    state->pwait2 = 1;
+    state->tfd = -1;
+    state->tfd_armed = 0;
     event_loop->api_data = state;
     return 0;
 }//end-api_create.
 
+/* Nothing is indexed by fd here: events[] holds one poll batch. */
 static int api_resize(SeEventLoop* event_loop, int setsize) {
-    ApiState* state = event_loop->api_data;
-
-    state->events = realloc(state->events, sizeof(struct epoll_event) * setsize);
     return 0;
 }//end-resize.
 
 static void api_free(SeEventLoop* event_loop) {
-    ApiState* state = event_loop->api_data;
+    ApiState* state = static_cast<ApiState*>(event_loop->api_data);
 
+    if (state->tfd >= 0) close(state->tfd);
     close(state->epfd);
     free(state->events);
     free(state);
 }//end-api_free.
 
+/* Translate an SE mask plus the fd's registration flags into epoll events. */
+static uint32_t api_events(SeFileEvent* fe, int mask) {
+    int flags = fe->flags;
+    uint32_t events = 0;
+
+    if (mask & SE_READABLE) events |= EPOLLIN;
+    if (mask & SE_WRITABLE) events |= EPOLLOUT;
+    if (flags & SE_EDGE) events |= EPOLLET;
+    if (flags & SE_ONESHOT) events |= EPOLLONESHOT;
+    if (flags & SE_EXCLUSIVE) events |= EPOLLEXCLUSIVE;
+    return events;
+}//end-api_events.
+
 static int api_add_event(SeEventLoop* event_loop, int fd, int mask) {
-    ApiState* state = event_loop->api_data;
+    ApiState* state = static_cast<ApiState*>(event_loop->api_data);
+    SeFileEvent* fe = SeFileEventAt(event_loop, fd);
     struct epoll_event ee;
     /* If the fd was already monitored for some event, we need a MOD
      * operation. Otherwise we need an ADD operation. */
-    int op = event_loop->events[fd].mask == AE_NONE ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
-
-    ee.events = 0;
-    mask |= event_loop->events[fd].mask; /* Merge old events */
-    if (mask & SE_READABLE) ee.events |= EPOLLIN;
-    if (mask & SE_WRITABLE) ee.events |= EPOLLOUT;
-    ee.data.u64 = 0; /* avoid valgrind warning */
-    ee.data.fd = fd;
+    int op = fe->mask == SE_NONE ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+
+    mask |= fe->mask; /* Merge old events */
+    ee.events = api_events(fe, mask);
+    /* The event itself rides along, so a wakeup needs no fd lookup. */
+    ee.data.ptr = fe;
     if (epoll_ctl(state->epfd, op, fd, &ee) == -1) return -1;
     return 0;
 }//end-api_add_event.
 
+/* EPOLL_CTL_MOD is refused on an EPOLLEXCLUSIVE registration, so those
+ * are replaced by a DEL followed by an ADD. */
+static void api_ctl_mod(ApiState* state, int flags, int fd, struct epoll_event* ee) {
+    if (flags & SE_EXCLUSIVE) {
+        epoll_ctl(state->epfd, EPOLL_CTL_DEL, fd, ee);
+        epoll_ctl(state->epfd, EPOLL_CTL_ADD, fd, ee);
+    } else {
+        epoll_ctl(state->epfd, EPOLL_CTL_MOD, fd, ee);
+    }
+}//end-api_ctl_mod.
+
 static void api_del_event(SeEventLoop* event_loop, int fd, int delmask) {
-    ApiState* state = eventLoop->api_data;
+    ApiState* state = static_cast<ApiState*>(event_loop->api_data);
+    SeFileEvent* fe = SeFileEventAt(event_loop, fd);
     struct epoll_event ee;
-    int mask = event_loop->events[fd].mask & (~delmask);
+    int mask = fe->mask & (~delmask);
 
-    ee.events = 0;
-    if (mask & SE_READABLE) ee.events |= EPOLLIN;
-    if (mask & SE_WRITABLE) ee.events |= EPOLLOUT;
-    ee.data.u64 = 0; /* avoid valgrind warning */
-    ee.data.fd = fd;
+    ee.events = api_events(fe, mask);
+    ee.data.ptr = fe;
     if (mask != SE_NONE) {
-        epoll_ctl(state->epfd, EPOLL_CTL_MOD, fd, &ee);
+        api_ctl_mod(state, fe->flags, fd, &ee);
     } else {
         /* Note, Kernel < 2.6.9 requires a non null event pointer even for
          * EPOLL_CTL_DEL. */
@@ -77,30 +117,127 @@ static void api_del_event(SeEventLoop* event_loop, int fd, int delmask) {
     }
 }//end-api_del_event.
 
-static int api_poll(SeEventLoop* event_loop, struct timeval* tvp) {
-    ApiState* state = event_loop->api_data;
+/* Replace the registered mask of an fd that stays registered. */
+static void api_mod_event(SeEventLoop* event_loop, int fd, int mask) {
+    ApiState* state = static_cast<ApiState*>(event_loop->api_data);
+    SeFileEvent* fe = SeFileEventAt(event_loop, fd);
+    struct epoll_event ee;
+
+    ee.events = api_events(fe, mask);
+    ee.data.ptr = fe;
+    api_ctl_mod(state, fe->flags, fd, &ee);
+}//end-api_mod_event.
+
+/* Arm the fallback timerfd to expire after timeout nanoseconds. It is
+ * watched edge triggered with a NULL data.ptr, so its expiry only ends the
+ * wait and is never read: rearming resets it. */
+static int api_arm_timer(ApiState* state, long long timeout) {
+    struct itimerspec its;
+
+    if (state->tfd == -2) return -1;
+    if (state->tfd == -1) {
+        struct epoll_event ee;
+        int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+        ee.events = EPOLLIN | EPOLLET;
+        ee.data.ptr = NULL;
+        if (tfd == -1 || epoll_ctl(state->epfd, EPOLL_CTL_ADD, tfd, &ee) == -1) {
+            if (tfd != -1) close(tfd);
+            state->tfd = -2;
+            return -1;
+        }
+        state->tfd = tfd;
+    }
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = timeout / 1000000000LL;
+    its.it_value.tv_nsec = timeout % 1000000000LL;
+    if (timeout == 0) its.it_value.tv_nsec = 1; /* 0 would disarm it */
+    if (timerfd_settime(state->tfd, 0, &its, NULL) == -1) return -1;
+    state->tfd_armed = 1;
+    return 0;
+}//end-api_arm_timer.
+
+/* A wait that ended before the timerfd expired leaves it armed, and it
+ * would cut short whichever wait comes next. Only waits that do not arm
+ * it again pay for disarming it. */
+static void api_disarm_timer(ApiState* state) {
+    struct itimerspec its;
+
+    if (!state->tfd_armed) return;
+    memset(&its, 0, sizeof(its));
+    timerfd_settime(state->tfd, 0, &its, NULL);
+    state->tfd_armed = 0;
+}//end-api_disarm_timer.
+
+/* Wait for at most timeout nanoseconds. epoll_wait counts milliseconds,
+ * and rounding up is fine when it overshoots by no more than the loop's
+ * timer slack. The timeout is measured from a fresh clock read, so that
+ * only holds when the deadline happens to fall just short of a whole
+ * millisecond, for millisecond timers as much as for finer ones; the rest
+ * goes to epoll_pwait2, or to the timerfd where it is missing. */
+static int api_wait(SeEventLoop* event_loop, ApiState* state, long long timeout) {
+    if (timeout < 0) {
+        api_disarm_timer(state);
+        return epoll_wait(state->epfd, state->events, event_loop->batch, -1);
+    }
+
+    long long ms = (timeout + 999999) / 1000000;
+    if (ms > INT_MAX) ms = INT_MAX; /* wakes early, the loop just polls again */
+    if (ms * 1000000 - timeout <= event_loop->timer_slack) {
+        api_disarm_timer(state);
+        return epoll_wait(state->epfd, state->events, event_loop->batch, static_cast<int>(ms));
+    }
+#ifdef HAVE_EPOLL_PWAIT2
+    if (state->pwait2) {
+        struct timespec ts;
+        ts.tv_sec = timeout / 1000000000LL;
+        ts.tv_nsec = timeout % 1000000000LL;
+        int retval = static_cast<int>(syscall(__NR_epoll_pwait2, state->epfd,
+            state->events, event_loop->batch, &ts, NULL, 0));
+        if (retval != -1 || errno != ENOSYS) return retval;
+        state->pwait2 = 0;
+    }
+#endif
+    if (api_arm_timer(state, timeout) == 0)
+        return epoll_wait(state->epfd, state->events, event_loop->batch, -1);
+    api_disarm_timer(state);
+    return epoll_wait(state->epfd, state->events, event_loop->batch, static_cast<int>(ms));
+}//end-api_wait.
+
+static int api_poll(SeEventLoop* event_loop, long long timeout) {
+    ApiState* state = static_cast<ApiState*>(event_loop->api_data);
 
     int numevents = 0;
-    int retval = epoll_wait(state->epfd, state->events, event_loop->setsize, 
-        tvp ? (tvp->tv_sec*1000 + tvp->tv_usec/1000) : -1);
-    if (retval > 0) {
-        numevents = retval;
-        for (int j = 0; j < numevents; ++j) {
-            int mask = 0;
-            struct epoll_event* e = state->events+j;
-
-            if (e->events & EPOLLIN) mask |= SE_READABLE;
-            if (e->events & EPOLLOUT) mask |= SE_WRITABLE;
-            if (e->events & EPOLLERR) mask |= SE_WRITABLE;
-            if (e->events & EPOLLHUP) mask |= SE_WRITABLE;
-            event_loop->fired[j].fd = e->data.fd;
-            event_loop->fired[j].mask = mask;
-        }//end-for.
-    }//end-if.
+    int retval = api_wait(event_loop, state, timeout);
+    for (int j = 0; j < retval; ++j) {
+        int mask = 0;
+        struct epoll_event* e = state->events+j;
+        SeFileEvent* fe = static_cast<SeFileEvent*>(e->data.ptr);
+
+        if (fe == NULL) { /* the timerfd */
+            state->tfd_armed = 0;
+            continue;
+        }
+        if (e->events & EPOLLIN) mask |= SE_READABLE;
+        if (e->events & EPOLLOUT) mask |= SE_WRITABLE;
+        /* Errors wake the reader too: the error queue, e.g. zero copy
+         * completions, is reported this way whatever the fd waits for.
+         * So do hangups, the only event a pipe whose writer closed ever
+         * reports, which a reading-only fd would otherwise never see. */
+        if (e->events & EPOLLERR) mask |= SE_READABLE | SE_WRITABLE;
+        if (e->events & EPOLLHUP) mask |= SE_READABLE | SE_WRITABLE;
+        event_loop->fired[numevents].fd = fe->fd;
+        event_loop->fired[numevents].mask = mask;
+        event_loop->fired[numevents].fe = fe;
+        ++numevents;
+    }//end-for.
 
     return numevents;
 }//end-api_poll.
 
+/* Registration flags this layer honors. */
+static const int api_flags = SE_EDGE | SE_ONESHOT | SE_EXCLUSIVE;
+
 static const char* api_name(void) {
     static const char* name = "epoll";
     return name;
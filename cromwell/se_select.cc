@@ -2,6 +2,8 @@
 
 namespace cromwell {
 
+/* select() is level triggered only: registering an fd with SE_EDGE,
+ * SE_ONESHOT or SE_EXCLUSIVE fails with EINVAL. */
 typedef struct ApiState {
 	fd_set rfds, wfds;
     /* We need to have a copy of the fd sets as it's not safe to reuse
@@ -10,7 +12,7 @@ typedef struct ApiState {
 } ApiState;
 
 static int api_create(SeEventLoop* event_loop) {
-    ApiState *state = malloc(sizeof(ApiState));
+    ApiState *state = static_cast<ApiState*>(malloc(sizeof(ApiState)));
     if (!state) return -1;
 
     FD_ZERO(&state->rfds);
@@ -19,18 +21,18 @@ static int api_create(SeEventLoop* event_loop) {
     return 0;
 }
 
-static int api_resize(SeEventLoop* eventLoop, int setsize) {
+static int api_resize(SeEventLoop* event_loop, int setsize) {
     /* Just ensure we have enough room in the fd_set type. */
     if (setsize >= FD_SETSIZE) return -1;
     return 0;
 }
 
-static void api_free_data(SeEventLoop* event_loop) {
+static void api_free(SeEventLoop* event_loop) {
     free(event_loop->api_data);
 }
 
 static int api_add_event(SeEventLoop* event_loop, int fd, int mask) {
-    SeApiState *state = event_loop->api_data;
+    ApiState *state = static_cast<ApiState*>(event_loop->api_data);
 
     if (mask & SE_READABLE) FD_SET(fd, &state->rfds);
     if (mask & SE_WRITABLE) FD_SET(fd, &state->wfds);
@@ -38,32 +40,53 @@ static int api_add_event(SeEventLoop* event_loop, int fd, int mask) {
 }
 
 static void api_del_event(SeEventLoop* event_loop, int fd, int mask) {
-    SeApiState *state = event_loop->api_data;
+    ApiState *state = static_cast<ApiState*>(event_loop->api_data);
 
     if (mask & SE_READABLE) FD_CLR(fd, &state->rfds);
     if (mask & SE_WRITABLE) FD_CLR(fd, &state->wfds);
 }
 
-static int api_poll(SeEventLoop* event_loop, struct timeval* tvp) {
-    SeApiState* state = event_loop->api_data;
+static void api_mod_event(SeEventLoop* event_loop, int fd, int mask) {
+    ApiState *state = static_cast<ApiState*>(event_loop->api_data);
+
+    if (mask & SE_READABLE) FD_SET(fd, &state->rfds);
+    else FD_CLR(fd, &state->rfds);
+    if (mask & SE_WRITABLE) FD_SET(fd, &state->wfds);
+    else FD_CLR(fd, &state->wfds);
+}
+
+static int api_poll(SeEventLoop* event_loop, long long timeout) {
+    ApiState* state = static_cast<ApiState*>(event_loop->api_data);
+    struct timeval tv, *tvp = NULL;
 
     memcpy(&state->_rfds, &state->rfds, sizeof(fd_set));
     memcpy(&state->_wfds, &state->wfds, sizeof(fd_set));
 
+    /* select() counts in microseconds, round up so we never wake early. */
+    if (timeout >= 0) {
+        long long us = (timeout + 999) / 1000;
+        tv.tv_sec = static_cast<time_t>(us / 1000000);
+        tv.tv_usec = static_cast<suseconds_t>(us % 1000000);
+        tvp = &tv;
+    }
+
     int numevents = 0;
     int retval = select(event_loop->maxfd+1, &state->_rfds, &state->_wfds, NULL, tvp);
-    if (retval > 0) {    	
-        for (int j = 0; j <= event_loop->maxfd; ++j) {
+    if (retval > 0) {
+        /* Anything beyond the batch is still ready at the next poll. */
+        for (int j = 0; j <= event_loop->maxfd && numevents < event_loop->batch; ++j) {
             int mask = 0;
-            SeFileEvent* fe = &event_loop->events[j];
+            SeFileEvent* fe = SeFileEventAt(event_loop, j);
 
-            if (fe->mask == SE_NONE) continue;
+            if (fe == NULL || fe->mask == SE_NONE) continue;
             if (fe->mask & SE_READABLE && FD_ISSET(j, &state->_rfds))
                 mask |= SE_READABLE;
             if (fe->mask & SE_WRITABLE && FD_ISSET(j, &state->_wfds))
                 mask |= SE_WRITABLE;
-            eventLoop->fired[numevents].fd = j;
-            eventLoop->fired[numevents].mask = mask;
+            if (mask == SE_NONE) continue;
+            event_loop->fired[numevents].fd = j;
+            event_loop->fired[numevents].mask = mask;
+            event_loop->fired[numevents].fe = fe;
             ++numevents;
         }//end-for
     }//end-if
@@ -71,6 +94,8 @@ static int api_poll(SeEventLoop* event_loop, struct timeval* tvp) {
     return numevents;
 }//end-api-poll.
 
+static const int api_flags = 0;
+
 static const char* api_name(void) {
     static const char* name = "select";
     return name;
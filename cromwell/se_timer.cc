@@ -0,0 +1,447 @@
+#include "se_timer.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+namespace cromwell {
+
+#define SE_WHEEL_BITS 8
+#define SE_WHEEL_SIZE (1 << SE_WHEEL_BITS)
+#define SE_WHEEL_MASK (SE_WHEEL_SIZE - 1)
+#define SE_WHEEL_WORDS (SE_WHEEL_SIZE / 64)
+
+/* One tick is 2^20ns (~1.05ms): the near wheel spans ~268ms and the far
+ * wheel ~68.7s, which keeps idle/keepalive timers off the heap. */
+#define SE_TICK_SHIFT 20
+#define SE_TICK(when) ((when) >> SE_TICK_SHIFT)
+#define SE_TICK_WHEN(tick) ((tick) << SE_TICK_SHIFT)
+
+#define SE_POOL_CHUNK 256
+
+typedef struct SeWheel {
+    SeTimeEvent* slots[SE_WHEEL_SIZE];
+    unsigned long long bitmap[SE_WHEEL_WORDS]; /* non-empty slots */
+} SeWheel;
+
+struct SeTimerWheel {
+    long long cur_tick;   /* first tick not completely expired */
+    SeWheel near;
+    SeWheel far;
+    SeTimeEvent** heap;
+    int heap_size;
+    int heap_cap;
+    SeTimeEvent* expired; /* FIFO of due timers */
+    SeTimeEvent** expired_tail;
+    SeTimeEvent** chunks; /* node pool */
+    int nchunks;
+    SeTimeEvent* free_list;
+    int count;            /* scheduled, expired or firing timers */
+    long long nearest;    /* cached SeTimerNearest result */
+    int nearest_valid;
+};
+
+/* ---------------------------- wheels ---------------------------- */
+
+static void SeWheelLink(SeWheel* w, int idx, SeTimeEvent* te) {
+    te->next = w->slots[idx];
+    if (te->next) te->next->pprev = &te->next;
+    te->pprev = &w->slots[idx];
+    te->index = idx;
+    w->slots[idx] = te;
+    w->bitmap[idx >> 6] |= 1ULL << (idx & 63);
+}
+
+static void SeWheelUnlink(SeWheel* w, SeTimeEvent* te) {
+    int idx = te->index;
+
+    *te->pprev = te->next;
+    if (te->next) te->next->pprev = te->pprev;
+    te->next = NULL;
+    te->pprev = NULL;
+    if (w->slots[idx] == NULL)
+        w->bitmap[idx >> 6] &= ~(1ULL << (idx & 63));
+}
+
+static int SeWheelEmpty(const SeWheel* w) {
+    for (int i = 0; i < SE_WHEEL_WORDS; ++i)
+        if (w->bitmap[i]) return 0;
+    return 1;
+}
+
+/* First non-empty slot in [from, SE_WHEEL_SIZE), or -1. */
+static int SeWheelNext(const SeWheel* w, int from) {
+    if (from >= SE_WHEEL_SIZE) return -1;
+    int word = from >> 6;
+    unsigned long long bits = w->bitmap[word] & (~0ULL << (from & 63));
+    for (;;) {
+        if (bits) return (word << 6) + __builtin_ctzll(bits);
+        if (++word == SE_WHEEL_WORDS) return -1;
+        bits = w->bitmap[word];
+    }
+}
+
+/* Distance from slot 'from' to the next non-empty slot, wrapping around,
+ * or -1 when the wheel is empty. */
+static int SeWheelDistance(const SeWheel* w, int from) {
+    int j = SeWheelNext(w, from);
+    if (j >= 0) return j - from;
+    j = SeWheelNext(w, 0);
+    if (j >= 0) return j + SE_WHEEL_SIZE - from;
+    return -1;
+}
+
+/* ----------------------------- heap ----------------------------- */
+
+static void SeHeapSet(SeTimerWheel* tw, int pos, SeTimeEvent* te) {
+    tw->heap[pos] = te;
+    te->index = pos;
+}
+
+static void SeHeapUp(SeTimerWheel* tw, int pos) {
+    SeTimeEvent* te = tw->heap[pos];
+    while (pos > 0) {
+        int parent = (pos - 1) / 2;
+        if (tw->heap[parent]->when_ns <= te->when_ns) break;
+        SeHeapSet(tw, pos, tw->heap[parent]);
+        pos = parent;
+    }
+    SeHeapSet(tw, pos, te);
+}
+
+static void SeHeapDown(SeTimerWheel* tw, int pos) {
+    SeTimeEvent* te = tw->heap[pos];
+    for (;;) {
+        int child = pos * 2 + 1;
+        if (child >= tw->heap_size) break;
+        if (child + 1 < tw->heap_size &&
+            tw->heap[child+1]->when_ns < tw->heap[child]->when_ns)
+            ++child;
+        if (te->when_ns <= tw->heap[child]->when_ns) break;
+        SeHeapSet(tw, pos, tw->heap[child]);
+        pos = child;
+    }
+    SeHeapSet(tw, pos, te);
+}
+
+static int SeHeapPush(SeTimerWheel* tw, SeTimeEvent* te) {
+    if (tw->heap_size == tw->heap_cap) {
+        int cap = tw->heap_cap ? tw->heap_cap * 2 : 64;
+        void* p = realloc(tw->heap, sizeof(SeTimeEvent*) * static_cast<size_t>(cap));
+        if (p == NULL) return SE_ERR;
+        tw->heap = static_cast<SeTimeEvent**>(p);
+        tw->heap_cap = cap;
+    }
+    SeHeapSet(tw, tw->heap_size++, te);
+    SeHeapUp(tw, tw->heap_size - 1);
+    return SE_OK;
+}
+
+static void SeHeapRemove(SeTimerWheel* tw, SeTimeEvent* te) {
+    int pos = te->index;
+    SeTimeEvent* last = tw->heap[--tw->heap_size];
+
+    if (last != te) {
+        SeHeapSet(tw, pos, last);
+        SeHeapDown(tw, pos);
+        SeHeapUp(tw, last->index);
+    }
+}
+
+/* ---------------------------- timers ---------------------------- */
+
+/* Put a node on the tier matching its deadline. Only heap insertion can
+ * fail (allocation), wheel placement always succeeds. */
+static int SeTimerPlace(SeTimerWheel* tw, SeTimeEvent* te) {
+    long long tick = SE_TICK(te->when_ns);
+
+    /* Overdue deadlines go to the current slot and fire on the next pass. */
+    if (tick < tw->cur_tick) tick = tw->cur_tick;
+
+    if (tick - tw->cur_tick < SE_WHEEL_SIZE) {
+        SeWheelLink(&tw->near, static_cast<int>(tick & SE_WHEEL_MASK), te);
+        te->state = SE_TIMER_NEAR;
+    } else if ((tick >> SE_WHEEL_BITS) - (tw->cur_tick >> SE_WHEEL_BITS) < SE_WHEEL_SIZE) {
+        SeWheelLink(&tw->far, static_cast<int>((tick >> SE_WHEEL_BITS) & SE_WHEEL_MASK), te);
+        te->state = SE_TIMER_FAR;
+    } else {
+        if (SeHeapPush(tw, te) == SE_ERR) return SE_ERR;
+        te->state = SE_TIMER_HEAP;
+    }
+    return SE_OK;
+}
+
+static void SeExpiredAppend(SeTimerWheel* tw, SeTimeEvent* te) {
+    te->next = NULL;
+    te->pprev = tw->expired_tail;
+    *tw->expired_tail = te;
+    tw->expired_tail = &te->next;
+    te->state = SE_TIMER_EXPIRED;
+}
+
+static void SeExpiredUnlink(SeTimerWheel* tw, SeTimeEvent* te) {
+    *te->pprev = te->next;
+    if (te->next)
+        te->next->pprev = te->pprev;
+    else
+        tw->expired_tail = te->pprev;
+    te->next = NULL;
+    te->pprev = NULL;
+}
+
+/* A node leaving the scheduled set may have defined the cached nearest
+ * deadline. Far wheel nodes count with the start of their block. */
+static void SeTimerForget(SeTimerWheel* tw, SeTimeEvent* te) {
+    long long when = te->when_ns;
+
+    if (te->state == SE_TIMER_FAR)
+        when = SE_TICK_WHEN((SE_TICK(when) >> SE_WHEEL_BITS) << SE_WHEEL_BITS);
+    if (tw->nearest_valid && when <= tw->nearest)
+        tw->nearest_valid = 0;
+}
+
+/* Move the due timers of a near slot to the expired list. When 'all' is
+ * zero the slot is the current one and only partially due. */
+static void SeTimerCollect(SeTimerWheel* tw, int idx, long long now, int all) {
+    SeTimeEvent* te = tw->near.slots[idx];
+
+    while (te) {
+        SeTimeEvent* next = te->next;
+        if (all || te->when_ns <= now) {
+            SeWheelUnlink(&tw->near, te);
+            SeTimerForget(tw, te);
+            SeExpiredAppend(tw, te);
+        }
+        te = next;
+    }//end-while.
+}
+
+/* Called whenever cur_tick lands on a block boundary: the far slot of the
+ * new block moves to the near wheel and heap entries that came into the
+ * far wheel's range are pulled in. */
+static void SeTimerCascade(SeTimerWheel* tw) {
+    int idx = static_cast<int>((tw->cur_tick >> SE_WHEEL_BITS) & SE_WHEEL_MASK);
+    SeTimeEvent* te = tw->far.slots[idx];
+
+    /* The cached nearest may be this block's start, which is now behind. */
+    tw->nearest_valid = 0;
+    while (te) {
+        SeTimeEvent* next = te->next;
+        SeWheelUnlink(&tw->far, te);
+        SeTimerPlace(tw, te);
+        te = next;
+    }//end-while.
+
+    while (tw->heap_size > 0) {
+        te = tw->heap[0];
+        if ((SE_TICK(te->when_ns) >> SE_WHEEL_BITS) -
+            (tw->cur_tick >> SE_WHEEL_BITS) >= SE_WHEEL_SIZE)
+            break;
+        SeHeapRemove(tw, te);
+        SeTimerPlace(tw, te);
+    }//end-while.
+}
+
+SeTimerWheel* SeTimerCreate(long long now) {
+    SeTimerWheel* tw = static_cast<SeTimerWheel*>(malloc(sizeof(SeTimerWheel)));
+
+    if (tw == NULL) return NULL;
+    memset(tw, 0, sizeof(*tw));
+    tw->cur_tick = SE_TICK(now);
+    tw->expired_tail = &tw->expired;
+    return tw;
+}
+
+void SeTimerFree(SeTimerWheel* tw) {
+    if (tw == NULL) return;
+    for (int i = 0; i < tw->nchunks; ++i)
+        free(tw->chunks[i]);
+    free(tw->chunks);
+    free(tw->heap);
+    free(tw);
+}
+
+/* Run the finalizer of every timer still pending, before the wheel goes
+ * away with its loop. */
+void SeTimerFinalizeAll(SeTimerWheel* tw, SeEventLoop* event_loop) {
+    if (tw == NULL) return;
+    for (int i = 0; i < tw->nchunks; ++i) {
+        for (int j = 0; j < SE_POOL_CHUNK; ++j) {
+            SeTimeEvent* te = &tw->chunks[i][j];
+            if (te->state == SE_TIMER_FREE || te->finalizer_proc == NULL) continue;
+            te->finalizer_proc(event_loop, te->client);
+            te->finalizer_proc = NULL;
+        }
+    }
+}
+
+SeTimeEvent* SeTimerAlloc(SeTimerWheel* tw) {
+    if (tw->free_list == NULL) {
+        void* p = realloc(tw->chunks, sizeof(SeTimeEvent*) * static_cast<size_t>(tw->nchunks + 1));
+        if (p == NULL) return NULL;
+        tw->chunks = static_cast<SeTimeEvent**>(p);
+
+        SeTimeEvent* chunk = static_cast<SeTimeEvent*>(malloc(sizeof(SeTimeEvent) * SE_POOL_CHUNK));
+        if (chunk == NULL) return NULL;
+        tw->chunks[tw->nchunks] = chunk;
+
+        long long base = static_cast<long long>(tw->nchunks) * SE_POOL_CHUNK;
+        for (int i = SE_POOL_CHUNK - 1; i >= 0; --i) {
+            chunk[i].id = base + i; /* generation 0 is never handed out */
+            chunk[i].state = SE_TIMER_FREE;
+            chunk[i].next = tw->free_list;
+            tw->free_list = &chunk[i];
+        }
+        ++tw->nchunks;
+    }//end-if.
+
+    SeTimeEvent* te = tw->free_list;
+    tw->free_list = te->next;
+
+    long long gen = ((te->id >> 32) + 1) & 0x7fffffff;
+    if (gen == 0) gen = 1;
+    te->id = (gen << 32) | (te->id & 0xffffffffLL);
+    te->next = NULL;
+    te->pprev = NULL;
+    te->index = -1;
+    te->state = SE_TIMER_FIRING; /* not scheduled yet */
+    ++tw->count;
+    return te;
+}
+
+/* Return a node to the pool. It must not be on any tier. */
+void SeTimerRelease(SeTimerWheel* tw, SeTimeEvent* te) {
+    te->state = SE_TIMER_FREE;
+    te->next = tw->free_list;
+    tw->free_list = te;
+    --tw->count;
+}
+
+SeTimeEvent* SeTimerFind(SeTimerWheel* tw, long long id) {
+    if (id <= 0) return NULL;
+    long long slot = id & 0xffffffffLL;
+    if (slot >= static_cast<long long>(tw->nchunks) * SE_POOL_CHUNK) return NULL;
+
+    SeTimeEvent* te = &tw->chunks[slot / SE_POOL_CHUNK][slot % SE_POOL_CHUNK];
+    if (te->id != id) return NULL;
+    if (te->state == SE_TIMER_FREE || te->state == SE_TIMER_DELETED) return NULL;
+    return te;
+}
+
+/* (Re)arm a node that is not on any tier, i.e. fresh from SeTimerAlloc or
+ * returned by SeTimerNextExpired. */
+int SeTimerSchedule(SeTimerWheel* tw, SeTimeEvent* te, long long when) {
+    te->when_ns = when;
+    if (SeTimerPlace(tw, te) == SE_ERR) return SE_ERR;
+    if (tw->nearest_valid && (tw->nearest < 0 || when < tw->nearest))
+        tw->nearest = when;
+    return SE_OK;
+}
+
+/* Take a node off whatever tier it is on. A firing node is only marked,
+ * the code that fired it releases it once the callback returns. */
+void SeTimerCancel(SeTimerWheel* tw, SeTimeEvent* te) {
+    switch (te->state) {
+        case SE_TIMER_NEAR:
+            SeWheelUnlink(&tw->near, te);
+            break;
+        case SE_TIMER_FAR:
+            SeWheelUnlink(&tw->far, te);
+            break;
+        case SE_TIMER_HEAP:
+            SeHeapRemove(tw, te);
+            break;
+        case SE_TIMER_EXPIRED:
+            SeExpiredUnlink(tw, te);
+            break;
+        case SE_TIMER_FIRING:
+            te->state = SE_TIMER_DELETED;
+            return;
+        default:
+            return;
+    }//end-switch.
+    SeTimerForget(tw, te);
+    te->state = SE_TIMER_FIRING;
+}
+
+/* Advance the wheel to 'now' and move every due timer to the expired
+ * list. Empty stretches are skipped using the slot bitmaps, and when both
+ * wheels are empty we jump straight to the block of the earliest heap
+ * timer. */
+void SeTimerExpire(SeTimerWheel* tw, long long now) {
+    long long now_tick = SE_TICK(now);
+
+    while (tw->cur_tick < now_tick) {
+        int idx = static_cast<int>(tw->cur_tick & SE_WHEEL_MASK);
+        long long next;
+
+        SeTimerCollect(tw, idx, now, 1);
+
+        int j = SeWheelNext(&tw->near, idx + 1);
+        if (j >= 0) {
+            next = tw->cur_tick + (j - idx);
+        } else {
+            next = (tw->cur_tick | SE_WHEEL_MASK) + 1;
+            if (SeWheelEmpty(&tw->near) && SeWheelEmpty(&tw->far)) {
+                long long target = now_tick;
+                if (tw->heap_size > 0 && SE_TICK(tw->heap[0]->when_ns) < target)
+                    target = SE_TICK(tw->heap[0]->when_ns);
+                target &= ~static_cast<long long>(SE_WHEEL_MASK);
+                if (target > next) next = target;
+            }
+        }
+        if (next > now_tick) next = now_tick;
+        tw->cur_tick = next;
+        if ((next & SE_WHEEL_MASK) == 0) SeTimerCascade(tw);
+    }//end-while.
+
+    SeTimerCollect(tw, static_cast<int>(tw->cur_tick & SE_WHEEL_MASK), now, 0);
+}
+
+/* Pop the next due timer. The node is FIRING until the caller either
+ * reschedules it with SeTimerSchedule or releases it. */
+SeTimeEvent* SeTimerNextExpired(SeTimerWheel* tw) {
+    SeTimeEvent* te = tw->expired;
+
+    if (te == NULL) return NULL;
+    SeExpiredUnlink(tw, te);
+    te->state = SE_TIMER_FIRING;
+    return te;
+}
+
+/* Earliest deadline we have to wake up for, -1 if there is none. For the
+ * far wheel the start of its first non-empty block is used, which is the
+ * point where that block gets cascaded. */
+long long SeTimerNearest(SeTimerWheel* tw) {
+    if (tw->nearest_valid) return tw->nearest;
+
+    long long best = -1;
+    int idx = static_cast<int>(tw->cur_tick & SE_WHEEL_MASK);
+    int d = SeWheelDistance(&tw->near, idx);
+    if (d >= 0) {
+        SeTimeEvent* te = tw->near.slots[(idx + d) & SE_WHEEL_MASK];
+        for (; te; te = te->next)
+            if (best < 0 || te->when_ns < best) best = te->when_ns;
+    }
+
+    long long block = tw->cur_tick >> SE_WHEEL_BITS;
+    d = SeWheelDistance(&tw->far, static_cast<int>(block & SE_WHEEL_MASK));
+    if (d >= 0) {
+        long long when = SE_TICK_WHEN((block + d) << SE_WHEEL_BITS);
+        if (best < 0 || when < best) best = when;
+    }
+
+    if (tw->heap_size > 0) {
+        long long when = tw->heap[0]->when_ns;
+        if (best < 0 || when < best) best = when;
+    }
+
+    tw->nearest = best;
+    tw->nearest_valid = 1;
+    return best;
+}
+
+int SeTimerCount(SeTimerWheel* tw) {
+    return tw->count;
+}
+
+}//end-cromwell.
@@ -0,0 +1,54 @@
+#ifndef __CROMWELL_SE_TIMER_H
+#define __CROMWELL_SE_TIMER_H
+
+#include "se.h"
+
+namespace cromwell {
+
+/* Timer engine behind SeCreateTimeEvent/SeDeleteTimeEvent.
+ *
+ * Deadlines live in three tiers:
+ * 1) the near wheel, one slot per tick, for the next SE_WHEEL_SIZE ticks;
+ * 2) the far wheel, one slot per SE_WHEEL_SIZE ticks, cascaded into the
+ *    near wheel every time it wraps;
+ * 3) a binary min-heap for everything further away.
+ * Insert and cancel are O(1) on the wheels and O(log N) on the heap, and the
+ * nearest deadline is cached so the poll timeout costs nothing to compute.
+ *
+ * All times are CLOCK_MONOTONIC nanoseconds.
+ *
+ * Nodes are taken from a chunked pool owned by the wheel. The id returned to
+ * callers is the pool slot in the low 32 bits plus a generation in the high
+ * bits, so resolving an id is a single array access and stale ids miss. */
+
+/* Node states, kept in SeTimeEvent.state */
+#define SE_TIMER_FREE 0     /* on the pool free list */
+#define SE_TIMER_NEAR 1     /* linked into a near wheel slot */
+#define SE_TIMER_FAR 2      /* linked into a far wheel slot */
+#define SE_TIMER_HEAP 3     /* stored in the heap */
+#define SE_TIMER_EXPIRED 4  /* due, waiting on the expired list */
+#define SE_TIMER_FIRING 5   /* handed out by SeTimerNextExpired */
+#define SE_TIMER_DELETED 6  /* deleted while firing, released by the caller */
+
+typedef struct SeTimerWheel SeTimerWheel;
+
+SeTimerWheel* SeTimerCreate(long long now);
+void SeTimerFree(SeTimerWheel* tw);
+void SeTimerFinalizeAll(SeTimerWheel* tw, SeEventLoop* event_loop);
+
+SeTimeEvent* SeTimerAlloc(SeTimerWheel* tw);
+void SeTimerRelease(SeTimerWheel* tw, SeTimeEvent* te);
+SeTimeEvent* SeTimerFind(SeTimerWheel* tw, long long id);
+
+int SeTimerSchedule(SeTimerWheel* tw, SeTimeEvent* te, long long when);
+void SeTimerCancel(SeTimerWheel* tw, SeTimeEvent* te);
+
+void SeTimerExpire(SeTimerWheel* tw, long long now);
+SeTimeEvent* SeTimerNextExpired(SeTimerWheel* tw);
+
+long long SeTimerNearest(SeTimerWheel* tw);
+int SeTimerCount(SeTimerWheel* tw);
+
+}//end-cromwell.
+
+#endif
@@ -0,0 +1,384 @@
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <poll.h>
+
+/* The loop waits with a timeout through IORING_ENTER_EXT_ARG, which needs
+ * 5.11+ headers; older trees only get the native backend. */
+#ifndef IORING_FEAT_EXT_ARG
+#undef HAVE_IO_URING
+#else
+
+namespace cromwell {
+
+/* io_uring multiplexing layer.
+ *
+ * Every registered fd gets a one-shot IORING_OP_POLL_ADD. Interest changes
+ * only mark the fd dirty, a full removal queues its POLL_REMOVE at once;
+ * right before waiting we compare each dirty fd's mask with the poll armed
+ * in the kernel and queue the POLL_REMOVE/POLL_ADD pair that makes up the
+ * difference. Those re-arms, plus the polls consumed
+ * by the previous wakeup, are submitted by the same io_uring_enter that
+ * waits for completions, so an iteration costs a single syscall however
+ * many fds changed. Re-arming after every completion keeps the level
+ * triggered semantics of the epoll and select layers; registering an fd
+ * with SE_EDGE, SE_ONESHOT or SE_EXCLUSIVE fails with EINVAL. */
+
+#define URING_SQ_ENTRIES 256
+#define URING_USER_REMOVE (1ULL << 63) /* user_data of POLL_REMOVE requests */
+
+typedef struct UringFd {
+    unsigned int armed; /* poll events armed in the kernel, 0 if none */
+    unsigned int seq;   /* bumped on every arm, stale completions are dropped */
+    int dirty;          /* queued on the dirty list */
+} UringFd;
+
+typedef struct UringState {
+    int ring_fd;
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+    unsigned sq_entries;
+    unsigned sq_local_tail; /* sqes filled so far, published on submit */
+    struct io_uring_sqe* sqes;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    struct io_uring_cqe* cqes;
+    void* sq_ring;
+    size_t sq_ring_size;
+    void* cq_ring;
+    size_t cq_ring_size;
+    size_t sqes_size;
+    UringFd* fds;
+    int* dirty;
+    int ndirty;
+} UringState;
+
+static int uring_setup(unsigned entries, struct io_uring_params* p) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, p));
+}
+
+static int uring_enter(int ring_fd, unsigned to_submit, unsigned min_complete,
+        unsigned flags, void* arg, size_t argsz) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, ring_fd, to_submit,
+        min_complete, flags, arg, argsz));
+}
+
+static void* uring_ptr(void* base, unsigned offset) {
+    return static_cast<char*>(base) + offset;
+}
+
+static unsigned long long uring_user_data(int fd, unsigned int seq) {
+    return (static_cast<unsigned long long>(seq) << 32) | static_cast<unsigned int>(fd);
+}
+
+static void uring_unmap(UringState* state) {
+    if (state->sqes) munmap(state->sqes, state->sqes_size);
+    if (state->cq_ring && state->cq_ring != state->sq_ring)
+        munmap(state->cq_ring, state->cq_ring_size);
+    if (state->sq_ring) munmap(state->sq_ring, state->sq_ring_size);
+}
+
+static void uring_free(SeEventLoop* event_loop) {
+    UringState* state = static_cast<UringState*>(event_loop->api_data);
+
+    uring_unmap(state);
+    close(state->ring_fd);
+    free(state->fds);
+    free(state->dirty);
+    free(state);
+}//end-uring_free.
+
+static int uring_create(SeEventLoop* event_loop) {
+    struct io_uring_params p;
+    UringState* state = static_cast<UringState*>(calloc(1, sizeof(UringState)));
+
+    if (!state) return -1;
+    state->fds = static_cast<UringFd*>(calloc(static_cast<size_t>(event_loop->setsize), sizeof(UringFd)));
+    state->dirty = static_cast<int*>(malloc(sizeof(int) * event_loop->setsize));
+    if (!state->fds || !state->dirty) goto err;
+
+    /* Size the CQ ring for a full poll batch; the fd table grows later
+     * and NODROP holds any overflow until the next reap. */
+    memset(&p, 0, sizeof(p));
+    p.flags = IORING_SETUP_CQSIZE | IORING_SETUP_CLAMP;
+    p.cq_entries = URING_SQ_ENTRIES * 2;
+    while (p.cq_entries < static_cast<unsigned>(event_loop->batch))
+        p.cq_entries <<= 1;
+    state->ring_fd = uring_setup(URING_SQ_ENTRIES, &p);
+    if (state->ring_fd == -1) goto err;
+    if (!(p.features & IORING_FEAT_EXT_ARG) || !(p.features & IORING_FEAT_NODROP)) {
+        close(state->ring_fd);
+        goto err;
+    }
+
+    state->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    state->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (state->cq_ring_size > state->sq_ring_size)
+            state->sq_ring_size = state->cq_ring_size;
+        state->cq_ring_size = state->sq_ring_size;
+    }
+    state->sq_ring = mmap(NULL, state->sq_ring_size, PROT_READ|PROT_WRITE,
+        MAP_SHARED|MAP_POPULATE, state->ring_fd, IORING_OFF_SQ_RING);
+    if (state->sq_ring == MAP_FAILED) {
+        state->sq_ring = NULL;
+        goto err_ring;
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        state->cq_ring = state->sq_ring;
+    } else {
+        state->cq_ring = mmap(NULL, state->cq_ring_size, PROT_READ|PROT_WRITE,
+            MAP_SHARED|MAP_POPULATE, state->ring_fd, IORING_OFF_CQ_RING);
+        if (state->cq_ring == MAP_FAILED) {
+            state->cq_ring = NULL;
+            goto err_ring;
+        }
+    }
+    state->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    state->sqes = static_cast<struct io_uring_sqe*>(mmap(NULL, state->sqes_size,
+        PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, state->ring_fd, IORING_OFF_SQES));
+    if (state->sqes == MAP_FAILED) {
+        state->sqes = NULL;
+        goto err_ring;
+    }
+
+    state->sq_head = static_cast<unsigned*>(uring_ptr(state->sq_ring, p.sq_off.head));
+    state->sq_tail = static_cast<unsigned*>(uring_ptr(state->sq_ring, p.sq_off.tail));
+    state->sq_mask = static_cast<unsigned*>(uring_ptr(state->sq_ring, p.sq_off.ring_mask));
+    state->sq_array = static_cast<unsigned*>(uring_ptr(state->sq_ring, p.sq_off.array));
+    state->sq_entries = p.sq_entries;
+    state->sq_local_tail = *state->sq_tail;
+    state->cq_head = static_cast<unsigned*>(uring_ptr(state->cq_ring, p.cq_off.head));
+    state->cq_tail = static_cast<unsigned*>(uring_ptr(state->cq_ring, p.cq_off.tail));
+    state->cq_mask = static_cast<unsigned*>(uring_ptr(state->cq_ring, p.cq_off.ring_mask));
+    state->cqes = static_cast<struct io_uring_cqe*>(uring_ptr(state->cq_ring, p.cq_off.cqes));
+    event_loop->api_data = state;
+    return 0;
+
+err_ring:
+    uring_unmap(state);
+    close(state->ring_fd);
+err:
+    free(state->fds);
+    free(state->dirty);
+    free(state);
+    return -1;
+}//end-uring_create.
+
+static int uring_resize(SeEventLoop* event_loop, int setsize) {
+    UringState* state = static_cast<UringState*>(event_loop->api_data);
+    UringFd* fds = static_cast<UringFd*>(realloc(state->fds, sizeof(UringFd) * setsize));
+    if (!fds) return -1;
+    state->fds = fds;
+    int* dirty = static_cast<int*>(realloc(state->dirty, sizeof(int) * setsize));
+    if (!dirty) return -1;
+    state->dirty = dirty;
+
+    for (int i = event_loop->setsize; i < setsize; ++i)
+        memset(&state->fds[i], 0, sizeof(UringFd));
+    return 0;
+}//end-uring_resize.
+
+/* Hand everything queued so far to the kernel without waiting. */
+static int uring_submit(UringState* state) {
+    unsigned to_submit = state->sq_local_tail - __atomic_load_n(state->sq_head, __ATOMIC_ACQUIRE);
+
+    __atomic_store_n(state->sq_tail, state->sq_local_tail, __ATOMIC_RELEASE);
+    if (to_submit == 0) return 0;
+    return uring_enter(state->ring_fd, to_submit, 0, 0, NULL, 0);
+}
+
+static struct io_uring_sqe* uring_get_sqe(UringState* state) {
+    unsigned head = __atomic_load_n(state->sq_head, __ATOMIC_ACQUIRE);
+
+    if (state->sq_local_tail - head >= state->sq_entries) {
+        if (uring_submit(state) < 0) return NULL;
+        head = __atomic_load_n(state->sq_head, __ATOMIC_ACQUIRE);
+        if (state->sq_local_tail - head >= state->sq_entries) return NULL;
+    }
+    unsigned idx = state->sq_local_tail & *state->sq_mask;
+    struct io_uring_sqe* sqe = &state->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    state->sq_array[idx] = idx;
+    ++state->sq_local_tail;
+    return sqe;
+}
+
+static void uring_mark_dirty(UringState* state, int fd) {
+    if (!state->fds[fd].dirty) {
+        state->fds[fd].dirty = 1;
+        state->dirty[state->ndirty++] = fd;
+    }
+}
+
+/* Queue the removes/adds that bring the kernel in line with the masks of
+ * the dirty fds. An fd toggled on and off between two waits costs nothing. */
+static void uring_flush(SeEventLoop* event_loop, UringState* state) {
+    int i;
+
+    for (i = 0; i < state->ndirty; ++i) {
+        int fd = state->dirty[i];
+        UringFd* uf = &state->fds[fd];
+        SeFileEvent* fe = SeFileEventAt(event_loop, fd);
+        int mask = fe ? fe->mask : SE_NONE;
+        unsigned int want = 0;
+
+        if (mask & SE_READABLE) want |= POLLIN;
+        if (mask & SE_WRITABLE) want |= POLLOUT;
+        if (want == uf->armed) {
+            uf->dirty = 0;
+            continue;
+        }
+        /* Two sqes at most, never split a remove from its add. */
+        if (state->sq_entries - (state->sq_local_tail -
+            __atomic_load_n(state->sq_head, __ATOMIC_ACQUIRE)) < 2 &&
+            uring_submit(state) < 0)
+            break;
+        if (uf->armed) {
+            struct io_uring_sqe* sqe = uring_get_sqe(state);
+            if (!sqe) break;
+            sqe->opcode = IORING_OP_POLL_REMOVE;
+            sqe->fd = -1;
+            sqe->addr = uring_user_data(fd, uf->seq);
+            sqe->user_data = URING_USER_REMOVE;
+            uf->armed = 0;
+        }
+        if (want) {
+            struct io_uring_sqe* sqe = uring_get_sqe(state);
+            if (!sqe) break;
+            uf->seq = (uf->seq + 1) & 0x7fffffff;
+            sqe->opcode = IORING_OP_POLL_ADD;
+            sqe->fd = fd;
+            sqe->poll32_events = want;
+            sqe->user_data = uring_user_data(fd, uf->seq);
+            uf->armed = want;
+        }
+        uf->dirty = 0;
+    }//end-for.
+
+    /* Whatever did not fit stays dirty for the next wait. */
+    if (i < state->ndirty) {
+        memmove(state->dirty, state->dirty + i, sizeof(int) * (state->ndirty - i));
+        state->ndirty -= i;
+    } else {
+        state->ndirty = 0;
+    }
+}//end-uring_flush.
+
+static int uring_add_event(SeEventLoop* event_loop, int fd, int mask) {
+    UringState* state = static_cast<UringState*>(event_loop->api_data);
+
+    uring_mark_dirty(state, fd);
+    return 0;
+}//end-uring_add_event.
+
+/* Only called for a full removal, which is not deferred like the other
+ * changes: the caller may close the fd and get the same number back with
+ * the same mask before the next wait, and a flush comparing masks would
+ * then leave the new fd to the old file's poll. The POLL_REMOVE goes
+ * ahead of any later POLL_ADD in the ring, and the new seq drops whatever
+ * the old poll still completes with. */
+static void uring_del_event(SeEventLoop* event_loop, int fd, int delmask) {
+    UringState* state = static_cast<UringState*>(event_loop->api_data);
+    UringFd* uf = &state->fds[fd];
+
+    if (uf->armed) {
+        struct io_uring_sqe* sqe = uring_get_sqe(state);
+        if (sqe) {
+            sqe->opcode = IORING_OP_POLL_REMOVE;
+            sqe->fd = -1;
+            sqe->addr = uring_user_data(fd, uf->seq);
+            sqe->user_data = URING_USER_REMOVE;
+        }
+        /* Without an sqe the old poll lingers until it fires, and its
+         * completion is dropped as stale. */
+        uf->armed = 0;
+    }
+    uf->seq = (uf->seq + 1) & 0x7fffffff;
+}//end-uring_del_event.
+
+static void uring_mod_event(SeEventLoop* event_loop, int fd, int mask) {
+    UringState* state = static_cast<UringState*>(event_loop->api_data);
+
+    uring_mark_dirty(state, fd);
+}//end-uring_mod_event.
+
+static int uring_poll(SeEventLoop* event_loop, long long timeout) {
+    UringState* state = static_cast<UringState*>(event_loop->api_data);
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec ts;
+    unsigned min_complete = 1;
+
+    uring_flush(event_loop, state);
+
+    /* The wait takes a timespec, so the deadline is exact here. */
+    memset(&arg, 0, sizeof(arg));
+    if (timeout >= 0) {
+        ts.tv_sec = timeout / 1000000000LL;
+        ts.tv_nsec = timeout % 1000000000LL;
+        arg.ts = reinterpret_cast<unsigned long long>(&ts);
+        if (timeout == 0) min_complete = 0;
+    }
+
+    /* Submit the re-arms and wait in one go. -ETIME and -EINTR just mean
+     * nothing completed in time. */
+    unsigned to_submit = state->sq_local_tail - __atomic_load_n(state->sq_head, __ATOMIC_ACQUIRE);
+    __atomic_store_n(state->sq_tail, state->sq_local_tail, __ATOMIC_RELEASE);
+    uring_enter(state->ring_fd, to_submit, min_complete,
+        IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+
+    int numevents = 0;
+    unsigned head = *state->cq_head;
+    unsigned tail = __atomic_load_n(state->cq_tail, __ATOMIC_ACQUIRE);
+    while (head != tail && numevents < event_loop->batch) {
+        struct io_uring_cqe* cqe = &state->cqes[head & *state->cq_mask];
+        ++head;
+        if (cqe->user_data & URING_USER_REMOVE) continue;
+
+        int fd = static_cast<int>(cqe->user_data & 0xffffffff);
+        unsigned int seq = static_cast<unsigned int>(cqe->user_data >> 32);
+        if (fd >= event_loop->setsize) continue;
+        UringFd* uf = &state->fds[fd];
+        if (seq != uf->seq || !uf->armed) continue; /* cancelled or re-armed */
+
+        /* The one-shot poll is consumed. */
+        uf->armed = 0;
+
+        int mask = 0;
+        if (cqe->res < 0) {
+            /* The kernel refused the poll, e.g. EBADF: re-arming would only
+             * fail again on every wait. Let the callbacks find the error
+             * once; the fd stays unarmed until its mask changes. */
+            mask = SE_READABLE | SE_WRITABLE;
+        } else {
+            /* Arm it again before the next wait. */
+            uring_mark_dirty(state, fd);
+            if (cqe->res & POLLIN) mask |= SE_READABLE;
+            if (cqe->res & POLLOUT) mask |= SE_WRITABLE;
+            /* See se_epoll.cc. */
+            if (cqe->res & POLLERR) mask |= SE_READABLE | SE_WRITABLE;
+            if (cqe->res & POLLHUP) mask |= SE_READABLE | SE_WRITABLE;
+        }
+        event_loop->fired[numevents].fd = fd;
+        event_loop->fired[numevents].mask = mask;
+        event_loop->fired[numevents].fe = SeFileEventAt(event_loop, fd);
+        ++numevents;
+    }//end-while.
+    __atomic_store_n(state->cq_head, head, __ATOMIC_RELEASE);
+
+    return numevents;
+}//end-uring_poll.
+
+static const int uring_flags = 0;
+
+static const char* uring_name(void) {
+    static const char* name = "io_uring";
+    return name;
+}//end-uring_name.
+
+}//end-cromwell.
+
+#endif
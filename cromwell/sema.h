@@ -6,7 +6,7 @@
 #include <stdexcept>
 #include <semaphore.h>
 
-#include "timespec.h"
+#include "times.h"
 
 namespace cromwell {
 
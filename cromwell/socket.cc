@@ -1,19 +1,103 @@
 #include "socket.h"
 #include "socket_opt.h"
 
+#include <sys/socket.h>
+#include <errno.h>
+
 namespace cromwell {
 
-Socket::Socket():
-  : fd_(-1) {
-  	fd_ = create_socket(nullptr, AF_INET);
+Socket::Socket(int fd)
+  : fd_(fd) {
 }
 
 Socket::~Socket() {
+  Close();
+}
+
+void Socket::Close() {
   socket_close(fd_);
+  fd_ = -1;
+}
+
+bool Socket::Connect(const char* ip, uint16_t port, const char* bind) {
+  Close();
+  fd_ = tcp_nonblock_bind_connect(nullptr, ip, port, bind);
+  return fd_ >= 0;
+}
+
+bool Socket::Listen(const char* ip, uint16_t port, bool reuseport) {
+  Close();
+  fd_ = tcp_listen(nullptr, ip, port, reuseport);
+  if (fd_ < 0) return false;
+  if (nonblock(nullptr, fd_) == -1) {
+    Close();
+    return false;
+  }
+  return true;
+}
+
+bool Socket::ListenUnix(const char* path) {
+  Close();
+  fd_ = unix_listen(nullptr, path, 511);
+  if (fd_ < 0) return false;
+  if (nonblock(nullptr, fd_) == -1) {
+    Close();
+    return false;
+  }
+  return true;
+}
+
+int Socket::Accept(char* ip, size_t ip_len, int* port) {
+  return tcp_accept4(nullptr, fd_, ip, ip_len, port, SOCK_NONBLOCK | SOCK_CLOEXEC);
+}
+
+bool Socket::Send(const char* data, int data_len) {
+  return s_write(fd_, const_cast<char*>(data), data_len) == data_len;
+}
+
+bool Socket::Recv(char* buf, int buf_len) {
+  return s_read(fd_, buf, buf_len) == buf_len;
 }
 
-bool Socket::Listen(const char* ip, uint16_t port) {
+void Socket::SetNonBlock(bool on) {
+  if (on) nonblock(nullptr, fd_);
+  else block(nullptr, fd_);
+}
+
+void Socket::SetTcpNoDelay(bool on) {
+  if (on) enable_tcp_nodelay(nullptr, fd_);
+  else disable_tcp_nodelay(nullptr, fd_);
+}
+
+void Socket::SetReuseAddr(bool on) {
+  int val = on ? 1 : 0;
+  setsockopt(fd_, SOL_SOCKET, SO_REUSEADDR, &val, sizeof(val));
+}
+
+void Socket::SetReusePort(bool on) {
+  int val = on ? 1 : 0;
+  setsockopt(fd_, SOL_SOCKET, SO_REUSEPORT, &val, sizeof(val));
+}
+
+void Socket::SetKeepAlive(bool on) {
+  int val = on ? 1 : 0;
+  setsockopt(fd_, SOL_SOCKET, SO_KEEPALIVE, &val, sizeof(val));
+}
+
+bool Socket::SetBusyPoll(int usec, bool prefer) {
+  return busy_poll(NULL, fd_, usec, prefer ? 1 : 0) == 0;
+}
+
+bool Socket::SetZeroCopy() {
+  return zerocopy(NULL, fd_) == 0;
+}
+
+bool Socket::SetFastOpen(int qlen) {
+  return tcp_fastopen(NULL, fd_, qlen) == 0;
+}
 
+bool Socket::SetDeferAccept(int seconds) {
+  return tcp_defer_accept(NULL, fd_, seconds) == 0;
 }
 
 }//end cromwell.
@@ -1,32 +1,50 @@
 #ifndef _CROMWELL_SOCKET_H
 #define _CROMWELL_SOCKET_H
 
+#include <stddef.h>
+#include <stdint.h>
+
+#include "noncopyable.h"
+
 namespace cromwell {
 
-class Socket : std::noncopyable {
+class Socket : noncopyable {
 public:
-    Socket();
+    explicit Socket(int fd = -1);
     virtual ~Socket();
 
 public:
     bool Valid() const { return fd_ >= 0; }
-    int SocketId() {return fd_;}
+    int SocketId() const {return fd_;}
 
 public:
     void Close();
 
     bool Connect(const char* ip, uint16_t port, const char* bind);
-    bool Listen(const char* ip, uint16_t port);
+    bool Listen(const char* ip, uint16_t port, bool reuseport);
+    // AF_UNIX stream listener on path, '@' first for the abstract namespace.
+    bool ListenUnix(const char* path);
 
-    int Accept();
+    // Non-blocking accept with accept4, the new fd is non-blocking and
+    // close-on-exec. Returns it or -1 with errno set.
+    int Accept(char* ip, size_t ip_len, int* port);
 
     bool Send(const char* data, int data_len);
     bool Recv(char* buf, int buf_len);
 
-    void SetTcpNoDeday(bool on);
+    void SetNonBlock(bool on);
+    void SetTcpNoDelay(bool on);
     void SetReuseAddr(bool on);
     void SetReusePort(bool on);
     void SetKeepAlive(bool on);
+    // SO_BUSY_POLL for usec microseconds, 0 turns it off.
+    bool SetBusyPoll(int usec, bool prefer);
+    // SO_ZEROCOPY, so sends may pass MSG_ZEROCOPY.
+    bool SetZeroCopy();
+    // TCP_FASTOPEN on a listener, qlen fast opens pending at most.
+    bool SetFastOpen(int qlen);
+    // TCP_DEFER_ACCEPT on a listener, 0 turns it off.
+    bool SetDeferAccept(int seconds);
 
 private:
     int fd_;
@@ -1,19 +1,42 @@
 #include "socket_opt.h"
 
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
+#include <linux/filter.h>
 #include <arpa/inet.h>
+#include <netdb.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifndef SO_BUSY_POLL
+#define SO_BUSY_POLL 46
+#endif
+#ifndef SO_PREFER_BUSY_POLL
+#define SO_PREFER_BUSY_POLL 69 /* Linux 5.11 */
+#endif
+#ifndef TCP_FASTOPEN_CONNECT
+#define TCP_FASTOPEN_CONNECT 30 /* Linux 4.11 */
+#endif
 
 namespace cromwell {
 
-static int kErrorMsgLen = 256;
+#define RESOLVE_NONE 0
+#define RESOLVE_IP_ONLY 1
 
 static void set_error(char* err, const char* fmt, ...) {
 	if (!err) return;
 
 	va_list ap;
 	va_start(ap, fmt);
-	vsnprintf(err, kErrorMsgLen, fmt, ap);
+	vsnprintf(err, SOCKET_ERR_LEN, fmt, ap);
 	va_end(ap);
 }
 
@@ -85,7 +108,7 @@ int keep_alive(char *err, int fd, int interval) {
      * probes without getting a reply. */
     val = 3;
     if (setsockopt(fd, IPPROTO_TCP, TCP_KEEPCNT, &val, sizeof(val)) < 0) {
-        anetSetError(err, "setsockopt TCP_KEEPCNT: %s\n", strerror(errno));
+        set_error(err, "setsockopt TCP_KEEPCNT: %s\n", strerror(errno));
         return -1;
     }
 #else
@@ -143,6 +166,15 @@ int send_timeout(char *err, int fd, long long ms) {
     return 0;
 }
 
+/* The pending error of the socket (SO_ERROR), e.g. the outcome of a non
+ * blocking connect once it turned writable. 0 for none. */
+int socket_error(int fd) {
+    int optval = 0;
+    socklen_t optlen = sizeof(optval);
+    if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &optval, &optlen) == -1) return errno;
+    return optval;
+}
+
 static int set_reuse_addr(char *err, int fd) {
     int yes = 1;
     /* Make sure connection-intensive things like the redis benckmark
@@ -154,11 +186,97 @@ static int set_reuse_addr(char *err, int fd) {
     return 0;
 }
 
-/* anetGenericResolve() is called by anetResolve() and anetResolveIP() to
+/* Let several sockets bind the same address and port, the kernel then
+ * spreads incoming connections over their accept queues. */
+int reuse_port(char *err, int fd) {
+    int yes = 1;
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(yes)) == -1) {
+        set_error(err, "setsockopt SO_REUSEPORT: %s", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+/* Make the SO_REUSEPORT group fd belongs to pick the listener by the cpu
+ * that received the SYN: listener cpu % listeners, counted in the order
+ * they started listening (SO_ATTACH_REUSEPORT_CBPF, Linux 4.5). */
+int reuse_port_steer_cpu(char *err, int fd, int listeners) {
+    struct sock_filter code[3];
+    struct sock_fprog prog;
+    if (listeners <= 0) {
+        set_error(err, "reuse_port_steer_cpu: no listeners");
+        return -1;
+    }
+    code[0].code = BPF_LD | BPF_W | BPF_ABS;
+    code[0].jt = code[0].jf = 0;
+    code[0].k = static_cast<uint32_t>(SKF_AD_OFF + SKF_AD_CPU);
+    code[1].code = BPF_ALU | BPF_MOD | BPF_K;
+    code[1].jt = code[1].jf = 0;
+    code[1].k = static_cast<uint32_t>(listeners);
+    code[2].code = BPF_RET | BPF_A;
+    code[2].jt = code[2].jf = 0;
+    code[2].k = 0;
+    prog.len = 3;
+    prog.filter = code;
+    if (setsockopt(fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog)) == -1) {
+        set_error(err, "setsockopt SO_ATTACH_REUSEPORT_CBPF: %s", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+/* Let reads and polls on the socket busy wait on the device queue for up
+ * to usec microseconds (SO_BUSY_POLL), and with prefer set ask the kernel
+ * to leave the queue to busy polling under load (SO_PREFER_BUSY_POLL).
+ * Raising usec above net.core.busy_read needs CAP_NET_ADMIN. */
+int busy_poll(char *err, int fd, int usec, int prefer) {
+    if (setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &usec, sizeof(usec)) == -1) {
+        set_error(err, "setsockopt SO_BUSY_POLL: %s", strerror(errno));
+        return -1;
+    }
+    if (prefer && setsockopt(fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &prefer, sizeof(prefer)) == -1) {
+        set_error(err, "setsockopt SO_PREFER_BUSY_POLL: %s", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+/* Allow MSG_ZEROCOPY sends on the socket (SO_ZEROCOPY, Linux 4.14). */
+int zerocopy(char *err, int fd) {
+    int yes = 1;
+    if (setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &yes, sizeof(yes)) == -1) {
+        set_error(err, "setsockopt SO_ZEROCOPY: %s", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+/* Accept data in the SYN on a listening socket, with at most qlen fast
+ * open requests pending. The server bit of net.ipv4.tcp_fastopen (2) must
+ * be set as well, or the kernel quietly does a normal handshake. */
+int tcp_fastopen(char *err, int fd, int qlen) {
+    if (setsockopt(fd, IPPROTO_TCP, TCP_FASTOPEN, &qlen, sizeof(qlen)) == -1) {
+        set_error(err, "setsockopt TCP_FASTOPEN: %s", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+/* Have the listening socket report a connection only once its first data
+ * arrived, waiting up to seconds for it. */
+int tcp_defer_accept(char *err, int fd, int seconds) {
+    if (setsockopt(fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, &seconds, sizeof(seconds)) == -1) {
+        set_error(err, "setsockopt TCP_DEFER_ACCEPT: %s", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+/* gene_resolve() is called by resolve() and resolve_ip() to
  * do the actual work. It resolves the hostname "host" and set the string
  * representation of the IP address into the buffer pointed by "ipbuf".
  *
- * If flags is set to ANET_IP_ONLY the function only resolves hostnames
+ * If flags is set to RESOLVE_IP_ONLY the function only resolves hostnames
  * that are actually already IPv4 or IPv6 addresses. This turns the function
  * into a validating / normalizing function. */
 static int gene_resolve(char *err, char *host, char *ipbuf, size_t ipbuf_len, int flags) {
@@ -166,7 +284,7 @@ static int gene_resolve(char *err, char *host, char *ipbuf, size_t ipbuf_len, in
     int rv;
 
     memset(&hints, 0, sizeof(hints));
-    if (flags & ANET_IP_ONLY) hints.ai_flags = AI_NUMERICHOST;
+    if (flags & RESOLVE_IP_ONLY) hints.ai_flags = AI_NUMERICHOST;
     hints.ai_family = AF_UNSPEC;
     hints.ai_socktype = SOCK_STREAM;  /* specify socktype to avoid dups */
 
@@ -175,11 +293,11 @@ static int gene_resolve(char *err, char *host, char *ipbuf, size_t ipbuf_len, in
         return -1;
     }
     if (info->ai_family == AF_INET) {
-        struct sockaddr_in *sa = (struct sockaddr_in *)info->ai_addr;
-        inet_ntop(AF_INET, &(sa->sin_addr), ipbuf, ipbuf_len);
+        struct sockaddr_in *sa = reinterpret_cast<struct sockaddr_in *>(info->ai_addr);
+        inet_ntop(AF_INET, &(sa->sin_addr), ipbuf, static_cast<socklen_t>(ipbuf_len));
     } else {
-        struct sockaddr_in6 *sa = (struct sockaddr_in6 *)info->ai_addr;
-        inet_ntop(AF_INET6, &(sa->sin6_addr), ipbuf, ipbuf_len);
+        struct sockaddr_in6 *sa = reinterpret_cast<struct sockaddr_in6 *>(info->ai_addr);
+        inet_ntop(AF_INET6, &(sa->sin6_addr), ipbuf, static_cast<socklen_t>(ipbuf_len));
     }
 
     freeaddrinfo(info);
@@ -187,11 +305,11 @@ static int gene_resolve(char *err, char *host, char *ipbuf, size_t ipbuf_len, in
 }
 
 int resolve(char *err, char *host, char *ipbuf, size_t ipbuf_len) {
-    return gene_resolve(err, host, ipbuf, ipbuf_len, ANET_NONE);
+    return gene_resolve(err, host, ipbuf, ipbuf_len, RESOLVE_NONE);
 }
 
 int resolve_ip(char *err, char *host, char *ipbuf, size_t ipbuf_len) {
-    return gene_resolve(err, host, ipbuf, ipbuf_len, ANET_IP_ONLY);
+    return gene_resolve(err, host, ipbuf, ipbuf_len, RESOLVE_IP_ONLY);
 }
 
 static int v6_only(char *err, int s) {
@@ -223,8 +341,9 @@ int create_socket(char *err, int domain) {
 #define CONNECT_NONE 0
 #define CONNECT_NONBLOCK 1
 #define CONNECT_BE_BINDING 2 /* Best effort binding. */
-static int tcp_gene_connect(char *err, char *addr, int port, char *source_addr, int flags) {
-    int s = ANET_ERR, rv;
+#define CONNECT_FASTOPEN 4 /* Data in the SYN once a cookie is cached. */
+static int tcp_gene_connect(char *err, const char *addr, int port, const char *source_addr, int flags) {
+    int s = -1, rv;
     char portstr[6];  /* strlen("65535") + 1; */
     struct addrinfo hints, *servinfo, *bservinfo, *p, *b;
 
@@ -246,6 +365,13 @@ static int tcp_gene_connect(char *err, char *addr, int port, char *source_addr,
         if (set_reuse_addr(err, s) == -1) goto error;
         if (flags & CONNECT_NONBLOCK && nonblock(err,s) != 0)
             goto error;
+        if (flags & CONNECT_FASTOPEN) {
+            /* With a cookie for the server the connect returns at once and
+             * the SYN leaves with the first write. Best effort: an older
+             * kernel does a normal connect. */
+            int yes = 1;
+            setsockopt(s, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, &yes, sizeof(yes));
+        }
         if (source_addr) {
             int bound = 0;
             /* Using getaddrinfo saves us from self-determining IPv4 vs IPv6 */
@@ -280,7 +406,7 @@ static int tcp_gene_connect(char *err, char *addr, int port, char *source_addr,
         goto end;
     }
     if (p == NULL)
-        anetSetError(err, "creating socket: %s", strerror(errno));
+        set_error(err, "creating socket: %s", strerror(errno));
 
 error:
     if (s != -1) {
@@ -300,19 +426,58 @@ end:
     }
 }
 
-int tcp_connect(char *err, char *addr, int port) {
-    return tcp_gene_connect(err, addr, port, NULL, ANET_CONNECT_NONE);
+int tcp_connect(char *err, const char *addr, int port) {
+    return tcp_gene_connect(err, addr, port, NULL, CONNECT_NONE);
+}
+
+int tcp_nonblock_connect(char *err, const char *addr, int port) {
+    return tcp_gene_connect(err, addr, port, NULL, CONNECT_NONBLOCK);
 }
 
-int tcp_nonblock_connect(char *err, char *addr, int port) {
-    return tcp_gene_connect(err, addr, port, NULL, ANET_CONNECT_NONBLOCK);
+int tcp_nonblock_bind_connect(char *err, const char *addr, int port, const char *source_addr) {
+    return tcp_gene_connect(err, addr, port, source_addr, CONNECT_NONBLOCK);
 }
 
-int tcp_nonblock_bind_connect(char *err, char *addr, int port, char *source_addr) {
-    return tcp_gene_connect(err, addr, port, source_addr, ANET_CONNECT_NONBLOCK);
+int tcp_nonblock_fastopen_connect(char *err, const char *addr, int port) {
+    return tcp_gene_connect(err, addr, port, NULL, CONNECT_NONBLOCK | CONNECT_FASTOPEN);
 }
 
-int listen(char* err, int s, struct sockaddr* sa, socklen_t len, int backlog) {
+/* Fill sa with an AF_UNIX path. A leading '@' names a socket in the
+ * abstract namespace, which needs no file and vanishes with its last fd. */
+static int unix_addr(char *err, const char *path, struct sockaddr_un *sa, socklen_t *len) {
+    size_t n = strlen(path);
+    if (n == 0 || n >= sizeof(sa->sun_path)) {
+        set_error(err, "invalid unix socket path: %s", path);
+        return -1;
+    }
+    memset(sa, 0, sizeof(*sa));
+    sa->sun_family = AF_UNIX;
+    memcpy(sa->sun_path, path, n);
+    if (path[0] == '@') sa->sun_path[0] = '\0';
+    *len = static_cast<socklen_t>(offsetof(struct sockaddr_un, sun_path) + n + (path[0] == '@' ? 0 : 1));
+    return 0;
+}
+
+/* A non-blocking AF_UNIX connect completes at once or fails, EAGAIN when
+ * the listener's backlog is full; it never returns EINPROGRESS. */
+int unix_nonblock_connect(char *err, const char *path) {
+    struct sockaddr_un sa;
+    socklen_t len;
+    if (unix_addr(err, path, &sa, &len) == -1) return -1;
+    int s = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (s == -1) {
+        set_error(err, "creating socket: %s", strerror(errno));
+        return -1;
+    }
+    if (connect(s, reinterpret_cast<struct sockaddr*>(&sa), len) == -1) {
+        set_error(err, "connect %s: %s", path, strerror(errno));
+        close(s);
+        return -1;
+    }
+    return s;
+}
+
+static int bind_listen(char* err, int s, struct sockaddr* sa, socklen_t len, int backlog) {
     if (bind(s, sa, len) == -1) {
         set_error(err, "bind: %s", strerror(errno));
         close(s);
@@ -328,22 +493,46 @@ int listen(char* err, int s, struct sockaddr* sa, socklen_t len, int backlog) {
 }
 
 // listen func for model.
-int tcp_listen(char* err, const char* addr, int port) {
+int tcp_listen(char* err, const char* addr, int port, bool reuseport) {
 	if (port < 0) return -1;
 	struct sockaddr_in sa;
-	int fd = tcp_create(err, AF_INET);
+	int fd = create_socket(err, AF_INET);
 	if (fd < 0) return -1;
+	if (reuseport && reuse_port(err, fd) == -1) {
+		close(fd);
+		return -1;
+	}
 
 	bzero(&sa, sizeof(sa));
 	sa.sin_family = AF_INET;
-	sa.sin_port = htons(port);
+	sa.sin_port = htons(static_cast<uint16_t>(port));
 	sa.sin_addr.s_addr = htonl(INADDR_ANY);
 	if (addr && inet_aton(addr, &sa.sin_addr) == 0) {
 		set_error(err, "invalid bind address: %s", addr);
 		close(fd);
 		return -1;
 	}
-	return listen(err, fd, (struct sockaddr*)&sa, sizeof(sa), 511);
+	if (bind_listen(err, fd, reinterpret_cast<struct sockaddr*>(&sa), sizeof(sa), 511) == -1)
+		return -1;
+	return fd;
+}
+
+/* Listen on an AF_UNIX path. A socket file left behind by a previous run
+ * is removed first; any other file there is an error. */
+int unix_listen(char *err, const char *path, int backlog) {
+    struct sockaddr_un sa;
+    socklen_t len;
+    if (unix_addr(err, path, &sa, &len) == -1) return -1;
+    int s = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (s == -1) {
+        set_error(err, "creating socket: %s", strerror(errno));
+        return -1;
+    }
+    struct stat st;
+    if (path[0] != '@' && stat(path, &st) == 0 && S_ISSOCK(st.st_mode)) unlink(path);
+    if (bind_listen(err, s, reinterpret_cast<struct sockaddr*>(&sa), len, backlog) == -1)
+        return -1;
+    return s;
 }
 
 static int _tcp_server(char *err, int port, char *bindaddr, int af, int backlog) {
@@ -368,7 +557,7 @@ static int _tcp_server(char *err, int port, char *bindaddr, int af, int backlog)
 
         if (af == AF_INET6 && v6_only(err, s) == -1) goto error;
         if (set_reuse_addr(err, s) == -1) goto error;
-        if (listen(err, s, p->ai_addr, p->ai_addrlen, backlog) == -1) goto error;
+        if (bind_listen(err, s, p->ai_addr, p->ai_addrlen, backlog) == -1) goto error;
         goto end;
     }
     if (p == NULL) {
@@ -387,10 +576,10 @@ int tcp_server(char *err, int port, char *bindaddr, int backlog) {
     return _tcp_server(err, port, bindaddr, AF_INET, backlog);
 }
 
-static int gene_accept(char* err, int sock, struct sockaddr* sa, socklen_t* len) {
+static int gene_accept(char* err, int sock, struct sockaddr* sa, socklen_t* len, int flags) {
 	int fd;
 	while(true) {
-		fd = accept(sock, sa, len);
+		fd = accept4(sock, sa, len, flags);
 		if (fd == -1) {
 			if (errno == EINTR) continue;
 			else {
@@ -403,21 +592,34 @@ static int gene_accept(char* err, int sock, struct sockaddr* sa, socklen_t* len)
 	return fd;
 }
 
-int accept(char* err, int sock, char* ip, size_t ip_len, int* port) {
+int tcp_accept(char* err, int sock, char* ip, size_t ip_len, int* port) {
+    return tcp_accept4(err, sock, ip, ip_len, port, 0);
+}
+
+/* tcp_accept() with accept4 flags, e.g. SOCK_NONBLOCK | SOCK_CLOEXEC to
+ * save the fcntl calls. */
+int tcp_accept4(char* err, int sock, char* ip, size_t ip_len, int* port, int flags) {
     int fd;
     struct sockaddr_storage sa;
     socklen_t salen = sizeof(sa);
 
-    if ((fd = gene_accept(err, sock, (struct sockaddr*)&sa, &salen)) == -1)
+    if ((fd = gene_accept(err, sock, reinterpret_cast<struct sockaddr*>(&sa), &salen, flags)) == -1)
     	return -1;
      if (sa.ss_family == AF_INET) {
-        struct sockaddr_in *s = (struct sockaddr_in *)&sa;
-        if (ip) inet_ntop(AF_INET,(void*)&(s->sin_addr),ip,ip_len);
+        struct sockaddr_in *s = reinterpret_cast<struct sockaddr_in *>(&sa);
+        if (ip) inet_ntop(AF_INET, &(s->sin_addr), ip, static_cast<socklen_t>(ip_len));
         if (port) *port = ntohs(s->sin_port);
-    } else {
-        struct sockaddr_in6 *s = (struct sockaddr_in6 *)&sa;
-        if (ip) inet_ntop(AF_INET6,(void*)&(s->sin6_addr),ip,ip_len);
+    } else if (sa.ss_family == AF_INET6) {
+        struct sockaddr_in6 *s = reinterpret_cast<struct sockaddr_in6 *>(&sa);
+        if (ip) inet_ntop(AF_INET6, &(s->sin6_addr), ip, static_cast<socklen_t>(ip_len));
         if (port) *port = ntohs(s->sin6_port);
+    } else {
+        /* AF_UNIX: clients are mostly unnamed, as in get_peer_string(). */
+        if (ip && ip_len > 0) {
+            strncpy(ip, "/unixsocket", ip_len - 1);
+            ip[ip_len - 1] = '\0';
+        }
+        if (port) *port = 0;
     }
     return fd;
 }
@@ -425,12 +627,13 @@ int accept(char* err, int sock, char* ip, size_t ip_len, int* port) {
 /* Like read(2) but make sure 'count' is read before to return
  * (unless error or EOF condition is encountered) */
 int s_read(int fd, char *buf, int count) {
-    ssize_t nread, totlen = 0;
+    ssize_t nread;
+    int totlen = 0;
     while(totlen != count) {
-        nread = read(fd, buf, count-totlen);
+        nread = read(fd, buf, static_cast<size_t>(count-totlen));
         if (nread == 0) return totlen;
         if (nread == -1) return -1;
-        totlen += nread;
+        totlen += static_cast<int>(nread);
         buf += nread;
     }
     return totlen;
@@ -439,12 +642,13 @@ int s_read(int fd, char *buf, int count) {
 /* Like write(2) but make sure 'count' is written before to return
  * (unless error is encountered) */
 int s_write(int fd, char *buf, int count) {
-    ssize_t nwritten, totlen = 0;
+    ssize_t nwritten;
+    int totlen = 0;
     while(totlen != count) {
-        nwritten = write(fd, buf, count-totlen);
+        nwritten = write(fd, buf, static_cast<size_t>(count-totlen));
         if (nwritten == 0) return totlen;
         if (nwritten == -1) return -1;
-        totlen += nwritten;
+        totlen += static_cast<int>(nwritten);
         buf += nwritten;
     }
     return totlen;
@@ -454,16 +658,16 @@ int get_peer_string(int fd, char *ip, size_t ip_len, int *port) {
     struct sockaddr_storage sa;
     socklen_t salen = sizeof(sa);
 
-    if (getpeername(fd, (struct sockaddr*)&sa, &salen) == -1) goto error;
+    if (getpeername(fd, reinterpret_cast<struct sockaddr*>(&sa), &salen) == -1) goto error;
     if (ip_len == 0) goto error;
 
     if (sa.ss_family == AF_INET) {
-        struct sockaddr_in *s = (struct sockaddr_in *)&sa;
-        if (ip) inet_ntop(AF_INET, (void*)&(s->sin_addr), ip, ip_len);
+        struct sockaddr_in *s = reinterpret_cast<struct sockaddr_in *>(&sa);
+        if (ip) inet_ntop(AF_INET, &(s->sin_addr), ip, static_cast<socklen_t>(ip_len));
         if (port) *port = ntohs(s->sin_port);
     } else if (sa.ss_family == AF_INET6) {
-        struct sockaddr_in6 *s = (struct sockaddr_in6 *)&sa;
-        if (ip) inet_ntop(AF_INET6, (void*)&(s->sin6_addr), ip, ip_len);
+        struct sockaddr_in6 *s = reinterpret_cast<struct sockaddr_in6 *>(&sa);
+        if (ip) inet_ntop(AF_INET6, &(s->sin6_addr), ip, static_cast<socklen_t>(ip_len));
         if (port) *port = ntohs(s->sin6_port);
     } else if (sa.ss_family == AF_UNIX) {
         if (ip) strncpy(ip, "/unixsocket", ip_len);
@@ -488,9 +692,111 @@ error:
 
 int socket_create_pair(char* err, int fd[2]) {
 	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fd) < 0) {
-  	set_error(err, "socketpair: %s", strerror(errno));
-  }
-  return 0;
+		set_error(err, "socketpair: %s", strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+/* Keeps message boundaries, for passing fds with a tag each. */
+int socket_create_seqpacket_pair(char* err, int fd[2]) {
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fd) < 0) {
+		set_error(err, "socketpair: %s", strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+/* Send up to MAX_PASSED_FDS fds (SCM_RIGHTS) along with len bytes of data,
+ * at least one byte as a stream socket drops an empty message. The peer
+ * gets its own copies; the caller still owns and closes fds. Returns the
+ * bytes sent or -1 with errno set, EAGAIN when the socket is full. */
+int send_fds(char *err, int sock, const int *fds, int nfds, const char *data, size_t len) {
+    union {
+        char buf[CMSG_SPACE(sizeof(int) * MAX_PASSED_FDS)];
+        struct cmsghdr align;
+    } control;
+    if (nfds < 0 || nfds > MAX_PASSED_FDS || len == 0) {
+        set_error(err, "send_fds: %d fds, %zu bytes", nfds, len);
+        errno = EINVAL;
+        return -1;
+    }
+    struct iovec iov;
+    iov.iov_base = const_cast<char*>(data);
+    iov.iov_len = len;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if (nfds > 0) {
+        size_t fdlen = sizeof(int) * static_cast<size_t>(nfds);
+        memset(&control, 0, sizeof(control));
+        msg.msg_control = control.buf;
+        msg.msg_controllen = CMSG_SPACE(fdlen);
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(fdlen);
+        memcpy(CMSG_DATA(cmsg), fds, fdlen);
+    }
+    ssize_t n;
+    do {
+        n = sendmsg(sock, &msg, MSG_NOSIGNAL);
+    } while (n == -1 && errno == EINTR);
+    if (n == -1) {
+        set_error(err, "sendmsg: %s", strerror(errno));
+        return -1;
+    }
+    return static_cast<int>(n);
+}
+
+/* Receive one message of send_fds(). On entry *nfds is the room in fds,
+ * on return the number received, close-on-exec; fds beyond the room are
+ * closed. Returns the data bytes, 0 at EOF or -1 with errno set. A message
+ * cut short, its data by a too small len on a datagram socket or its fds
+ * by the kernel, fails with EMSGSIZE and closes every fd that came. */
+int recv_fds(char *err, int sock, int *fds, int *nfds, char *data, size_t len) {
+    union {
+        char buf[CMSG_SPACE(sizeof(int) * MAX_PASSED_FDS)];
+        struct cmsghdr align;
+    } control;
+    struct iovec iov;
+    iov.iov_base = data;
+    iov.iov_len = len;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    ssize_t n;
+    do {
+        n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+    } while (n == -1 && errno == EINTR);
+    int room = *nfds;
+    *nfds = 0;
+    if (n == -1) {
+        set_error(err, "recvmsg: %s", strerror(errno));
+        return -1;
+    }
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) continue;
+        int count = static_cast<int>((cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+        for (int i = 0; i < count; ++i) {
+            int fd;
+            memcpy(&fd, CMSG_DATA(cmsg) + sizeof(int) * static_cast<size_t>(i), sizeof(fd));
+            if (*nfds < room) fds[(*nfds)++] = fd;
+            else close(fd);
+        }
+    }
+    if (msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) {
+        for (int i = 0; i < *nfds; ++i) close(fds[i]);
+        *nfds = 0;
+        set_error(err, "recvmsg: message truncated");
+        errno = EMSGSIZE;
+        return -1;
+    }
+    return static_cast<int>(n);
 }
 
 int socket_close(int fd) {
@@ -1,13 +1,20 @@
 #ifndef __SOCKET_OPT_H
 #define __SOCKET_OPT_H
 
+#include <stddef.h>
+
 namespace cromwell {
 
+/* Size of the err buffers, NULL is accepted wherever no message is wanted. */
+#define SOCKET_ERR_LEN 256
+
 int create_socket(char *err, int domain);
 
-int tcp_connect(char *err, char *addr, int port);
-int tcp_nonblock_connect(char *err, char *addr, int port);
-int tcp_nonblock_bind_connect(char *err, char *addr, int port, char *source_addr);
+int tcp_connect(char *err, const char *addr, int port);
+int tcp_nonblock_connect(char *err, const char *addr, int port);
+int tcp_nonblock_bind_connect(char *err, const char *addr, int port, const char *source_addr);
+int tcp_nonblock_fastopen_connect(char *err, const char *addr, int port);
+int unix_nonblock_connect(char *err, const char *path);
 
 int nonblock(char *err, int fd);
 int block(char *err, int fd);
@@ -20,13 +27,22 @@ int disable_tcp_nodelay(char *err, int fd);
 int set_send_buffer(char *err, int fd, int buffsize);
 int tcp_keep_alive(char *err, int fd);
 int send_timeout(char *err, int fd, long long ms);
+int reuse_port(char *err, int fd);
+int reuse_port_steer_cpu(char *err, int fd, int listeners);
+int busy_poll(char *err, int fd, int usec, int prefer);
+int zerocopy(char *err, int fd);
+int tcp_fastopen(char *err, int fd, int qlen);
+int tcp_defer_accept(char *err, int fd, int seconds);
+int socket_error(int fd);
 
 int resolve(char *err, char *host, char *ipbuf, size_t ipbuf_len);
 int resolve_ip(char *err, char *host, char *ipbuf, size_t ipbuf_len);
 
 int tcp_server(char *err, int port, char *bindaddr, int backlog);
-int tcp_listen(char *err, const char* addr, int port);
-int accept(char* err, int serversock, char* ip, size_t ip_len, int* port);
+int tcp_listen(char *err, const char* addr, int port, bool reuseport);
+int tcp_accept(char* err, int serversock, char* ip, size_t ip_len, int* port);
+int tcp_accept4(char* err, int serversock, char* ip, size_t ip_len, int* port, int flags);
+int unix_listen(char *err, const char *path, int backlog);
 
 int s_read(int fd, char *buf, int count);
 int s_write(int fd, char *buf, int count);
@@ -34,6 +50,12 @@ int s_write(int fd, char *buf, int count);
 int get_peer_string(int fd, char *ip, size_t ip_len, int *port);
 
 int socket_create_pair(char* err, int fd[2]);
+int socket_create_seqpacket_pair(char* err, int fd[2]);
+
+/* Passing fds over AF_UNIX sockets, see send_fds(). */
+#define MAX_PASSED_FDS 16
+int send_fds(char *err, int sock, const int *fds, int nfds, const char *data, size_t len);
+int recv_fds(char *err, int sock, int *fds, int *nfds, char *data, size_t len);
 
 int socket_close(int fd);
 
@@ -0,0 +1,799 @@
+#include "tcp_connection.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/errqueue.h>
+#include <netinet/in.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include <memory>
+#include <string>
+
+#include "connection_pool.h"
+#include "event_loop.h"
+
+namespace cromwell {
+
+// A file region, or bytes sent after one.
+struct TcpConnection::OutputSegment {
+  int fd; // -1 for bytes
+  bool owned; // fd is ours to close
+  bool splice; // sendfile refused the file
+  bool dry; // the last splice found the source empty
+  bool seekable;
+  off_t offset;
+  size_t remaining;
+  std::string bytes;
+};
+
+// An output buffer passed to the kernel by reference: its bytes must stay
+// put until the completion for the last send from it arrived.
+struct TcpConnection::ZeroCopyBlock {
+  FastBuffer buf; // the unsent rest
+  size_t size;
+  bool zerocopy; // some of it went out with MSG_ZEROCOPY
+  uint32_t last; // id of the last such send
+};
+
+const size_t TcpConnection::kExtraBufferSize = 64 * 1024;
+const size_t TcpConnection::kDirectSendSize = 16 * 1024;
+const size_t TcpConnection::kIdleBufferSize = 16 * 1024;
+const size_t TcpConnection::kDefaultHighWater = 64 * 1024 * 1024;
+const size_t TcpConnection::kDefaultLowWater = 16 * 1024 * 1024;
+const size_t TcpConnection::kFileChunkSize = 1024 * 1024 * 1024;
+const size_t TcpConnection::kPipeChunkSize = 64 * 1024;
+
+TcpConnection::TcpConnection(EventLoop& loop, int sockfd, const char* peer_ip, int peer_port)
+  : loop_(loop),
+  pool_(nullptr),
+  handle_(0),
+  context_(nullptr),
+  socket_(sockfd),
+  channel_(loop, sockfd),
+  peer_port_(peer_port),
+  state_(kConnecting),
+  segment_bytes_(0),
+  piped_(0),
+  source_fd_(-1),
+  zerocopy_threshold_(0),
+  zerocopy_bytes_(0),
+  zerocopy_next_(0),
+  zerocopy_done_(0),
+  zerocopy_sends_(0),
+  zerocopy_copied_(0),
+  reads_(0),
+  writes_(0),
+  error_(0),
+  high_water_(kDefaultHighWater),
+  low_water_(kDefaultLowWater),
+  above_high_(false),
+  paused_(0),
+  budget_retry_(false),
+  budget_(nullptr),
+  charged_(0) {
+  peer_ip_[0] = '\0';
+  if (peer_ip) {
+    strncpy(peer_ip_, peer_ip, sizeof(peer_ip_) - 1);
+    peer_ip_[sizeof(peer_ip_) - 1] = '\0';
+  }
+  pipe_[0] = pipe_[1] = -1;
+  flush_.next = nullptr;
+  flush_.pprev = nullptr;
+  flush_.proc = OnFlush;
+  flush_.client = this;
+  channel_.SetReadCallback([this](long long receive_time) { HandleRead(receive_time); });
+  channel_.SetWriteCallback([this]() { HandleWrite(); });
+}
+
+TcpConnection::~TcpConnection() {
+  assert(state_ == kDisconnected || state_ == kConnecting);
+  SeRemovePendingFlush(&flush_);
+  if (!zerocopy_.empty()) {
+    ReapZeroCopy();
+    if (!zerocopy_.empty()) {
+      // The kernel may still read blocks we are about to free: reset the
+      // connection on close, dropping what it has queued, rather than let
+      // it send whatever reuses the memory.
+      struct linger lg;
+      lg.l_onoff = 1;
+      lg.l_linger = 0;
+      setsockopt(fd(), SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+    }
+    for (size_t i = 0; i < zerocopy_.size(); ++i) delete zerocopy_[i];
+  }
+  if (budget_) budget_->Charge(-static_cast<long long>(charged_));
+  ClearSegments();
+  if (pipe_[0] >= 0) {
+    close(pipe_[0]);
+    close(pipe_[1]);
+  }
+}
+
+void TcpConnection::Destroy() const {
+  if (pool_) {
+    pool_->Free(const_cast<TcpConnection*>(this));
+  } else {
+    delete this;
+  }
+}
+
+// The caller must hold a TcpConnectionPtr: the channel pins the
+// connection through its reference count.
+void TcpConnection::ConnectEstablished() {
+  loop_.AssertInLoopThread();
+  assert(state_ == kConnecting);
+  state_ = kConnected;
+  channel_.Tie(this);
+  if (!paused_) channel_.EnableReading();
+  if (conn_cb_) conn_cb_(TcpConnectionPtr(this));
+}
+
+void TcpConnection::ConnectDestroyed() {
+  loop_.AssertInLoopThread();
+  if (state_ == kConnected || state_ == kDisconnecting) {
+    state_ = kDisconnected;
+    channel_.DisableAll();
+    if (conn_cb_) conn_cb_(TcpConnectionPtr(this));
+  }
+  state_ = kDisconnected;
+  SeRemovePendingFlush(&flush_);
+  if (!channel_.IsNoneEvent()) channel_.DisableAll();
+  channel_.Remove();
+  ClearSegments();
+  ReleaseBackpressure();
+}
+
+// One readv per wakeup: whatever does not fit the free tail of the input
+// buffer lands on the stack and is appended after, so the buffer only
+// grows by what the message callback leaves unconsumed.
+void TcpConnection::HandleRead(long long receive_time) {
+  if (!zerocopy_.empty()) ReapZeroCopy();
+  if (budget_ && budget_->Over()) {
+    PauseReading(kPauseBudget, true);
+    RetryBudget();
+    return;
+  }
+  char extra[kExtraBufferSize];
+  struct iovec iov[2];
+  size_t writable = input_.GetWritingSize();
+  iov[0].iov_base = input_.GetWriting();
+  iov[0].iov_len = writable;
+  iov[1].iov_base = extra;
+  iov[1].iov_len = sizeof(extra);
+  int iovcnt = writable < sizeof(extra) ? 2 : 1;
+
+  ssize_t n = readv(fd(), iov, iovcnt);
+  ++reads_;
+  if (n > 0) {
+    size_t len = static_cast<size_t>(n);
+    if (len <= writable) {
+      input_.PourWriting(len);
+    } else {
+      input_.PourWriting(writable);
+      if (!input_.Write(extra, len - writable)) {
+        HandleError(ENOMEM);
+        return;
+      }
+    }
+    if (message_cb_) {
+      message_cb_(this, &input_, receive_time);
+    } else {
+      input_.DrainReading(input_.GetReadingSize());
+    }
+    // Give back what a burst made the buffer grow to.
+    if (input_.GetReadingSize() == 0 && input_.GetCapacity() > kIdleBufferSize) {
+      input_.DestroyAll();
+    }
+    if (budget_) Recharge();
+  } else if (n == 0) {
+    HandleClose();
+  } else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+    HandleError(errno);
+  }
+}
+
+void TcpConnection::HandleWrite() {
+  if (!zerocopy_.empty()) ReapZeroCopy();
+  if (channel_.IsWriting()) Flush();
+}
+
+void TcpConnection::HandleClose() {
+  loop_.AssertInLoopThread();
+  state_ = kDisconnected;
+  SeRemovePendingFlush(&flush_);
+  channel_.DisableAll();
+  channel_.Remove();
+  ClearSegments();
+  ReleaseBackpressure();
+  TcpConnectionPtr guard(this);
+  if (conn_cb_) conn_cb_(guard);
+  if (close_cb_) close_cb_(guard);
+}
+
+void TcpConnection::HandleError(int err) {
+  error_ = err;
+  HandleClose();
+}
+
+void TcpConnection::Send(const void* data, size_t len) {
+  if (loop_.IsInLoopThread()) {
+    SendInLoop(data, len);
+  } else {
+    TcpConnectionPtr self(this);
+    std::string copy(static_cast<const char*>(data), len);
+    loop_.QueueInLoop([self, copy]() { self->SendInLoop(copy.data(), copy.size()); });
+  }
+}
+
+void TcpConnection::Send(FastBuffer* buf) {
+  if (loop_.IsInLoopThread()) {
+    SendBufferInLoop(buf);
+  } else {
+    TcpConnectionPtr self(this);
+    std::shared_ptr<FastBuffer> moved(new FastBuffer());
+    moved->Swap(*buf);
+    loop_.QueueInLoop([self, moved]() { self->SendBufferInLoop(moved.get()); });
+  }
+}
+
+void TcpConnection::SendBufferInLoop(FastBuffer* buf) {
+  size_t len = buf->GetReadingSize();
+  if ((state_ != kConnected && state_ != kDisconnecting) ||
+      output_.GetReadingSize() > 0 || !segments_.empty()) {
+    SendInLoop(buf->GetReading(), len);
+    buf->DrainReading(len);
+    return;
+  }
+  // Take the memory over, buf gets our empty one.
+  output_.Swap(*buf);
+  buf->ResetAll();
+  if (!channel_.IsWriting()) SeAddPendingFlush(loop_.se_loop(), &flush_);
+  CheckWaterMarks();
+  if (budget_) Recharge();
+}
+
+void TcpConnection::SendInLoop(const void* data, size_t len) {
+  if (state_ != kConnected && state_ != kDisconnecting) return;
+  if (!segments_.empty()) {
+    // Behind a file region: queued after it.
+    OutputSegment* tail = segments_.back();
+    if (tail->fd >= 0) {
+      tail = new OutputSegment();
+      tail->fd = -1;
+      segments_.push_back(tail);
+    }
+    tail->bytes.append(static_cast<const char*>(data), len);
+    segment_bytes_ += len;
+    len = 0;
+  }
+  // Big enough to be worth a syscall of its own: out now, behind what is
+  // buffered, and only the rest is copied.
+  if (len >= kDirectSendSize && !channel_.IsWriting()) {
+    size_t sent = 0;
+    if (!WriteOut(data, len, &sent)) return;
+    data = static_cast<const char*>(data) + sent;
+    len -= sent;
+  }
+  if (len > 0 && !output_.Write(data, len)) {
+    HandleError(ENOMEM);
+    return;
+  }
+  // While writable is armed the writable callback flushes.
+  if (!channel_.IsWriting()) SeAddPendingFlush(loop_.se_loop(), &flush_);
+  CheckWaterMarks();
+  if (budget_) Recharge();
+}
+
+// Write the output buffer followed by data until the kernel buffer is
+// full. sent counts the bytes of data that went out. False once the
+// connection failed and was closed.
+bool TcpConnection::WriteOut(const void* data, size_t len, size_t* sent) {
+  *sent = 0;
+  for (;;) {
+    struct iovec iov[2];
+    int iovcnt = 0;
+    size_t buffered = output_.GetReadingSize();
+    if (buffered > 0) {
+      iov[iovcnt].iov_base = output_.GetReading();
+      iov[iovcnt++].iov_len = buffered;
+    }
+    if (*sent < len) {
+      iov[iovcnt].iov_base = const_cast<char*>(static_cast<const char*>(data) + *sent);
+      iov[iovcnt++].iov_len = len - *sent;
+    }
+    if (iovcnt == 0) return true;
+    size_t total = buffered + len - *sent;
+
+    // sendmsg rather than writev for MSG_NOSIGNAL: a peer that reset the
+    // connection is an EPIPE, not a SIGPIPE.
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = static_cast<size_t>(iovcnt);
+    ssize_t n = sendmsg(fd(), &msg, MSG_NOSIGNAL);
+    ++writes_;
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK) return true;
+      // A deferred fast open connect sent its SYN without the data.
+      if (errno == EINPROGRESS) return true;
+      HandleError(errno);
+      return false;
+    }
+    size_t nwritten = static_cast<size_t>(n);
+    if (nwritten >= buffered) {
+      output_.DrainReading(buffered);
+      *sent += nwritten - buffered;
+    } else {
+      output_.DrainReading(nwritten);
+    }
+    // A short write means the kernel buffer is full, don't ask again.
+    if (nwritten < total) return true;
+  }//end-for.
+}
+
+size_t TcpConnection::Pending() const {
+  size_t unsent = zerocopy_.empty() ? 0 : zerocopy_.back()->buf.GetReadingSize();
+  return unsent + output_.GetReadingSize() + segment_bytes_;
+}
+
+bool TcpConnection::OutputDone() const {
+  return output_.GetReadingSize() == 0 && segments_.empty() &&
+    (zerocopy_.empty() || zerocopy_.back()->buf.GetReadingSize() == 0);
+}
+
+// Write the rest of the last zero copy block, the output buffer, then the
+// segments behind it in order, until the kernel buffer is full. False
+// once the connection failed and was closed.
+bool TcpConnection::WriteAll() {
+  for (;;) {
+    if (!zerocopy_.empty() && zerocopy_.back()->buf.GetReadingSize() > 0) {
+      int rc = SendZeroCopy(zerocopy_.back());
+      if (rc <= 0) return rc == 0;
+      ReleaseZeroCopy();
+    }
+    if (zerocopy_threshold_ > 0 && output_.GetReadingSize() >= zerocopy_threshold_) {
+      // From here on the kernel may read the block until it says it is
+      // done, so it leaves output_, which starts over with fresh memory.
+      ZeroCopyBlock* block = new ZeroCopyBlock();
+      block->buf.Swap(output_);
+      block->size = block->buf.GetReadingSize();
+      block->zerocopy = false;
+      block->last = 0;
+      zerocopy_.push_back(block);
+      zerocopy_bytes_ += block->size;
+      continue;
+    }
+    size_t sent;
+    if (!WriteOut(nullptr, 0, &sent)) return false;
+    if (output_.GetReadingSize() > 0 || segments_.empty()) return true;
+    OutputSegment* seg = segments_.front();
+    if (seg->fd < 0) {
+      // Bytes after a region that is done: they are next, buffer them.
+      if (!output_.Write(seg->bytes.data(), seg->bytes.size())) {
+        HandleError(ENOMEM);
+        return false;
+      }
+      segment_bytes_ -= seg->bytes.size();
+    } else {
+      int rc = SendSegment(seg);
+      if (rc < 0) return false;
+      if (rc == 0) return true;
+      if (seg->fd == source_fd_) StopWatchingSource();
+      if (seg->owned) close(seg->fd);
+    }
+    segments_.pop_front();
+    delete seg;
+  }//end-for.
+}
+
+bool TcpConnection::SendFile(int fd, off_t offset, size_t count) {
+  if (loop_.IsInLoopThread()) {
+    SendFileInLoop(fd, offset, count, false);
+    return true;
+  }
+  int copy = dup(fd);
+  if (copy < 0) return false;
+  TcpConnectionPtr self(this);
+  loop_.QueueInLoop([self, copy, offset, count]() {
+    self->SendFileInLoop(copy, offset, count, true);
+  });
+  return true;
+}
+
+void TcpConnection::SendFileInLoop(int fd, off_t offset, size_t count, bool owned) {
+  if ((state_ != kConnected && state_ != kDisconnecting) || count == 0) {
+    if (owned) close(fd);
+    return;
+  }
+  OutputSegment* seg = new OutputSegment();
+  struct stat st;
+  seg->fd = fd;
+  seg->owned = owned;
+  seg->splice = fstat(fd, &st) != 0 || !S_ISREG(st.st_mode);
+  seg->dry = false;
+  seg->seekable = !seg->splice || lseek(fd, 0, SEEK_CUR) != -1;
+  seg->offset = offset;
+  seg->remaining = count;
+
+  // Nothing ahead of it: straight out.
+  if (OutputDone() && !channel_.IsWriting()) {
+    int rc = SendSegment(seg);
+    if (rc != 0) {
+      if (seg->owned) close(seg->fd);
+      delete seg;
+      if (rc > 0) SeAddPendingFlush(loop_.se_loop(), &flush_); // write complete
+      return;
+    }
+  }
+  if (!seg->owned) {
+    seg->fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+    seg->owned = true;
+    if (seg->fd < 0) {
+      int err = errno;
+      delete seg;
+      HandleError(err);
+      return;
+    }
+  }
+  segments_.push_back(seg);
+  if (!channel_.IsWriting()) SeAddPendingFlush(loop_.se_loop(), &flush_);
+}
+
+// Send what is left of a file region: 1 once it is done, 0 while the
+// kernel buffer is full, -1 after a failure closed the connection.
+int TcpConnection::SendSegment(OutputSegment* seg) {
+  if (seg->splice) return SpliceSegment(seg);
+  while (seg->remaining > 0) {
+    size_t chunk = seg->remaining < kFileChunkSize ? seg->remaining : kFileChunkSize;
+    ssize_t n = sendfile(fd(), seg->fd, &seg->offset, chunk);
+    ++writes_;
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+      if (errno == EINVAL || errno == ENOSYS) {
+        // The filesystem does not do sendfile, go through a pipe.
+        seg->splice = true;
+        return SpliceSegment(seg);
+      }
+      HandleError(errno);
+      return -1;
+    }
+    if (n == 0) break; // EOF, the file is shorter than the region
+    seg->remaining -= static_cast<size_t>(n);
+    // A short write means the kernel buffer is full, don't ask again.
+    if (static_cast<size_t>(n) < chunk && seg->remaining > 0) return 0;
+  }//end-while.
+  seg->remaining = 0;
+  return 1;
+}
+
+// splice needs a pipe on one side: file to our pipe, pipe to socket.
+int TcpConnection::SpliceSegment(OutputSegment* seg) {
+  if (pipe_[0] < 0 && pipe2(pipe_, O_NONBLOCK | O_CLOEXEC) != 0) {
+    pipe_[0] = pipe_[1] = -1;
+    HandleError(errno);
+    return -1;
+  }
+  const unsigned int flags = SPLICE_F_MOVE | SPLICE_F_NONBLOCK;
+  seg->dry = false;
+  for (;;) {
+    if (piped_ > 0) {
+      ssize_t n = splice(pipe_[0], nullptr, fd(), nullptr, piped_, flags);
+      ++writes_;
+      if (n < 0) {
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN) return 0;
+        HandleError(errno);
+        return -1;
+      }
+      piped_ -= static_cast<size_t>(n);
+      if (piped_ > 0) return 0;
+    }
+    if (seg->remaining == 0) return 1;
+    size_t chunk = seg->remaining < kPipeChunkSize ? seg->remaining : kPipeChunkSize;
+    ssize_t n = splice(seg->fd, seg->seekable ? &seg->offset : nullptr,
+        pipe_[1], nullptr, chunk, flags);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      if (errno == EAGAIN) {
+        // The pipe is empty, so it is the source that has nothing yet.
+        seg->dry = true;
+        return 0;
+      }
+      HandleError(errno);
+      return -1;
+    }
+    if (n == 0) {
+      seg->remaining = 0; // EOF
+    } else {
+      seg->remaining -= static_cast<size_t>(n);
+      piped_ += static_cast<size_t>(n);
+    }
+  }//end-for.
+}
+
+// Wait for a dry source rather than for the socket, which can likely
+// take more and would wake the loop right away.
+void TcpConnection::WatchSource(int fd) {
+  if (source_fd_ == fd) return;
+  StopWatchingSource();
+  if (SeCreateFileEvent(loop_.se_loop(), fd, SE_READABLE, OnSourceReadable, this) == SE_ERR) {
+    // Not pollable: retry on writable, as for a full socket.
+    if (!channel_.IsWriting()) channel_.EnableWriting();
+    return;
+  }
+  source_fd_ = fd;
+}
+
+void TcpConnection::StopWatchingSource() {
+  if (source_fd_ < 0) return;
+  SeDeleteFileEvent(loop_.se_loop(), source_fd_, SE_READABLE);
+  source_fd_ = -1;
+}
+
+void TcpConnection::OnSourceReadable(SeEventLoop* loop, int fd, void* client, int mask) {
+  TcpConnectionPtr guard(static_cast<TcpConnection*>(client));
+  guard->StopWatchingSource();
+  guard->Flush();
+}
+
+void TcpConnection::ClearSegments() {
+  StopWatchingSource();
+  for (size_t i = 0; i < segments_.size(); ++i) {
+    if (segments_[i]->fd >= 0 && segments_[i]->owned) close(segments_[i]->fd);
+    delete segments_[i];
+  }
+  segments_.clear();
+  segment_bytes_ = 0;
+  if (piped_ > 0) {
+    // Whatever is left in the pipe belongs to a region we gave up on.
+    close(pipe_[0]);
+    close(pipe_[1]);
+    pipe_[0] = pipe_[1] = -1;
+    piped_ = 0;
+  }
+}
+
+bool TcpConnection::SetZeroCopyThreshold(size_t bytes) {
+  loop_.AssertInLoopThread();
+  if (bytes > 0 && !socket_.SetZeroCopy()) return false;
+  zerocopy_threshold_ = bytes;
+  return true;
+}
+
+// Send what is left of the block, with MSG_ZEROCOPY while the threshold
+// is on: 1 once it is all out, 0 while the kernel buffer is full, -1
+// after a failure closed the connection.
+int TcpConnection::SendZeroCopy(ZeroCopyBlock* block) {
+  FastBuffer& buf = block->buf;
+  bool copy = zerocopy_threshold_ == 0;
+  while (buf.GetReadingSize() > 0) {
+    size_t len = buf.GetReadingSize();
+    ssize_t n = send(fd(), buf.GetReading(), len, MSG_NOSIGNAL | (copy ? 0 : MSG_ZEROCOPY));
+    ++writes_;
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+      if (errno == ENOBUFS && !copy) {
+        // Out of option memory for notifications: copy this once.
+        copy = true;
+        continue;
+      }
+      HandleError(errno);
+      return -1;
+    }
+    if (!copy) {
+      block->zerocopy = true;
+      block->last = zerocopy_next_++;
+      ++zerocopy_sends_;
+    }
+    copy = zerocopy_threshold_ == 0;
+    buf.DrainReading(static_cast<size_t>(n));
+    // A short write means the kernel buffer is full, don't ask again.
+    if (static_cast<size_t>(n) < len) return 0;
+  }//end-while.
+  return 1;
+}
+
+// Completions arrive on the error queue, each a range of send ids, in
+// order for TCP. They wake the loop as an error event on the socket.
+void TcpConnection::ReapZeroCopy() {
+  for (;;) {
+    char control[128];
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    if (recvmsg(fd(), &msg, MSG_ERRQUEUE) < 0) {
+      if (errno == EINTR) continue;
+      break;
+    }
+    for (struct cmsghdr* cm = CMSG_FIRSTHDR(&msg); cm != nullptr; cm = CMSG_NXTHDR(&msg, cm)) {
+      if (!(cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) &&
+          !(cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR)) continue;
+      struct sock_extended_err ee;
+      memcpy(&ee, CMSG_DATA(cm), sizeof(ee));
+      if (ee.ee_errno != 0 || ee.ee_origin != SO_EE_ORIGIN_ZEROCOPY) continue;
+      if (ee.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+        // The kernel copied after all, pinning the pages only cost us.
+        ++zerocopy_copied_;
+        zerocopy_threshold_ = 0;
+      }
+      uint32_t done = ee.ee_data + 1;
+      if (static_cast<int32_t>(done - zerocopy_done_) > 0) zerocopy_done_ = done;
+    }//end-for.
+  }//end-for.
+  ReleaseZeroCopy();
+  if (budget_) Recharge();
+}
+
+// Free the blocks at the front that are sent and completed.
+void TcpConnection::ReleaseZeroCopy() {
+  while (!zerocopy_.empty()) {
+    ZeroCopyBlock* block = zerocopy_.front();
+    if (block->buf.GetReadingSize() > 0) break;
+    if (block->zerocopy && static_cast<int32_t>(block->last - zerocopy_done_) >= 0) break;
+    zerocopy_bytes_ -= block->size;
+    zerocopy_.pop_front();
+    delete block;
+  }//end-while.
+}
+
+void TcpConnection::OnFlush(SeEventLoop* loop, void* client) {
+  TcpConnectionPtr guard(static_cast<TcpConnection*>(client));
+  guard->Flush();
+}
+
+void TcpConnection::Flush() {
+  SeRemovePendingFlush(&flush_);
+  if (state_ == kDisconnected) return;
+  if (!WriteAll()) return;
+  CheckWaterMarks();
+  if (budget_) Recharge();
+  if (!OutputDone()) {
+    if (!segments_.empty() && segments_.front()->dry) {
+      if (channel_.IsWriting()) channel_.DisableWriting();
+      WatchSource(segments_.front()->fd);
+      return;
+    }
+    StopWatchingSource();
+    if (!channel_.IsWriting()) channel_.EnableWriting();
+    return;
+  }
+  StopWatchingSource();
+  if (channel_.IsWriting()) channel_.DisableWriting();
+  if (write_complete_cb_) write_complete_cb_(this);
+  if (state_ == kDisconnecting) ShutdownInLoop();
+}
+
+void TcpConnection::Shutdown() {
+  TcpConnectionPtr self(this);
+  loop_.RunInLoop([self]() { self->ShutdownInLoop(); });
+}
+
+void TcpConnection::ShutdownInLoop() {
+  loop_.AssertInLoopThread();
+  if (state_ == kConnected) state_ = kDisconnecting;
+  if (state_ == kDisconnecting && OutputDone() && !channel_.IsWriting()) {
+    ::shutdown(fd(), SHUT_WR);
+  }
+}
+
+void TcpConnection::ForceClose() {
+  TcpConnectionPtr self(this);
+  loop_.QueueInLoop([self]() { self->ForceCloseInLoop(); });
+}
+
+void TcpConnection::ForceCloseInLoop() {
+  loop_.AssertInLoopThread();
+  if (state_ == kConnected || state_ == kDisconnecting) HandleClose();
+}
+
+void TcpConnection::StopReading() {
+  PauseReadingAnywhere(kPauseUser, true);
+}
+
+void TcpConnection::StartReading() {
+  PauseReadingAnywhere(kPauseUser, false);
+}
+
+void TcpConnection::PauseReadingAnywhere(int reason, bool pause) {
+  if (loop_.IsInLoopThread()) {
+    PauseReading(reason, pause);
+  } else {
+    TcpConnectionPtr self(this);
+    loop_.QueueInLoop([self, reason, pause]() { self->PauseReading(reason, pause); });
+  }
+}
+
+// Reading is on while connected and no reason to pause is left.
+void TcpConnection::PauseReading(int reason, bool pause) {
+  if (pause) {
+    paused_ |= reason;
+  } else {
+    paused_ &= ~reason;
+  }
+  if (state_ != kConnected && state_ != kDisconnecting) return;
+  bool reading = paused_ == 0;
+  if (reading != channel_.IsReading()) {
+    if (reading) {
+      channel_.EnableReading();
+    } else {
+      channel_.DisableReading();
+    }
+  }
+}
+
+void TcpConnection::SetBackpressureSource(const TcpConnectionPtr& source) {
+  loop_.AssertInLoopThread();
+  if (backpressure_source_ && above_high_) {
+    backpressure_source_->PauseReadingAnywhere(kPausePeer, false);
+  }
+  backpressure_source_ = source;
+  if (backpressure_source_ && above_high_) {
+    backpressure_source_->PauseReadingAnywhere(kPausePeer, true);
+  }
+}
+
+void TcpConnection::CheckWaterMarks() {
+  size_t pending = Pending();
+  if (!above_high_ && pending >= high_water_) {
+    above_high_ = true;
+    if (backpressure_source_) backpressure_source_->PauseReadingAnywhere(kPausePeer, true);
+    if (high_water_cb_) high_water_cb_(this, pending);
+  } else if (above_high_ && pending <= low_water_) {
+    above_high_ = false;
+    if (backpressure_source_) backpressure_source_->PauseReadingAnywhere(kPausePeer, false);
+    if (low_water_cb_) low_water_cb_(this, pending);
+  }
+}
+
+// Bring the budget in line with what the buffers hold now.
+void TcpConnection::Recharge() {
+  size_t held = input_.GetReadingSize() + output_.GetReadingSize() +
+    segment_bytes_ + zerocopy_bytes_;
+  if (held != charged_) {
+    budget_->Charge(static_cast<long long>(held) - static_cast<long long>(charged_));
+    charged_ = held;
+  }
+}
+
+// Reading paused on the budget: look again after a while, there is no
+// wakeup for memory released by other connections.
+void TcpConnection::RetryBudget() {
+  if (budget_retry_) return;
+  budget_retry_ = true;
+  TcpConnectionPtr self(this);
+  loop_.RunAfter(budget_->RetrySeconds(), [self]() {
+    TcpConnection* conn = self.get();
+    conn->budget_retry_ = false;
+    if (!(conn->paused_ & kPauseBudget)) return;
+    if (conn->budget_->Relieved()) {
+      conn->PauseReading(kPauseBudget, false);
+    } else if (conn->state_ == kConnected || conn->state_ == kDisconnecting) {
+      conn->RetryBudget();
+    }
+  });
+}
+
+// On close: hand back the budget and let the source read again.
+void TcpConnection::ReleaseBackpressure() {
+  if (budget_ && charged_) {
+    budget_->Charge(-static_cast<long long>(charged_));
+    charged_ = 0;
+  }
+  if (backpressure_source_) {
+    if (above_high_) backpressure_source_->PauseReadingAnywhere(kPausePeer, false);
+    backpressure_source_.Reset();
+  }
+  above_high_ = false;
+}
+
+}//end-cromwell.
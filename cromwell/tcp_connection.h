@@ -0,0 +1,251 @@
+#ifndef __CROMWELL_TCP_CONNECTION_H
+#define __CROMWELL_TCP_CONNECTION_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <deque>
+#include <functional>
+
+#include "buffer_budget.h"
+#include "channel.h"
+#include "delegate.h"
+#include "fast_buffer.h"
+#include "ref_counted.h"
+#include "se.h"
+#include "socket.h"
+
+namespace cromwell {
+
+class ConnectionPool;
+class EventLoop;
+class TcpConnection;
+
+typedef RefPtr<TcpConnection> TcpConnectionPtr;
+
+// One established, non-blocking TCP connection owned by one loop.
+//
+// Input is read with a single readv into the free tail of the input
+// buffer plus a 64KB area on the stack, so an idle connection keeps a
+// small buffer and a busy one still drains a burst in one syscall.
+// Output is copied into the output buffer and written out right before
+// the loop polls again, so everything sent during one iteration leaves
+// with one syscall; a large send goes out at once with writev, behind
+// whatever is buffered, without being copied first. File regions go out
+// in order with the bytes around them, from the kernel page cache with
+// sendfile, or for pipes and other files it refuses, with splice.
+// Above the zero copy threshold the output buffer is handed to the kernel
+// with MSG_ZEROCOPY instead of being copied into it; the block is freed
+// once the completion shows up on the socket error queue.
+//
+// Backpressure: once the output buffer reaches the high water mark the
+// high water callback runs, and reads pause on the backpressure source,
+// e.g. the upstream a proxy copies from, until it drained to the low
+// water mark. With a BufferBudget the connection also stops reading
+// while the budget is exceeded.
+//
+// The connection is reference counted and tied to its channel: it stays
+// alive while one of its callbacks runs. Everything but Send, Shutdown
+// and ForceClose must be called from the loop thread. Connections from a
+// ConnectionPool also have a Handle, which is what other threads and
+// timers should hold on to instead of a reference.
+class TcpConnection : public RefCounted {
+public:
+  // Established and closed, see Connected().
+  typedef std::function<void(const TcpConnectionPtr& conn)> ConnectionCallback;
+  typedef std::function<void(const TcpConnectionPtr& conn)> CloseCallback;
+  // New bytes are in buf, consume them with DrainReading.
+  typedef Delegate<void(TcpConnection* conn, FastBuffer* buf, long long receive_time)> MessageCallback;
+  // The output buffer ran empty.
+  typedef Delegate<void(TcpConnection* conn)> WriteCompleteCallback;
+  // The output buffer crossed a water mark, pending bytes in it.
+  typedef Delegate<void(TcpConnection* conn, size_t pending)> WaterMarkCallback;
+
+  TcpConnection(EventLoop& loop, int sockfd, const char* peer_ip, int peer_port);
+
+  EventLoop& GetLoop() const { return loop_; }
+  int fd() const { return socket_.SocketId(); }
+  const char* PeerIp() const { return peer_ip_; }
+  int PeerPort() const { return peer_port_; }
+  // Key in the ConnectionPool the connection came from, 0 if none.
+  uint64_t Handle() const { return handle_; }
+  // Whatever the owner keeps with the connection, NULL at first.
+  void SetContext(void* context) { context_ = context; }
+  void* Context() const { return context_; }
+  bool Connected() const { return state_ == kConnected; }
+  bool Disconnected() const { return state_ == kDisconnected; }
+
+  void SetConnectionCallback(const ConnectionCallback& cb) { conn_cb_ = cb; }
+  void SetMessageCallback(const MessageCallback& cb) { message_cb_ = cb; }
+  void SetWriteCompleteCallback(const WriteCompleteCallback& cb) { write_complete_cb_ = cb; }
+  // Internal, for the server owning the connection.
+  void SetCloseCallback(const CloseCallback& cb) { close_cb_ = cb; }
+
+  // Output buffer sizes at which the high water callback runs and, on
+  // the way back down, the low water callback. 64MB and 16MB by default.
+  void SetWaterMarks(size_t low, size_t high) { low_water_ = low; high_water_ = high; }
+  void SetHighWaterMarkCallback(const WaterMarkCallback& cb) { high_water_cb_ = cb; }
+  void SetLowWaterMarkCallback(const WaterMarkCallback& cb) { low_water_cb_ = cb; }
+  // Pause reads on source while this output is above the high water mark.
+  // Loop thread, source may live in another loop.
+  void SetBackpressureSource(const TcpConnectionPtr& source);
+  // Charge the bytes buffered here to budget, which must outlive the
+  // connection. Before ConnectEstablished.
+  void SetBufferBudget(BufferBudget* budget) { budget_ = budget; }
+
+  // Stop and restart reading from the socket. Any thread.
+  void StopReading();
+  void StartReading();
+  bool IsReading() const { return channel_.IsReading(); }
+
+  // Copied; from another thread the bytes travel through the task queue.
+  void Send(const void* data, size_t len);
+  // Send the readable bytes of buf and leave it empty. When nothing else
+  // is buffered its memory becomes the output buffer and the bytes are
+  // not copied, which is how large messages reach the zero copy path.
+  // Any thread.
+  void Send(FastBuffer* buf);
+  // Send count bytes of fd starting at offset without copying them
+  // through user space; they go out after everything sent before and
+  // ahead of everything sent after. For a file that cannot seek, e.g. a
+  // pipe, offset is ignored and sending ends early at EOF. The fd is
+  // duplicated when the region cannot go out at once, so the caller may
+  // close it on return. While a pipe or socket source has no data yet
+  // the connection waits for it to turn readable, and what is queued
+  // behind the region waits with it. Any thread; false if dup failed.
+  bool SendFile(int fd, off_t offset, size_t count);
+  // Half-close once the output buffer is written out.
+  void Shutdown();
+  void ForceClose();
+  void SetTcpNoDelay(bool on) { socket_.SetTcpNoDelay(on); }
+  // Write output buffers of at least bytes with MSG_ZEROCOPY, 0 for never
+  // (the default). Pinning pages only pays off above some 10KB. When the
+  // kernel reports it copied anyway, as it does for loopback and other
+  // local peers, the connection goes back to plain sends. False if the
+  // socket refused SO_ZEROCOPY.
+  bool SetZeroCopyThreshold(size_t bytes);
+
+  FastBuffer* InputBuffer() { return &input_; }
+  FastBuffer* OutputBuffer() { return &output_; }
+  // Bytes waiting in the output buffer, file regions not counted.
+  size_t Pending() const;
+  // Read and write syscalls issued so far.
+  long long Reads() const { return reads_; }
+  long long Writes() const { return writes_; }
+  // The errno that closed the connection, ENOMEM when a buffer could not
+  // grow; 0 if it closed cleanly or is still open.
+  int Error() const { return error_; }
+  // Sends made with MSG_ZEROCOPY, and completions the kernel reported as
+  // copied after all.
+  long long ZeroCopySends() const { return zerocopy_sends_; }
+  long long ZeroCopyCopied() const { return zerocopy_copied_; }
+
+  // Start reading, called once by the owner after the connection is set
+  // up. ConnectDestroyed unregisters it for good, the last thing the owner
+  // does with it.
+  void ConnectEstablished();
+  void ConnectDestroyed();
+
+private:
+  friend class ConnectionPool;
+  struct OutputSegment;
+  struct ZeroCopyBlock;
+  enum StateE { kDisconnected, kConnecting, kConnected, kDisconnecting };
+  // Why reading is paused, one bit each.
+  enum PauseE { kPauseUser = 1, kPausePeer = 2, kPauseBudget = 4 };
+
+  ~TcpConnection();
+  void Destroy() const;
+
+  static void OnFlush(SeEventLoop* loop, void* client);
+  void HandleRead(long long receive_time);
+  void HandleWrite();
+  void HandleClose();
+  void HandleError(int err);
+  void SendInLoop(const void* data, size_t len);
+  void SendBufferInLoop(FastBuffer* buf);
+  bool WriteOut(const void* data, size_t len, size_t* sent);
+  bool WriteAll();
+  void SendFileInLoop(int fd, off_t offset, size_t count, bool owned);
+  int SendSegment(OutputSegment* seg);
+  int SpliceSegment(OutputSegment* seg);
+  static void OnSourceReadable(SeEventLoop* loop, int fd, void* client, int mask);
+  void WatchSource(int fd);
+  void StopWatchingSource();
+  bool OutputDone() const;
+  void ClearSegments();
+  int SendZeroCopy(ZeroCopyBlock* block);
+  void ReapZeroCopy();
+  void ReleaseZeroCopy();
+  void Flush();
+  void ShutdownInLoop();
+  void ForceCloseInLoop();
+  void PauseReading(int reason, bool pause);
+  void PauseReadingAnywhere(int reason, bool pause);
+  void CheckWaterMarks();
+  void Recharge();
+  void RetryBudget();
+  void ReleaseBackpressure();
+
+private:
+  static const size_t kExtraBufferSize;
+  static const size_t kDirectSendSize;
+  static const size_t kIdleBufferSize;
+  static const size_t kDefaultHighWater;
+  static const size_t kDefaultLowWater;
+  static const size_t kFileChunkSize;
+  static const size_t kPipeChunkSize;
+
+private:
+  EventLoop& loop_;
+  ConnectionPool* pool_;
+  uint64_t handle_;
+  void* context_;
+  Socket socket_;
+  Channel channel_;
+  char peer_ip_[46];
+  int peer_port_;
+  StateE state_;
+  FastBuffer input_;
+  FastBuffer output_;
+  // What is queued behind a file region, in order; output_ holds only
+  // the bytes ahead of the first one.
+  std::deque<OutputSegment*> segments_;
+  size_t segment_bytes_;
+  int pipe_[2]; // for splice, created on first use
+  size_t piped_; // bytes of the front region sitting in the pipe
+  int source_fd_; // the front region's source, watched while it is dry
+  // Blocks given to the kernel, oldest first; only the last one may still
+  // have bytes to send, and they go out ahead of output_.
+  std::deque<ZeroCopyBlock*> zerocopy_;
+  size_t zerocopy_threshold_;
+  size_t zerocopy_bytes_; // held by the blocks
+  uint32_t zerocopy_next_; // id of the next MSG_ZEROCOPY send
+  uint32_t zerocopy_done_; // ids below it are completed
+  long long zerocopy_sends_;
+  long long zerocopy_copied_;
+  SeFlush flush_;
+  long long reads_;
+  long long writes_;
+  int error_;
+  size_t high_water_;
+  size_t low_water_;
+  bool above_high_;
+  int paused_;
+  bool budget_retry_;
+  BufferBudget* budget_;
+  size_t charged_;
+  TcpConnectionPtr backpressure_source_;
+
+  ConnectionCallback conn_cb_;
+  CloseCallback close_cb_;
+  MessageCallback message_cb_;
+  WriteCompleteCallback write_complete_cb_;
+  WaterMarkCallback high_water_cb_;
+  WaterMarkCallback low_water_cb_;
+};
+
+}//end-cromwell.
+
+#endif
@@ -1,9 +1,11 @@
 #ifndef __CROMWELL_THREAD_H
 #define __CROMWELL_THREAD_H
 
+#include <functional>
 #include <stdexcept>
 #include <stdlib.h>
 #include <pthread.h>
+#include <signal.h>
 #include <sys/prctl.h>
 #include <sched.h>
 
@@ -18,28 +20,41 @@ public:
     kRunning,
   };
 
-  explicit Thread(const ThreadFunc& func, pthread_attr* attr, bool detached) :
+  explicit Thread(const ThreadFunc& func, pthread_attr_t* attr, bool detached,
+      bool block_signals = false) :
     func_(func),
     attr_(attr),
+    arg_(NULL),
+    state_(kStop),
     detached_(detached),
-    state_(kStop) {
+    block_signals_(block_signals) {
 
     }
 
   ~Thread() {
+    if (!detached_) {
+      try { this->Join(); } catch(...) {}
+    }
     if (attr_) {
       pthread_attr_destroy(attr_);
       delete attr_;
       attr_ = nullptr;
     }
-    if (!detached_) {
-      try { this->Join(); } catch(...) {}
-    }
   }
 
   inline bool Start(void* arg) {
     if (state_ != kStop) return false;
-    if (pthread_create(&t_id_, attr_, DefaultThreadMain, arg) != 0) {
+    arg_ = arg;
+    // The new thread inherits our mask, so block around pthread_create
+    // and no signal can reach it before it runs.
+    sigset_t blocked, saved;
+    if (block_signals_) {
+      AsyncSignals(&blocked);
+      pthread_sigmask(SIG_BLOCK, &blocked, &saved);
+    }
+    int rc = pthread_create(&t_id_, attr_, DefaultThreadMain, this);
+    if (block_signals_) pthread_sigmask(SIG_SETMASK, &saved, NULL);
+    if (rc != 0) {
       throw std::runtime_error("pthread_create failed.");
     }
     state_ = kRunning;
@@ -50,8 +65,8 @@ public:
     if (!detached_ && state_ != kStop) {
       void* ignore;
       int res = pthread_join(t_id_, &ignore);
-      detached_ = (res == 0);
       if (res != 0) return false;
+      state_ = kStop;
     }//end-if.
     return true;
   }
@@ -65,7 +80,27 @@ public:
   }
 
   static inline void SetName(const char* thread_name) {
-    prctl(PR_SET_NAME, name);
+    prctl(PR_SET_NAME, thread_name);
+  }
+
+  // Pin the calling thread to one cpu.
+  static inline bool SetAffinity(int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+  }
+
+  // Every signal but the ones raised synchronously by a faulting
+  // instruction, which must never be blocked.
+  static inline void AsyncSignals(sigset_t* set) {
+    sigfillset(set);
+    sigdelset(set, SIGSEGV);
+    sigdelset(set, SIGBUS);
+    sigdelset(set, SIGFPE);
+    sigdelset(set, SIGILL);
+    sigdelset(set, SIGTRAP);
+    sigdelset(set, SIGABRT);
   }
 
   static inline void Yield() {
@@ -77,16 +112,19 @@ public:
 
 private:
   inline static void* DefaultThreadMain(void* arg) {
-    func_(arg);
+    Thread* thread = static_cast<Thread*>(arg);
+    thread->func_(thread->arg_);
     return NULL;
   }
 
 private:
   ThreadFunc func_;
   pthread_attr_t* attr_;
+  void* arg_;
   pthread_t t_id_;
   ThreadState state_;
   bool detached_;
+  bool block_signals_;
 };
 
 class ThreadFactory {
@@ -95,7 +133,8 @@ public:
     : priority_(-1),
     schedule_(-1),
     stack_size_(-1),
-    detached_(false) {
+    detached_(false),
+    block_signals_(true) {
 
     }
 
@@ -105,8 +144,12 @@ public:
     else priority_ = prior;
   }
 
+  // Map the [0, 1] priority onto the range of the scheduling policy.
   inline int get_priority(void) const {
-    int policy = get_schedule();
+    int policy = get_schedule() >= 0 ? get_schedule() : SCHED_OTHER;
+    int min = sched_get_priority_min(policy);
+    int max = sched_get_priority_max(policy);
+    return min + static_cast<int>(static_cast<float>(max - min) * priority_);
   }
 
   inline void set_schedule(int policy) {
@@ -142,6 +185,17 @@ public:
     return detached_;
   }
 
+  // Threads start with every asynchronous signal blocked, so signals are
+  // left to the thread that waits for them, e.g. a loop with signal
+  // events (see SeCreateSignalEvent). On by default.
+  inline void set_block_signals(bool rc) {
+    block_signals_ = rc;
+  }
+
+  inline bool get_block_signals() const {
+    return block_signals_;
+  }
+
   inline Thread* CreateThread(const ThreadFunc& func) const {
     pthread_attr_t* attr = new pthread_attr_t;
     if (0 == pthread_attr_init(attr)) {
@@ -157,10 +211,11 @@ public:
         if (priority_ >= 0) {
           struct sched_param param;
           param.sched_priority = get_priority();
-          if (pthread_attr_setschedparam(attr, &sched_param) != 0) break;
+          if (pthread_attr_setschedparam(attr, &param) != 0) break;
         }
-        return new Thread(func, attr, detached_);
+        return new Thread(func, attr, detached_, block_signals_);
       } while(0);
+      pthread_attr_destroy(attr);
     }//end-if.
     delete attr;
     return nullptr;
@@ -171,6 +226,7 @@ private:
   int schedule_;
   int stack_size_;
   bool detached_;
+  bool block_signals_;
 };
 
 }//end-cromwell.
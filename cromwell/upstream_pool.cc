@@ -0,0 +1,204 @@
+#include "upstream_pool.h"
+
+#include <string.h>
+#include <time.h>
+
+#include "connector.h"
+#include "event_loop.h"
+
+namespace cromwell {
+
+struct UpstreamPool::Slot {
+  Backend* backend;
+  std::shared_ptr<Connector> connector;
+  TcpConnectionPtr conn; // set while up
+  int outstanding;
+};
+
+struct UpstreamPool::Backend {
+  char ip[256]; // or host name
+  int port;
+  int up; // slots with a connection
+  int outstanding;
+  std::vector<std::unique_ptr<Slot> > slots;
+};
+
+UpstreamPool::UpstreamPool(EventLoop& loop, int connections)
+  : loop_(loop),
+  connections_(connections > 0 ? connections : 1),
+  strategy_(kPowerOfTwoChoices),
+  started_(false),
+  connected_(0),
+  outstanding_(0),
+  seed_(static_cast<uint32_t>(reinterpret_cast<uintptr_t>(this) >> 4) ^
+      static_cast<uint32_t>(time(nullptr))),
+  next_(0),
+  resolver_(nullptr) {
+  if (seed_ == 0) seed_ = 1;
+}
+
+UpstreamPool::~UpstreamPool() {
+  Stop();
+}
+
+void UpstreamPool::AddBackend(const char* ip, int port) {
+  std::unique_ptr<Backend> backend(new Backend());
+  strncpy(backend->ip, ip, sizeof(backend->ip) - 1);
+  backend->ip[sizeof(backend->ip) - 1] = '\0';
+  backend->port = port;
+  backend->up = 0;
+  backend->outstanding = 0;
+  for (int i = 0; i < connections_; ++i) {
+    std::unique_ptr<Slot> slot(new Slot());
+    slot->backend = backend.get();
+    slot->outstanding = 0;
+    backend->slots.push_back(std::move(slot));
+  }//end-for.
+  backends_.push_back(std::move(backend));
+}
+
+void UpstreamPool::Start() {
+  loop_.AssertInLoopThread();
+  if (started_) return;
+  started_ = true;
+  for (size_t i = 0; i < backends_.size(); ++i) {
+    for (size_t j = 0; j < backends_[i]->slots.size(); ++j) {
+      Connect(backends_[i]->slots[j].get());
+    }
+  }//end-for.
+}
+
+void UpstreamPool::Stop() {
+  if (!started_) return;
+  loop_.AssertInLoopThread();
+  started_ = false;
+  for (size_t i = 0; i < backends_.size(); ++i) {
+    Backend* backend = backends_[i].get();
+    for (size_t j = 0; j < backend->slots.size(); ++j) {
+      Slot* slot = backend->slots[j].get();
+      if (slot->connector) {
+        slot->connector->SetNewConnectionCallback(Connector::NewConnectionCallback());
+        slot->connector->Stop();
+        slot->connector.reset();
+      }
+      if (slot->conn) {
+        slots_.erase(slot->conn.get());
+        TcpConnectionPtr conn = slot->conn;
+        slot->conn.Reset();
+        conn->ConnectDestroyed();
+      }
+      slot->outstanding = 0;
+    }//end-for.
+    backend->up = 0;
+    backend->outstanding = 0;
+  }//end-for.
+  live_.clear();
+  connected_ = 0;
+  outstanding_ = 0;
+}
+
+void UpstreamPool::Connect(Slot* slot) {
+  Backend* backend = slot->backend;
+  slot->connector = std::make_shared<Connector>(loop_, backend->ip, backend->port);
+  slot->connector->SetResolver(resolver_);
+  slot->connector->SetNewConnectionCallback([this, slot](int sockfd) {
+    OnConnected(slot, sockfd);
+  });
+  slot->connector->Start();
+}
+
+void UpstreamPool::OnConnected(Slot* slot, int sockfd) {
+  Backend* backend = slot->backend;
+  TcpConnectionPtr conn(new TcpConnection(loop_, sockfd, backend->ip, backend->port));
+  conn->SetTcpNoDelay(true);
+  conn->SetConnectionCallback(conn_cb_);
+  conn->SetCloseCallback([this, slot](const TcpConnectionPtr& c) { OnClose(slot, c); });
+  slot->conn = conn;
+  slot->outstanding = 0;
+  slots_[conn.get()] = slot;
+  ++connected_;
+  if (++backend->up == 1) UpdateLive();
+  conn->ConnectEstablished();
+}
+
+// Requests in flight on the connection are lost with it; whoever sent
+// them learns from the connection callback.
+void UpstreamPool::OnClose(Slot* slot, const TcpConnectionPtr& conn) {
+  if (slot->conn.get() != conn.get()) return;
+  Backend* backend = slot->backend;
+  backend->outstanding -= slot->outstanding;
+  outstanding_ -= slot->outstanding;
+  slot->outstanding = 0;
+  slots_.erase(conn.get());
+  slot->conn.Reset();
+  --connected_;
+  if (--backend->up == 0) UpdateLive();
+  conn->ConnectDestroyed();
+  if (started_ && slot->connector) slot->connector->Reconnect();
+}
+
+void UpstreamPool::UpdateLive() {
+  live_.clear();
+  for (size_t i = 0; i < backends_.size(); ++i) {
+    if (backends_[i]->up > 0) live_.push_back(backends_[i].get());
+  }
+}
+
+TcpConnection* UpstreamPool::Acquire() {
+  loop_.AssertInLoopThread();
+  Backend* backend = PickBackend();
+  if (!backend) return nullptr;
+  Slot* best = nullptr;
+  for (size_t i = 0; i < backend->slots.size(); ++i) {
+    Slot* slot = backend->slots[i].get();
+    if (slot->conn && (!best || slot->outstanding < best->outstanding)) best = slot;
+  }//end-for.
+  ++best->outstanding;
+  ++backend->outstanding;
+  ++outstanding_;
+  return best->conn.get();
+}
+
+void UpstreamPool::Release(TcpConnection* conn) {
+  loop_.AssertInLoopThread();
+  std::unordered_map<TcpConnection*, Slot*>::iterator it = slots_.find(conn);
+  if (it == slots_.end()) return;
+  Slot* slot = it->second;
+  if (slot->outstanding == 0) return;
+  --slot->outstanding;
+  --slot->backend->outstanding;
+  --outstanding_;
+}
+
+UpstreamPool::Backend* UpstreamPool::PickBackend() {
+  size_t n = live_.size();
+  if (n == 0) return nullptr;
+  if (n == 1) return live_[0];
+  if (strategy_ == kPowerOfTwoChoices) {
+    size_t a = Random() % n;
+    size_t b = Random() % (n - 1);
+    if (b >= a) ++b;
+    return live_[b]->outstanding < live_[a]->outstanding ? live_[b] : live_[a];
+  }
+  // Ties go round-robin, or an idle pool would send everything to the
+  // first backend.
+  size_t start = next_++ % n;
+  Backend* best = live_[start];
+  for (size_t i = 1; i < n; ++i) {
+    Backend* backend = live_[(start + i) % n];
+    if (backend->outstanding < best->outstanding) best = backend;
+  }//end-for.
+  return best;
+}
+
+// xorshift32, plenty for picking backends.
+uint32_t UpstreamPool::Random() {
+  uint32_t x = seed_;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  seed_ = x;
+  return x;
+}
+
+}//end-cromwell.
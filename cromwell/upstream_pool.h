@@ -0,0 +1,97 @@
+#ifndef __CROMWELL_UPSTREAM_POOL_H
+#define __CROMWELL_UPSTREAM_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "noncopyable.h"
+#include "tcp_connection.h"
+
+namespace cromwell {
+
+class AsyncResolver;
+class EventLoop;
+
+// Persistent connections from one loop to a set of backends, opened up
+// front so a request never waits for a handshake. Acquire picks the
+// backend with power of two choices (two random backends, the one with
+// fewer requests outstanding) or by least outstanding requests over all
+// of them, and the least busy connection to it; Release ends the request.
+// A connection that closes is counted out at once and connected again in
+// the background, with the Connector's backoff while the backend is down
+// or keeps dropping connections.
+//
+// One pool per loop, e.g. created in the thread init callback of an
+// EventLoopThreadPool: everything runs in the loop thread, nothing locks.
+// The pool leaves the connections' context to the user.
+class UpstreamPool : noncopyable {
+public:
+  enum Strategy {
+    kPowerOfTwoChoices = 0,
+    kLeastOutstanding,
+  };
+  // An upstream connection went up or down, see Connected(). Set its
+  // message callback here.
+  typedef std::function<void(const TcpConnectionPtr& conn)> ConnectionCallback;
+
+  // connections to each backend.
+  UpstreamPool(EventLoop& loop, int connections);
+  ~UpstreamPool();
+
+  // Before Start. ip may be a host name, see SetResolver.
+  void AddBackend(const char* ip, int port);
+  void SetStrategy(Strategy strategy) { strategy_ = strategy; }
+  // Look host names up with resolver, which must outlive the pool.
+  void SetResolver(AsyncResolver* resolver) { resolver_ = resolver; }
+  void SetConnectionCallback(const ConnectionCallback& cb) { conn_cb_ = cb; }
+
+  // Connect everything.
+  void Start();
+  // Close every connection and stop reconnecting.
+  void Stop();
+
+  // A connection for one more request, NULL while no backend is up.
+  TcpConnection* Acquire();
+  // The request on conn is done. Ignored once conn closed.
+  void Release(TcpConnection* conn);
+
+  size_t Backends() const { return backends_.size(); }
+  // Connections up and requests outstanding, over all backends.
+  int Connected() const { return connected_; }
+  int Outstanding() const { return outstanding_; }
+
+private:
+  struct Backend;
+  struct Slot;
+
+  void Connect(Slot* slot);
+  void OnConnected(Slot* slot, int sockfd);
+  void OnClose(Slot* slot, const TcpConnectionPtr& conn);
+  void UpdateLive();
+  Backend* PickBackend();
+  uint32_t Random();
+
+private:
+  EventLoop& loop_;
+  int connections_;
+  Strategy strategy_;
+  bool started_;
+  int connected_;
+  int outstanding_;
+  uint32_t seed_;
+  size_t next_; // round-robin start among equally busy backends
+  std::vector<std::unique_ptr<Backend> > backends_;
+  std::vector<Backend*> live_; // backends with a connection up
+  std::unordered_map<TcpConnection*, Slot*> slots_; // by connection up
+  AsyncResolver* resolver_;
+  ConnectionCallback conn_cb_;
+};
+
+}//end-cromwell.
+
+#endif
@@ -0,0 +1,93 @@
+// Connection storm benchmark for Acceptor.
+//
+// C client threads connect and reset as fast as they can while the server
+// accepts and closes, for each way of accepting: one accept per wakeup,
+// a batch per wakeup handed to N worker loops, one SO_REUSEPORT listener
+// per worker loop, and the same with the listener picked by cpu.
+//
+//   accept_bench [workers] [clients] [seconds] [port]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "cromwell/acceptor.h"
+#include "cromwell/event_loop.h"
+#include "cromwell/event_loop_thread_pool.h"
+
+using namespace cromwell;
+
+namespace {
+
+std::atomic<bool> g_running(true);
+
+void Client(int port) {
+  struct sockaddr_in sa;
+  sa.sin_family = AF_INET;
+  sa.sin_port = htons(static_cast<uint16_t>(port));
+  sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  // Reset instead of FIN, or TIME_WAIT runs out of ports within a second.
+  struct linger lg = {1, 0};
+  while (g_running) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    setsockopt(fd, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+    connect(fd, reinterpret_cast<struct sockaddr*>(&sa), sizeof(sa));
+    close(fd);
+  }
+}
+
+void Run(const char* name, int workers, int clients, int seconds, int port,
+    int batch, bool per_loop, bool steer) {
+  EventLoop base_loop;
+  EventLoopThreadPool pool(base_loop, workers);
+  pool.Start();
+
+  long long accepted = 0;
+  {
+    Acceptor acceptor(base_loop, "127.0.0.1", port, false);
+    acceptor.SetWorkerPool(&pool);
+    acceptor.SetAcceptBatch(batch);
+    acceptor.SetListenerPerLoop(per_loop, steer);
+    acceptor.SetNewConnectionCallback([](EventLoop& loop, int fd, const char* ip, int peer_port) {
+      close(fd);
+    });
+    if (!acceptor.Listen()) {
+      perror("listen");
+      exit(1);
+    }
+
+    g_running = true;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < clients; ++i) threads.push_back(std::thread(Client, port));
+    base_loop.RunAfter(seconds, [&base_loop]() { base_loop.Quit(); });
+    base_loop.Loop();
+    g_running = false;
+    for (size_t i = 0; i < threads.size(); ++i) threads[i].join();
+    accepted = acceptor.Accepted();
+  }
+  pool.Stop();
+
+  printf("%-16s %.0f accepts/s\n", name, static_cast<double>(accepted) / seconds);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  int workers = argc > 1 ? atoi(argv[1]) : 4;
+  int clients = argc > 2 ? atoi(argv[2]) : 8;
+  int seconds = argc > 3 ? atoi(argv[3]) : 3;
+  int port = argc > 4 ? atoi(argv[4]) : 19528;
+
+  Run("one-per-wakeup", workers, clients, seconds, port, 1, false, false);
+  Run("batched", workers, clients, seconds, port + 1, 64, false, false);
+  Run("listener-per-loop", workers, clients, seconds, port + 2, 64, true, false);
+  Run("steered-by-cpu", workers, clients, seconds, port + 3, 64, true, true);
+  return 0;
+}
@@ -0,0 +1,125 @@
+// Proxy backpressure benchmark.
+//
+// A producer writes into the upstream side of a proxy as fast as it can;
+// the proxy copies everything to the downstream connection, whose reader
+// only takes rate bytes per millisecond. Without backpressure the
+// downstream output buffer absorbs the difference; with water marks the
+// upstream stops reading and TCP flow control holds the producer back.
+// The second pair of runs puts every connection under one BufferBudget.
+// Reports the bytes delivered and the peak of buffered memory.
+//
+//   backpressure_bench [rate_kb_per_ms] [seconds]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <vector>
+
+#include "cromwell/buffer_budget.h"
+#include "cromwell/event_loop.h"
+#include "cromwell/se.h"
+#include "cromwell/tcp_connection.h"
+
+using namespace cromwell;
+
+namespace {
+
+const size_t kHighWater = 1024 * 1024;
+const size_t kLowWater = 256 * 1024;
+
+struct Run {
+  long long produced;
+  long long consumed;
+  size_t peak;
+  size_t rate;
+  std::vector<char> chunk;
+};
+
+void SetNonBlock(int fd) {
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+void OnProducer(SeEventLoop* loop, int fd, void* client, int mask) {
+  Run* run = static_cast<Run*>(client);
+  ssize_t n = write(fd, run->chunk.data(), run->chunk.size());
+  if (n > 0) run->produced += n;
+}
+
+void Pair(int sv[2]) {
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+    perror("socketpair");
+    exit(1);
+  }
+  SetNonBlock(sv[0]);
+  SetNonBlock(sv[1]);
+}
+
+void RunOnce(bool backpressure, BufferBudget* budget, size_t rate, int seconds) {
+  EventLoop loop;
+  Run run;
+  run.produced = run.consumed = 0;
+  run.peak = 0;
+  run.rate = rate;
+  run.chunk.assign(64 * 1024, 'p');
+
+  int up[2], down[2];
+  Pair(up);
+  Pair(down);
+  TcpConnectionPtr upstream(new TcpConnection(loop, up[1], "upstream", 0));
+  TcpConnectionPtr downstream(new TcpConnection(loop, down[0], "downstream", 0));
+  TcpConnection* out = downstream.get();
+  upstream->SetMessageCallback([out](TcpConnection* conn, FastBuffer* buf, long long receive_time) {
+    out->Send(buf->GetReading(), buf->GetReadingSize());
+    buf->DrainReading(buf->GetReadingSize());
+  });
+  downstream->SetWaterMarks(kLowWater, kHighWater);
+  if (backpressure) downstream->SetBackpressureSource(upstream);
+  if (budget) {
+    upstream->SetBufferBudget(budget);
+    downstream->SetBufferBudget(budget);
+  }
+  upstream->ConnectEstablished();
+  downstream->ConnectEstablished();
+
+  SeCreateFileEvent(loop.se_loop(), up[0], SE_WRITABLE, OnProducer, &run);
+  int reader = down[1];
+  loop.RunEvery(0.001, [&run, reader, out]() {
+    std::vector<char> buf(run.rate);
+    ssize_t n = read(reader, buf.data(), buf.size());
+    if (n > 0) run.consumed += n;
+    size_t held = out->Pending();
+    if (held > run.peak) run.peak = held;
+  });
+  loop.RunAfter(seconds, [&loop]() { loop.Quit(); });
+  loop.Loop();
+
+  printf("%-12s %-6s produced=%.1fMB consumed=%.1fMB peak_output=%.1fMB",
+      backpressure ? "watermarks" : "none", budget ? "budget" : "-",
+      static_cast<double>(run.produced) / 1e6, static_cast<double>(run.consumed) / 1e6,
+      static_cast<double>(run.peak) / 1e6);
+  if (budget) printf(" budget_peak=%.1fMB", static_cast<double>(budget->Peak()) / 1e6);
+  printf("\n");
+
+  SeDeleteFileEvent(loop.se_loop(), up[0], SE_WRITABLE);
+  upstream->ConnectDestroyed();
+  downstream->ConnectDestroyed();
+  close(up[0]);
+  close(down[1]);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  size_t rate = argc > 1 ? static_cast<size_t>(atol(argv[1])) * 1024 : 64 * 1024;
+  int seconds = argc > 2 ? atoi(argv[2]) : 2;
+
+  RunOnce(false, nullptr, rate, seconds);
+  RunOnce(true, nullptr, rate, seconds);
+  BufferBudget budget(4 * 1024 * 1024, 0.001);
+  RunOnce(false, &budget, rate, seconds);
+  return 0;
+}
@@ -0,0 +1,93 @@
+// Asynchronous DNS with cdns::Resolver.
+//
+// Resolves every name given twice, the second time from the cache or the
+// lookup already out, then connects a Connector to the first one by name
+// on a local listener. All of it runs on one loop that keeps ticking a
+// timer while the lookups are out, to show it never blocks. Works offline for names in /etc/hosts,
+// e.g. localhost; -s points it at a stub resolver instead of the servers
+// in /etc/resolv.conf.
+//
+//   dns [-s ip[:port],...] host...
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <memory>
+
+#include "cromwell/acceptor.h"
+#include "cromwell/connector.h"
+#include "cromwell/event_loop.h"
+#include "examples/cdns/resolver.h"
+
+using namespace cromwell;
+
+namespace {
+
+const int kPort = 19580;
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  EventLoop loop;
+  cdns::Resolver resolver(loop);
+  int first = 1;
+  if (argc > 2 && strcmp(argv[1], "-s") == 0) {
+    if (!resolver.SetServers(argv[2])) {
+      fprintf(stderr, "bad servers: %s\n", argv[2]);
+      return 1;
+    }
+    first = 3;
+  }
+  if (first >= argc) {
+    fprintf(stderr, "usage: %s [-s ip[:port],...] host...\n", argv[0]);
+    return 1;
+  }
+
+  int ticks = 0;
+  loop.RunEvery(0.001, [&ticks]() { ++ticks; });
+  int waiting = 0;
+  long long start = loop.Now();
+  for (int round = 0; round < 2; ++round) {
+    for (int i = first; i < argc; ++i) {
+      ++waiting;
+      std::string host(argv[i]);
+      resolver.Resolve(argv[i], [&, host, round](const char* ip) {
+        printf("%s %s -> %s after %.3fms\n", round == 0 ? "first" : "again",
+            host.c_str(), ip ? ip : "(failed)", static_cast<double>(loop.Now() - start) / 1e6);
+        --waiting;
+      });
+    }
+  }
+
+  // A connector given the host name.
+  Acceptor acceptor(loop, "0.0.0.0", kPort, false);
+  acceptor.SetNewConnectionCallback([](EventLoop& l, int fd, const char* ip, int port) { close(fd); });
+  bool connected = false;
+  std::shared_ptr<Connector> connector;
+  if (acceptor.Listen()) {
+    connector = std::make_shared<Connector>(loop, argv[first], kPort);
+    connector->SetResolver(&resolver);
+    connector->SetNewConnectionCallback([&connected](int fd) {
+      connected = true;
+      close(fd);
+    });
+    connector->Start();
+  }
+
+  loop.RunEvery(0.01, [&]() {
+    if (waiting == 0 && (!connector || connected)) loop.Quit();
+  });
+  loop.RunAfter(10, [&loop]() { loop.Quit(); });
+  loop.Loop();
+
+  printf("connector to %s:%d %s\n", argv[first], kPort, connected ? "connected" : "did not connect");
+  printf("queries=%lld cache_hits=%lld loop ticks meanwhile=%d\n",
+      resolver.Queries(), resolver.CacheHits(), ticks);
+  if (connector) {
+    connector->Stop();
+    loop.RunAfter(0.01, [&loop]() { loop.Quit(); });
+    loop.Loop();
+  }
+  return 0;
+}
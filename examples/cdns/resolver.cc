@@ -0,0 +1,201 @@
+#include "resolver.h"
+
+#include <string.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include <ares.h>
+
+#include <stdexcept>
+
+#include "cromwell/channel.h"
+
+using namespace cromwell;
+
+namespace cdns {
+
+// One lookup in flight and everybody waiting for it.
+struct Resolver::Query {
+  Resolver* owner;
+  std::string host;
+  std::vector<Callback> waiters;
+};
+
+namespace {
+
+// Once per process, the first resolver does it.
+struct LibraryInit {
+  LibraryInit() { ares_library_init(ARES_LIB_INIT_ALL); }
+};
+
+}  // namespace
+
+Resolver::Resolver(EventLoop& loop, Option opt)
+  : loop_(loop),
+  ctx_(nullptr),
+  min_ttl_(1),
+  max_ttl_(300),
+  cache_hits_(0),
+  queries_(0),
+  timer_(-1) {
+  static LibraryInit init;
+  struct ares_options options;
+  memset(&options, 0, sizeof(options));
+  int optmask = ARES_OPT_FLAGS | ARES_OPT_SOCK_STATE_CB;
+  options.flags = ARES_FLAG_STAYOPEN;
+  options.sock_state_cb = OnSockState;
+  options.sock_state_cb_data = this;
+  if (opt == kDnsOnly) {
+    optmask |= ARES_OPT_LOOKUPS;
+    options.lookups = const_cast<char*>("b");
+  }
+  int status = ares_init_options(&ctx_, &options, optmask);
+  if (status != ARES_SUCCESS) {
+    throw std::runtime_error(std::string("ares_init_options: ") + ares_strerror(status));
+  }
+}
+
+Resolver::~Resolver() {
+  // Fails what is pending, without callbacks, and closes the sockets.
+  ares_destroy(ctx_);
+  if (timer_ != -1) loop_.Cancel(timer_);
+  channels_.clear();
+  closed_.clear();
+}
+
+bool Resolver::SetServers(const char* servers) {
+  return ares_set_servers_ports_csv(ctx_, servers) == ARES_SUCCESS;
+}
+
+void Resolver::Resolve(const char* host, const Callback& cb) {
+  loop_.AssertInLoopThread();
+  closed_.clear();
+  std::string name(host);
+  std::unordered_map<std::string, Entry>::iterator it = cache_.find(name);
+  if (it != cache_.end()) {
+    if (loop_.Now() < it->second.expire) {
+      ++cache_hits_;
+      cb(it->second.ip.c_str());
+      return;
+    }
+    cache_.erase(it);
+  }
+
+  std::unordered_map<std::string, Query*>::iterator q = pending_.find(name);
+  if (q != pending_.end()) {
+    q->second->waiters.push_back(cb);
+    return;
+  }
+  Query* query = new Query();
+  query->owner = this;
+  query->host = name;
+  query->waiters.push_back(cb);
+  pending_[name] = query;
+  ++queries_;
+
+  struct ares_addrinfo_hints hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = ARES_AI_NOSORT;
+  // May answer at once, from the hosts file.
+  ares_getaddrinfo(ctx_, query->host.c_str(), nullptr, &hints, OnAddrInfo, query);
+  ScheduleTimeout();
+}
+
+void Resolver::OnAddrInfo(void* arg, int status, int timeouts, struct ares_addrinfo* result) {
+  Query* query = static_cast<Query*>(arg);
+  if (status == ARES_EDESTRUCTION) {
+    delete query;
+  } else {
+    query->owner->Answer(query, status, result);
+  }
+  if (result) ares_freeaddrinfo(result);
+}
+
+void Resolver::Answer(Query* query, int status, struct ares_addrinfo* result) {
+  char ip[INET6_ADDRSTRLEN];
+  int ttl = 0;
+  bool found = false;
+  if (status == ARES_SUCCESS && result) {
+    // The first IPv4 address, the first one at all if there is none.
+    struct ares_addrinfo_node* pick = nullptr;
+    for (struct ares_addrinfo_node* node = result->nodes; node; node = node->ai_next) {
+      if (!pick || (node->ai_family == AF_INET && pick->ai_family != AF_INET)) pick = node;
+    }//end-for.
+    if (pick && pick->ai_family == AF_INET) {
+      const struct sockaddr_in* sa = reinterpret_cast<const struct sockaddr_in*>(pick->ai_addr);
+      found = inet_ntop(AF_INET, &sa->sin_addr, ip, sizeof(ip)) != nullptr;
+    } else if (pick && pick->ai_family == AF_INET6) {
+      const struct sockaddr_in6* sa = reinterpret_cast<const struct sockaddr_in6*>(pick->ai_addr);
+      found = inet_ntop(AF_INET6, &sa->sin6_addr, ip, sizeof(ip)) != nullptr;
+    }
+    if (pick) ttl = pick->ai_ttl;
+  }
+
+  if (found && max_ttl_ > 0) {
+    if (ttl < min_ttl_) ttl = min_ttl_;
+    if (ttl > max_ttl_) ttl = max_ttl_;
+    Entry& entry = cache_[query->host];
+    entry.ip = ip;
+    entry.expire = loop_.Now() + ttl * 1000000000LL;
+  }
+
+  pending_.erase(query->host);
+  for (size_t i = 0; i < query->waiters.size(); ++i) {
+    query->waiters[i](found ? ip : nullptr);
+  }
+  delete query;
+}
+
+void Resolver::OnSockState(void* data, int fd, int readable, int writable) {
+  static_cast<Resolver*>(data)->Watch(fd, readable != 0, writable != 0);
+}
+
+void Resolver::Watch(int fd, bool readable, bool writable) {
+  std::map<int, std::unique_ptr<Channel> >::iterator it = channels_.find(fd);
+  if (!readable && !writable) {
+    if (it == channels_.end()) return;
+    it->second->DisableAll();
+    it->second->Remove();
+    closed_.push_back(std::move(it->second));
+    channels_.erase(it);
+    return;
+  }
+  if (it == channels_.end()) {
+    std::unique_ptr<Channel> channel(new Channel(loop_, fd));
+    channel->SetReadCallback([this, fd](long long receive_time) { Process(fd, ARES_SOCKET_BAD); });
+    channel->SetWriteCallback([this, fd]() { Process(ARES_SOCKET_BAD, fd); });
+    it = channels_.insert(std::make_pair(fd, std::move(channel))).first;
+  }
+  Channel* channel = it->second.get();
+  if (readable != channel->IsReading()) {
+    if (readable) channel->EnableReading(); else channel->DisableReading();
+  }
+  if (writable != channel->IsWriting()) {
+    if (writable) channel->EnableWriting(); else channel->DisableWriting();
+  }
+}
+
+void Resolver::Process(int readfd, int writefd) {
+  ares_process_fd(ctx_, readfd, writefd);
+  ScheduleTimeout();
+}
+
+// One loop timer for the earliest c-ares timeout, while queries run.
+void Resolver::ScheduleTimeout() {
+  if (timer_ != -1) {
+    loop_.Cancel(timer_);
+    timer_ = -1;
+  }
+  struct timeval tv;
+  if (!ares_timeout(ctx_, nullptr, &tv)) return;
+  double seconds = static_cast<double>(tv.tv_sec) + static_cast<double>(tv.tv_usec) / 1e6;
+  timer_ = loop_.RunAfter(seconds, [this]() {
+    timer_ = -1;
+    Process(ARES_SOCKET_BAD, ARES_SOCKET_BAD);
+  });
+}
+
+}//end-cdns.
@@ -0,0 +1,88 @@
+#ifndef __CDNS_RESOLVER_H
+#define __CDNS_RESOLVER_H
+
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "cromwell/async_resolver.h"
+#include "cromwell/event_loop.h"
+#include "cromwell/noncopyable.h"
+
+struct ares_addrinfo;
+struct ares_channeldata;
+
+namespace cromwell {
+class Channel;
+}
+
+namespace cdns {
+
+// Host names resolved by c-ares inside the loop: its sockets are watched
+// as channels of the loop and its timeouts run as loop timers, so a slow
+// lookup holds up nothing but the connections waiting for it. Answers
+// are cached for their TTL, kept between SetTtlBounds, and concurrent
+// lookups of one name share a query. The hosts file is read first unless
+// the resolver is DNS only, so names in /etc/hosts resolve offline.
+//
+// One per loop, loop thread only. Prefers IPv4 addresses.
+class Resolver : public cromwell::AsyncResolver, cromwell::noncopyable {
+public:
+  enum Option {
+    kDnsAndHostsFile,
+    kDnsOnly,
+  };
+
+  explicit Resolver(cromwell::EventLoop& loop, Option opt = kDnsAndHostsFile);
+  ~Resolver();
+
+  // Ask these name servers instead of those in /etc/resolv.conf, as
+  // "ip[:port],...", e.g. a stub resolver on 127.0.0.1:5353.
+  bool SetServers(const char* servers);
+  // Cache answers for at least min and at most max seconds, 1 and 300 by
+  // default; 0 and 0 turns the cache off.
+  void SetTtlBounds(int min_seconds, int max_seconds) {
+    min_ttl_ = min_seconds;
+    max_ttl_ = max_seconds;
+  }
+
+  void Resolve(const char* host, const Callback& cb);
+
+  // Lookups answered from the cache, and queries sent.
+  long long CacheHits() const { return cache_hits_; }
+  long long Queries() const { return queries_; }
+
+private:
+  struct Query;
+  struct Entry {
+    std::string ip;
+    long long expire; // loop time
+  };
+
+  static void OnSockState(void* data, int fd, int readable, int writable);
+  static void OnAddrInfo(void* arg, int status, int timeouts, struct ares_addrinfo* result);
+  void Watch(int fd, bool readable, bool writable);
+  void Answer(Query* query, int status, struct ares_addrinfo* result);
+  void Process(int readfd, int writefd);
+  void ScheduleTimeout();
+
+private:
+  cromwell::EventLoop& loop_;
+  struct ares_channeldata* ctx_;
+  int min_ttl_;
+  int max_ttl_;
+  long long cache_hits_;
+  long long queries_;
+  cromwell::EventLoop::TimerId timer_;
+  std::map<int, std::unique_ptr<cromwell::Channel> > channels_;
+  // Channels c-ares closed while one of them ran, freed later.
+  std::vector<std::unique_ptr<cromwell::Channel> > closed_;
+  std::unordered_map<std::string, Entry> cache_;
+  std::unordered_map<std::string, Query*> pending_;
+};
+
+}//end-cdns.
+
+#endif
@@ -0,0 +1,97 @@
+// Connection handle benchmark.
+//
+// N connections live in a ConnectionPool, and half of them are removed
+// again. Late events, like a timer firing or a worker reply arriving,
+// then look up random connections: through a pool handle, or through a
+// weak_ptr to a shared_ptr owned object of the same size, the pattern
+// the handles replace. A stale handle or expired weak_ptr finds nothing.
+// Reports nanoseconds per lookup and the hits.
+//
+//   connection_handle_bench [connections] [lookups]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <memory>
+#include <vector>
+
+#include "cromwell/connection_pool.h"
+#include "cromwell/event_loop.h"
+#include "cromwell/tcp_connection.h"
+
+using namespace cromwell;
+
+namespace {
+
+struct Object {
+  char bytes[sizeof(TcpConnection)];
+};
+
+long long NowNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// xorshift, cheap enough not to show up next to a lookup.
+uint32_t Next(uint64_t* state) {
+  uint64_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  *state = x;
+  return static_cast<uint32_t>(x >> 32);
+}
+
+void Report(const char* name, long long ns, long long lookups, long long hits) {
+  printf("%-8s %.1f ns/lookup hits=%lld/%lld\n", name,
+      static_cast<double>(ns) / static_cast<double>(lookups), hits, lookups);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  uint32_t count = argc > 1 ? static_cast<uint32_t>(atol(argv[1])) : 500000;
+  long long lookups = argc > 2 ? atoll(argv[2]) : 20000000;
+  if (count < 2) count = 2;
+
+  EventLoop loop;
+  ConnectionPool pool(loop, count);
+  std::vector<ConnectionPool::Handle> handles;
+  std::vector<std::shared_ptr<Object> > objects;
+  std::vector<std::weak_ptr<Object> > weaks;
+  for (uint32_t i = 0; i < count; ++i) {
+    // Never connected: only the lookup is measured.
+    TcpConnection* conn = pool.New(-1, "bench", 0);
+    handles.push_back(conn->Handle());
+    objects.push_back(std::make_shared<Object>());
+    weaks.push_back(objects.back());
+  }
+  for (uint32_t i = 0; i < count; i += 2) {
+    pool.Remove(pool.Find(handles[i]));
+    objects[i].reset();
+  }
+
+  uint64_t rng = 88172645463325252ULL;
+  long long hits = 0;
+  long long start = NowNs();
+  for (long long i = 0; i < lookups; ++i) {
+    if (pool.Find(handles[Next(&rng) % count])) ++hits;
+  }
+  Report("handle", NowNs() - start, lookups, hits);
+
+  rng = 88172645463325252ULL;
+  hits = 0;
+  start = NowNs();
+  for (long long i = 0; i < lookups; ++i) {
+    std::shared_ptr<Object> obj = weaks[Next(&rng) % count].lock();
+    if (obj) ++hits;
+  }
+  Report("weak_ptr", NowNs() - start, lookups, hits);
+
+  printf("connections=%u pool=%u live, %zu bytes per connection\n",
+      count, pool.Size(), sizeof(TcpConnection));
+  for (uint32_t i = 1; i < count; i += 2) pool.Remove(pool.Find(handles[i]));
+  return 0;
+}
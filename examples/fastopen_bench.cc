@@ -0,0 +1,177 @@
+// TCP Fast Open and deferred accept benchmark.
+//
+// One short request per connection over loopback, one connection after
+// the other: connect, send 64 bytes, wait for the first byte of the echo,
+// close. Reports the latency from the start of the connect to that first
+// byte, how many accepts found the request already there, and how many
+// requests rode in the SYN. Modes: a plain listener, one with
+// TCP_DEFER_ACCEPT, and fast open on both sides plus deferred accept. Fast
+// open needs net.ipv4.tcp_fastopen=3; with 1, the default, the server
+// ignores it.
+//
+//   fastopen_bench [connections] [port]
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "cromwell/acceptor.h"
+#include "cromwell/connector.h"
+#include "cromwell/event_loop.h"
+#include "cromwell/se.h"
+#include "cromwell/tcp_connection.h"
+
+using namespace cromwell;
+
+namespace {
+
+const size_t kRequestSize = 64;
+
+long long NowNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+long long ready_at_accept = 0;
+
+void OnEcho(SeEventLoop* loop, int fd, void* client, int mask) {
+  char buf[4096];
+  ssize_t n = read(fd, buf, sizeof(buf));
+  if (n > 0) {
+    if (write(fd, buf, static_cast<size_t>(n)) != n) perror("echo write");
+  } else if (n == 0 || errno != EAGAIN) {
+    SeDeleteFileEvent(loop, fd, SE_READABLE);
+    close(fd);
+  }
+}
+
+// Answers at once when the request came with the connection.
+void OnServerConnection(EventLoop& loop, int fd, const char* ip, int port) {
+  char buf[4096];
+  ssize_t n = read(fd, buf, sizeof(buf));
+  if (n > 0) {
+    ++ready_at_accept;
+    if (write(fd, buf, static_cast<size_t>(n)) != n) perror("echo write");
+  }
+  if (n == 0 || SeCreateFileEvent(loop.se_loop(), fd, SE_READABLE, OnEcho, NULL) == SE_ERR) {
+    close(fd);
+  }
+}
+
+bool SynData(int fd) {
+  struct tcp_info info;
+  socklen_t len = sizeof(info);
+  if (getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &len) == -1) return false;
+  return (info.tcpi_options & TCPI_OPT_SYN_DATA) != 0;
+}
+
+struct Run {
+  EventLoop* loop;
+  int port;
+  bool fastopen;
+  int left;
+  long long start;
+  long long syn_data;
+  std::vector<long long> latencies;
+  std::shared_ptr<Connector> connector;
+  TcpConnectionPtr conn;
+};
+
+void Next(Run* run) {
+  if (run->left-- == 0) {
+    run->loop->Quit();
+    return;
+  }
+  run->start = NowNs();
+  run->connector = std::make_shared<Connector>(*run->loop, "127.0.0.1", run->port);
+  run->connector->SetFastOpen(run->fastopen);
+  run->connector->SetNewConnectionCallback([run](int sockfd) {
+    run->conn.Reset(new TcpConnection(*run->loop, sockfd, "127.0.0.1", run->port));
+    run->conn->SetTcpNoDelay(true);
+    run->conn->SetMessageCallback([run](TcpConnection* c, FastBuffer* buf, long long receive_time) {
+      run->latencies.push_back(NowNs() - run->start);
+      if (SynData(c->fd())) ++run->syn_data;
+      buf->DrainReading(buf->GetReadingSize());
+      c->ForceClose();
+    });
+    run->conn->SetCloseCallback([run](const TcpConnectionPtr& c) {
+      c->ConnectDestroyed();
+      TcpConnectionPtr keep = run->conn;
+      run->loop->QueueInLoop([keep]() {});
+      run->conn.Reset();
+      Next(run);
+    });
+    run->conn->ConnectEstablished();
+    // Goes out with the SYN when the connect was deferred.
+    char request[kRequestSize] = {0};
+    run->conn->Send(request, sizeof(request));
+  });
+  run->connector->Start();
+}
+
+void Measure(EventLoop& loop, const char* name, int port, bool fastopen, bool defer, int connections) {
+  Acceptor acceptor(loop, "127.0.0.1", port, false);
+  acceptor.SetNewConnectionCallback(OnServerConnection);
+  if (fastopen) acceptor.SetFastOpen(128);
+  if (defer) acceptor.SetDeferAccept(5);
+  if (!acceptor.Listen()) {
+    perror("listen");
+    return;
+  }
+  ready_at_accept = 0;
+  Run run;
+  run.loop = &loop;
+  run.port = port;
+  run.fastopen = fastopen;
+  run.left = connections;
+  run.syn_data = 0;
+  Next(&run);
+  loop.Loop();
+
+  std::vector<long long>& lat = run.latencies;
+  if (lat.empty()) return;
+  std::sort(lat.begin(), lat.end());
+  long long sum = 0;
+  for (size_t i = 0; i < lat.size(); ++i) sum += lat[i];
+  printf("%-10s avg %6.1fus p50 %6.1fus p99 %6.1fus  data at accept %lld/%zu  in SYN %lld\n",
+      name, static_cast<double>(sum) / static_cast<double>(lat.size()) / 1e3,
+      static_cast<double>(lat[lat.size() / 2]) / 1e3,
+      static_cast<double>(lat[lat.size() * 99 / 100]) / 1e3,
+      ready_at_accept, lat.size(), run.syn_data);
+  run.connector->Stop();
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  int connections = argc > 1 ? atoi(argv[1]) : 5000;
+  int port = argc > 2 ? atoi(argv[2]) : 19590;
+
+  FILE* f = fopen("/proc/sys/net/ipv4/tcp_fastopen", "r");
+  int sysctl = 0;
+  if (f) {
+    if (fscanf(f, "%d", &sysctl) != 1) sysctl = 0;
+    fclose(f);
+  }
+  if ((sysctl & 3) != 3) {
+    printf("net.ipv4.tcp_fastopen=%d, fast open needs 3\n", sysctl);
+  }
+
+  EventLoop loop;
+  Measure(loop, "plain", port, false, false, connections);
+  Measure(loop, "defer", port + 1, false, true, connections);
+  Measure(loop, "fastopen", port + 2, true, true, connections);
+  // Let the last connector finish.
+  loop.RunAfter(0.01, [&loop]() { loop.Quit(); });
+  loop.Loop();
+  return 0;
+}
@@ -0,0 +1,163 @@
+// Pipelined request benchmark for the end-of-iteration output flush.
+//
+// Clients on N socketpairs each send a batch of P small requests in one
+// write and wait for all P replies. The server answers every request on
+// its own, either with a write() per reply or with TcpConnection::Send,
+// which only queues the reply until the flush at the end of the loop
+// iteration. Reports replies per second and write syscalls per reply.
+//
+//   pipeline_bench [connections] [pipeline] [seconds]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <memory>
+#include <vector>
+
+#include "cromwell/event_loop.h"
+#include "cromwell/se.h"
+#include "cromwell/tcp_connection.h"
+
+using namespace cromwell;
+
+namespace {
+
+const size_t kMsgSize = 16;
+
+struct Stats {
+  long long replies;
+  long long writes;
+};
+
+struct Server {
+  int fd;
+  Stats* stats;
+};
+
+struct Client {
+  int fd;
+  int pipeline;
+  size_t pending; // reply bytes still expected
+  Stats* stats;
+};
+
+void SetNonBlock(int fd) {
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+void SendBatch(Client* c) {
+  char buf[kMsgSize * 1024];
+  size_t len = kMsgSize * static_cast<size_t>(c->pipeline);
+  memset(buf, 'q', len);
+  if (write(c->fd, buf, len) != static_cast<ssize_t>(len)) perror("client write");
+  c->pending = len;
+}
+
+void OnServer(SeEventLoop* loop, int fd, void* client, int mask) {
+  Server* s = static_cast<Server*>(client);
+  char buf[kMsgSize * 1024];
+  ssize_t n = read(fd, buf, sizeof(buf));
+  for (ssize_t off = 0; off + static_cast<ssize_t>(kMsgSize) <= n; off += kMsgSize) {
+    if (write(fd, buf + off, kMsgSize) < 0) perror("server write");
+    ++s->stats->writes;
+  }
+}
+
+// Every request answered with a Send of its own.
+void OnMessage(TcpConnection* conn, FastBuffer* buf, long long receive_time) {
+  while (buf->GetReadingSize() >= kMsgSize) {
+    conn->Send(buf->GetReading(), kMsgSize);
+    buf->DrainReading(kMsgSize);
+  }//end-while.
+}
+
+void OnClient(SeEventLoop* loop, int fd, void* client, int mask) {
+  Client* c = static_cast<Client*>(client);
+  char buf[kMsgSize * 1024];
+  ssize_t n = read(fd, buf, sizeof(buf));
+  if (n <= 0) return;
+  c->pending -= static_cast<size_t>(n);
+  if (c->pending == 0) {
+    c->stats->replies += c->pipeline;
+    SendBatch(c);
+  }
+}
+
+int OnDeadline(SeEventLoop* loop, long long id, void* client) {
+  SeStop(loop);
+  return SE_NOMORE;
+}
+
+void Run(bool coalesce, int conns, int pipeline, int seconds) {
+  EventLoop loop;
+  Stats stats = {0, 0};
+  std::vector<std::unique_ptr<Server> > servers;
+  std::vector<TcpConnectionPtr> connections;
+  std::vector<std::unique_ptr<Client> > clients;
+
+  for (int i = 0; i < conns; ++i) {
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+      perror("socketpair");
+      exit(1);
+    }
+    SetNonBlock(sv[0]);
+    SetNonBlock(sv[1]);
+    if (coalesce) {
+      TcpConnectionPtr conn(new TcpConnection(loop, sv[0], "", 0));
+      conn->SetMessageCallback(OnMessage);
+      conn->ConnectEstablished();
+      connections.push_back(conn);
+    } else {
+      Server* s = new Server;
+      s->fd = sv[0];
+      s->stats = &stats;
+      servers.push_back(std::unique_ptr<Server>(s));
+      SeCreateFileEvent(loop.se_loop(), sv[0], SE_READABLE, OnServer, s);
+    }
+
+    Client* c = new Client;
+    c->fd = sv[1];
+    c->pipeline = pipeline;
+    c->stats = &stats;
+    clients.push_back(std::unique_ptr<Client>(c));
+    SeCreateFileEvent(loop.se_loop(), sv[1], SE_READABLE, OnClient, c);
+    SendBatch(c);
+  }
+
+  SeCreateTimeEvent(loop.se_loop(), seconds * 1000LL, OnDeadline, NULL, NULL);
+  loop.Loop();
+
+  for (size_t i = 0; i < connections.size(); ++i) stats.writes += connections[i]->Writes();
+  printf("%-9s conns=%d pipeline=%d replies=%.0f/s writes/reply=%.3f\n",
+      coalesce ? "coalesced" : "direct", conns, pipeline,
+      static_cast<double>(stats.replies) / seconds,
+      stats.replies ? static_cast<double>(stats.writes) / static_cast<double>(stats.replies) : 0.0);
+
+  for (size_t i = 0; i < servers.size(); ++i) {
+    SeDeleteFileEvent(loop.se_loop(), servers[i]->fd, SE_READABLE);
+    close(servers[i]->fd);
+  }
+  for (size_t i = 0; i < connections.size(); ++i) connections[i]->ConnectDestroyed();
+  for (size_t i = 0; i < clients.size(); ++i) {
+    SeDeleteFileEvent(loop.se_loop(), clients[i]->fd, SE_READABLE);
+    close(clients[i]->fd);
+  }
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  int conns = argc > 1 ? atoi(argv[1]) : 50;
+  int pipeline = argc > 2 ? atoi(argv[2]) : 32;
+  int seconds = argc > 3 ? atoi(argv[3]) : 3;
+  if (pipeline < 1 || pipeline > 1024) pipeline = 32;
+
+  Run(false, conns, pipeline, seconds);
+  Run(true, conns, pipeline, seconds);
+  return 0;
+}
@@ -0,0 +1,124 @@
+// Multi-reactor echo benchmark for EventLoopThreadPool.
+//
+// One Acceptor on the main loop fans connections out to N worker loops
+// that echo whatever they read. C client threads each keep one blocking
+// connection busy with ping-pong for the given time. Run it with growing
+// worker counts to see throughput follow the number of cores.
+//
+//   pool_echo_bench [workers] [clients] [seconds] [port]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "cromwell/acceptor.h"
+#include "cromwell/event_loop.h"
+#include "cromwell/event_loop_thread_pool.h"
+#include "cromwell/se.h"
+
+using namespace cromwell;
+
+namespace {
+
+const size_t kMessageSize = 64;
+std::atomic<bool> g_running(true);
+
+void OnEcho(SeEventLoop* loop, int fd, void* client, int mask) {
+  char buf[4096];
+  ssize_t n = read(fd, buf, sizeof(buf));
+  if (n > 0) {
+    if (write(fd, buf, static_cast<size_t>(n)) != n) perror("echo write");
+  } else if (n == 0) {
+    SeDeleteFileEvent(loop, fd, SE_READABLE);
+    close(fd);
+  }
+}
+
+void OnConnection(EventLoop& loop, int fd, const char* ip, int port) {
+  if (SeCreateFileEvent(loop.se_loop(), fd, SE_READABLE, OnEcho, NULL) == SE_ERR) {
+    close(fd);
+  }
+}
+
+void Client(int port, long long* round_trips) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in sa;
+  sa.sin_family = AF_INET;
+  sa.sin_port = htons(static_cast<uint16_t>(port));
+  sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (connect(fd, reinterpret_cast<struct sockaddr*>(&sa), sizeof(sa)) < 0) {
+    perror("connect");
+    close(fd);
+    return;
+  }
+  // The server stops echoing once the main loop returns, do not hang.
+  struct timeval tv = {1, 0};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+  char buf[kMessageSize] = {0};
+  while (g_running) {
+    if (write(fd, buf, sizeof(buf)) != static_cast<ssize_t>(sizeof(buf))) break;
+    size_t got = 0;
+    while (got < sizeof(buf)) {
+      ssize_t n = read(fd, buf + got, sizeof(buf) - got);
+      if (n <= 0) break;
+      got += static_cast<size_t>(n);
+    }
+    if (got < sizeof(buf)) break;
+    ++*round_trips;
+  }
+  close(fd);
+}
+
+int OnDeadline(SeEventLoop* loop, long long id, void* client) {
+  SeStop(loop);
+  return SE_NOMORE;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  int workers = argc > 1 ? atoi(argv[1]) : 4;
+  int clients = argc > 2 ? atoi(argv[2]) : 32;
+  int seconds = argc > 3 ? atoi(argv[3]) : 5;
+  int port = argc > 4 ? atoi(argv[4]) : 19527;
+
+  EventLoop base_loop;
+  EventLoopThreadPool pool(base_loop, workers);
+  pool.SetStrategy(EventLoopThreadPool::kLeastLoad);
+  pool.Start();
+
+  Acceptor acceptor(base_loop, "127.0.0.1", port, false);
+  acceptor.SetWorkerPool(&pool);
+  acceptor.SetNewConnectionCallback(OnConnection);
+  if (!acceptor.Listen()) {
+    perror("listen");
+    return 1;
+  }
+
+  std::vector<long long> counts(static_cast<size_t>(clients), 0);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < clients; ++i) {
+    threads.push_back(std::thread(Client, port, &counts[static_cast<size_t>(i)]));
+  }
+
+  SeCreateTimeEvent(base_loop.se_loop(), seconds * 1000LL, OnDeadline, NULL, NULL);
+  base_loop.Loop();
+  g_running = false;
+  for (size_t i = 0; i < threads.size(); ++i) threads[i].join();
+  pool.Stop();
+
+  long long total = 0;
+  for (size_t i = 0; i < counts.size(); ++i) total += counts[i];
+  printf("workers=%d clients=%d round_trips=%lld rate=%.0f/s\n",
+      workers, clients, total, static_cast<double>(total) / seconds);
+  return 0;
+}
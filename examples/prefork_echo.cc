@@ -0,0 +1,238 @@
+// Prefork echo server.
+//
+// The master forks W workers pinned to cpus 0..W-1, then passes each one
+// the listening socket over SCM_RIGHTS so every worker accepts for itself,
+// or with -a accepts alone and passes every connection on, round robin.
+//
+// With -u the master also listens on a unix path for its successor. A new
+// binary started with -i -u on the same path connects there, inherits the
+// listener and starts its workers on it; the old master then stops
+// accepting, and its workers exit once their last connection closed.
+// Connections waiting in the accept queue are the new workers' to take,
+// so an upgrade drops none.
+//
+//   prefork_echo [-w workers] [-a] [-u path [-i]] port
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <memory>
+#include <vector>
+
+#include "cromwell/acceptor.h"
+#include "cromwell/connector.h"
+#include "cromwell/event_loop.h"
+#include "cromwell/fd_channel.h"
+#include "cromwell/prefork.h"
+#include "cromwell/se.h"
+#include "cromwell/socket_opt.h"
+
+using namespace cromwell;
+
+namespace {
+
+// One per worker process.
+struct Worker {
+  EventLoop* loop;
+  std::unique_ptr<Acceptor> acceptor;
+  int connections;
+  long long served;
+  bool stopping;
+};
+
+Worker worker;
+
+void OnEcho(SeEventLoop* loop, int fd, void* client, int mask) {
+  char buf[4096];
+  ssize_t n = read(fd, buf, sizeof(buf));
+  if (n > 0) {
+    if (write(fd, buf, static_cast<size_t>(n)) != n) perror("echo write");
+    return;
+  }
+  if (n < 0 && errno == EAGAIN) return;
+  SeDeleteFileEvent(loop, fd, SE_READABLE);
+  close(fd);
+  if (--worker.connections == 0 && worker.stopping) worker.loop->Quit();
+}
+
+void Serve(EventLoop& loop, int fd, const char* ip, int port) {
+  nonblock(nullptr, fd);
+  if (SeCreateFileEvent(loop.se_loop(), fd, SE_READABLE, OnEcho, NULL) == SE_ERR) {
+    close(fd);
+    return;
+  }
+  ++worker.connections;
+  ++worker.served;
+}
+
+void Stop() {
+  worker.stopping = true;
+  worker.acceptor.reset();
+  if (worker.connections == 0) worker.loop->Quit();
+}
+
+int WorkerMain(int index, int sockfd) {
+  EventLoop loop;
+  worker.loop = &loop;
+  worker.connections = 0;
+  worker.served = 0;
+  worker.stopping = false;
+  FdChannel master(loop, sockfd);
+  master.SetFdCallback([&loop](int fd, const char* tag) {
+    if (strcmp(tag, "listener") == 0 && !worker.acceptor && !worker.stopping) {
+      worker.acceptor.reset(new Acceptor(loop, nullptr, 0, false));
+      worker.acceptor->SetListenFd(fd);
+      worker.acceptor->SetNewConnectionCallback(Serve);
+      if (!worker.acceptor->Listen()) perror("listen");
+    } else if (strcmp(tag, "conn") == 0 && fd >= 0) {
+      Serve(loop, fd, "", 0);
+    } else if (strcmp(tag, "stop") == 0) {
+      Stop();
+    } else if (fd >= 0) {
+      close(fd);
+    }
+  });
+  // The master is gone.
+  master.SetCloseCallback([]() { if (!worker.stopping) Stop(); });
+  master.Start();
+  loop.Loop();
+  printf("worker %d (pid %d) served %lld connections\n", index, getpid(), worker.served);
+  worker.acceptor.reset();
+  return 0;
+}
+
+// The listener of the instance running at path, -1 if there is none.
+int Inherit(const char* path) {
+  EventLoop loop;
+  int listen_fd = -1;
+  std::unique_ptr<FdChannel> channel;
+  std::shared_ptr<Connector> connector = std::make_shared<Connector>(loop, path);
+  connector->SetNewConnectionCallback([&](int sockfd) {
+    channel.reset(new FdChannel(loop, sockfd));
+    channel->SetFdCallback([&](int fd, const char* tag) {
+      if (strcmp(tag, "listener") == 0 && listen_fd < 0) {
+        listen_fd = fd;
+      } else {
+        if (fd >= 0) close(fd);
+        if (strcmp(tag, "end") == 0) loop.Quit();
+      }
+    });
+    channel->SetCloseCallback([&loop]() { loop.Quit(); });
+    channel->Start();
+  });
+  connector->Start();
+  loop.RunAfter(5, [&loop]() { loop.Quit(); });
+  loop.Loop();
+  connector->Stop();
+  loop.RunAfter(0.01, [&loop]() { loop.Quit(); });
+  loop.Loop();
+  return listen_fd;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  int workers = 2;
+  bool master_accepts = false;
+  const char* upgrade_path = nullptr;
+  bool inherit = false;
+  int opt;
+  while ((opt = getopt(argc, argv, "w:au:i")) != -1) {
+    switch (opt) {
+    case 'w': workers = atoi(optarg); break;
+    case 'a': master_accepts = true; break;
+    case 'u': upgrade_path = optarg; break;
+    case 'i': inherit = true; break;
+    default:
+      fprintf(stderr, "usage: %s [-w workers] [-a] [-u path [-i]] port\n", argv[0]);
+      return 1;
+    }
+  }
+  int port = optind < argc ? atoi(argv[optind]) : 19600;
+
+  // Workers first, so they hold no copy of anything the master opens.
+  Prefork prefork(workers);
+  prefork.SetFirstCpu(0);
+  if (!prefork.Start(WorkerMain)) {
+    perror("fork");
+    return 1;
+  }
+
+  int listen_fd;
+  if (inherit && upgrade_path) {
+    listen_fd = Inherit(upgrade_path);
+    if (listen_fd < 0) fprintf(stderr, "nothing to inherit at %s\n", upgrade_path);
+  } else {
+    char err[SOCKET_ERR_LEN];
+    listen_fd = tcp_listen(err, "0.0.0.0", port, false);
+    if (listen_fd < 0) fprintf(stderr, "%s\n", err);
+  }
+  if (listen_fd < 0) return 1; // the workers follow when their channel closes
+
+  EventLoop loop;
+  std::vector<std::unique_ptr<FdChannel> > channels;
+  for (int i = 0; i < prefork.Workers(); ++i) {
+    channels.push_back(std::unique_ptr<FdChannel>(new FdChannel(loop, prefork.Fd(i))));
+    channels.back()->Start();
+  }//end-for.
+
+  std::unique_ptr<Acceptor> acceptor;
+  size_t next = 0;
+  if (master_accepts) {
+    acceptor.reset(new Acceptor(loop, nullptr, 0, false));
+    acceptor->SetListenFd(listen_fd);
+    listen_fd = -1;
+    acceptor->SetNewConnectionCallback([&](EventLoop& l, int fd, const char* ip, int p) {
+      channels[next++ % channels.size()]->Send(fd, "conn");
+      close(fd);
+    });
+    if (!acceptor->Listen()) {
+      perror("listen");
+      return 1;
+    }
+  } else {
+    for (size_t i = 0; i < channels.size(); ++i) channels[i]->Send(listen_fd, "listener");
+  }
+
+  // Hand the listener to a successor, then retire.
+  std::unique_ptr<Acceptor> upgrade;
+  std::unique_ptr<FdChannel> successor;
+  bool retiring = false;
+  if (upgrade_path) {
+    upgrade.reset(new Acceptor(loop, upgrade_path));
+    upgrade->SetNewConnectionCallback([&](EventLoop& l, int fd, const char* ip, int p) {
+      if (retiring) {
+        close(fd);
+        return;
+      }
+      retiring = true;
+      successor.reset(new FdChannel(loop, fd));
+      successor->Send(acceptor ? acceptor->ListenFd() : listen_fd, "listener");
+      successor->Send(-1, "end");
+      acceptor.reset();
+      for (size_t i = 0; i < channels.size(); ++i) channels[i]->Send(-1, "stop");
+      loop.RunEvery(0.05, [&]() {
+        if (prefork.Reap(false) == 0) loop.Quit();
+      });
+    });
+    if (!upgrade->Listen()) {
+      perror(upgrade_path);
+      return 1;
+    }
+  }
+
+  printf("master %d: %d workers on port %d%s\n", getpid(), prefork.Workers(), port,
+      master_accepts ? ", master accepts" : "");
+  fflush(stdout);
+  loop.Loop();
+  printf("master %d: handed over, workers done\n", getpid());
+
+  upgrade.reset();
+  successor.reset();
+  channels.clear();
+  if (listen_fd >= 0) close(listen_fd);
+  return 0;
+}
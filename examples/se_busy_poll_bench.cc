@@ -0,0 +1,105 @@
+// Busy-poll latency benchmark for SeSetBusyPoll.
+//
+// A client thread sends one byte over a socketpair and waits for the loop
+// thread to echo it, with a pause between round trips so the loop goes
+// idle. Reports round-trip latency (p50, p99) and where the loop spent
+// its waits, for busy polling off, fixed and adaptive. Needs two cpus to
+// mean anything: on one, the spinning loop competes with the client.
+//
+//   se_busy_poll_bench [busy_poll_us] [round_trips] [pause_us]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+#include "cromwell/se.h"
+
+using namespace cromwell;
+
+namespace {
+
+long long NowNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<long long>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+void OnReadable(SeEventLoop* loop, int fd, void* client, int mask) {
+  char buf[64];
+  ssize_t n = read(fd, buf, sizeof(buf));
+  if (n <= 0) {
+    SeDeleteFileEvent(loop, fd, SE_READABLE);
+    SeStop(loop);
+    return;
+  }
+  if (write(fd, buf, static_cast<size_t>(n)) != n) perror("write");
+}
+
+void Client(int fd, int round_trips, int pause_us, std::vector<long long>* rtt) {
+  char c = 'x';
+  for (int i = 0; i < round_trips; ++i) {
+    long long start = NowNs();
+    if (write(fd, &c, 1) != 1 || read(fd, &c, 1) != 1) break;
+    rtt->push_back(NowNs() - start);
+    if (pause_us > 0) usleep(static_cast<useconds_t>(pause_us));
+  }
+  shutdown(fd, SHUT_WR);
+}
+
+void Run(const char* name, long long busy_poll, int adaptive,
+    int round_trips, int pause_us) {
+  int sv[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == -1) {
+    perror("socketpair");
+    exit(1);
+  }
+  SeEventLoop* loop = SeCreateEventLoop(64);
+  if (!loop) {
+    fprintf(stderr, "cannot create loop\n");
+    exit(1);
+  }
+  SeSetBusyPoll(loop, busy_poll, adaptive);
+  SeCreateFileEvent(loop, sv[1], SE_READABLE, OnReadable, NULL);
+
+  std::vector<long long> rtt;
+  rtt.reserve(static_cast<size_t>(round_trips));
+  std::thread client(Client, sv[0], round_trips, pause_us, &rtt);
+  SeMain(loop);
+  client.join();
+
+  SePollStats stats;
+  SeGetPollStats(loop, &stats);
+  std::sort(rtt.begin(), rtt.end());
+  if (!rtt.empty()) {
+    printf("%-8s p50=%.1fus p99=%.1fus spin=%.1fms blocked=%.1fms "
+        "hits=%lld misses=%lld blocks=%lld budget=%lldus\n", name,
+        static_cast<double>(rtt[rtt.size() / 2]) / 1000.0,
+        static_cast<double>(rtt[rtt.size() * 99 / 100]) / 1000.0,
+        static_cast<double>(stats.spin_ns) / 1e6,
+        static_cast<double>(stats.blocked_ns) / 1e6,
+        stats.spin_hits, stats.spin_misses, stats.blocks,
+        stats.busy_poll / 1000);
+  }
+  SeDeleteEventLoop(loop);
+  close(sv[0]);
+  close(sv[1]);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  long long busy_poll = (argc > 1 ? atoll(argv[1]) : 50) * 1000LL;
+  int round_trips = argc > 2 ? atoi(argv[2]) : 20000;
+  int pause_us = argc > 3 ? atoi(argv[3]) : 20;
+
+  Run("off", 0, 0, round_trips, pause_us);
+  Run("fixed", busy_poll, 0, round_trips, pause_us);
+  Run("adaptive", busy_poll, 1, round_trips, pause_us);
+  return 0;
+}
@@ -0,0 +1,120 @@
+// Echo round-trip benchmark for the SE multiplexing layers.
+//
+// Opens N socketpairs inside one loop: one end echoes whatever it reads,
+// the other end counts the round trip and sends the next message. The same
+// run is repeated on the native layer (epoll) and on io_uring.
+//
+//   se_echo_bench [connections] [seconds] [message_size]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <vector>
+
+#include "cromwell/se.h"
+
+using namespace cromwell;
+
+namespace {
+
+struct Bench {
+  size_t msg_size;
+  long long round_trips;
+  std::vector<char> buf;
+};
+
+void SetNonBlock(int fd) {
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+void OnEcho(SeEventLoop* loop, int fd, void* client, int mask) {
+  Bench* bench = static_cast<Bench*>(client);
+  ssize_t n = read(fd, bench->buf.data(), bench->buf.size());
+  if (n > 0 && write(fd, bench->buf.data(), static_cast<size_t>(n)) != n) {
+    perror("echo write");
+  }
+}
+
+void OnReply(SeEventLoop* loop, int fd, void* client, int mask) {
+  Bench* bench = static_cast<Bench*>(client);
+  ssize_t n = read(fd, bench->buf.data(), bench->msg_size);
+  if (n <= 0) return;
+  ++bench->round_trips;
+  if (write(fd, bench->buf.data(), bench->msg_size) < 0 && errno != EAGAIN) {
+    perror("client write");
+  }
+}
+
+int OnDeadline(SeEventLoop* loop, long long id, void* client) {
+  SeStop(loop);
+  return SE_NOMORE;
+}
+
+void Run(const char* api, int conns, int seconds, size_t msg_size) {
+  SeEventLoop* loop = SeCreateEventLoopWithApi(conns * 2 + 64, api);
+  if (!loop) {
+    fprintf(stderr, "cannot create loop on %s\n", api ? api : "native");
+    return;
+  }
+
+  Bench bench;
+  bench.msg_size = msg_size;
+  bench.round_trips = 0;
+  bench.buf.resize(msg_size * 4);
+
+  std::vector<int> fds;
+  for (int i = 0; i < conns; ++i) {
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+      perror("socketpair");
+      break;
+    }
+    SetNonBlock(sv[0]);
+    SetNonBlock(sv[1]);
+    SeCreateFileEvent(loop, sv[0], SE_READABLE, OnEcho, &bench);
+    SeCreateFileEvent(loop, sv[1], SE_READABLE, OnReply, &bench);
+    if (write(sv[1], bench.buf.data(), msg_size) < 0) perror("write");
+    fds.push_back(sv[0]);
+    fds.push_back(sv[1]);
+  }
+
+  SeCreateTimeEvent(loop, seconds * 1000LL, OnDeadline, NULL, NULL);
+  SeMain(loop);
+
+  printf("%-10s conns=%d size=%zu round_trips=%lld rate=%.0f/s\n",
+      SeGetApiName(loop), conns, msg_size, bench.round_trips,
+      static_cast<double>(bench.round_trips) / seconds);
+
+  SeLoopMetrics m;
+  SeGetMetrics(loop, &m);
+  printf("%-10s iterations=%lld fired p50=%lld p99=%lld busy p99=%lldus "
+      "wait p99=%lldus callback max=%lldus\n", "",
+      m.iterations, SeHistogramPercentile(&m.fired, 50),
+      SeHistogramPercentile(&m.fired, 99),
+      SeHistogramPercentile(&m.busy_ns, 99) / 1000,
+      SeHistogramPercentile(&m.wait_ns, 99) / 1000,
+      m.callback_max_ns / 1000);
+
+  for (size_t i = 0; i < fds.size(); ++i) {
+    SeDeleteFileEvent(loop, fds[i], SE_READABLE);
+    close(fds[i]);
+  }
+  SeDeleteEventLoop(loop);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  int conns = argc > 1 ? atoi(argv[1]) : 1000;
+  int seconds = argc > 2 ? atoi(argv[2]) : 5;
+  size_t msg_size = argc > 3 ? static_cast<size_t>(atoi(argv[3])) : 64;
+
+  Run(NULL, conns, seconds, msg_size);
+  Run("io_uring", conns, seconds, msg_size);
+  return 0;
+}
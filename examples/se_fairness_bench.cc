@@ -0,0 +1,151 @@
+// Mixed-load fairness benchmark for SeSetFileEventClass/SeChargeFileEvent.
+//
+// One loop carries a few bulk socketpairs, whose writer keeps the pipe
+// full and whose reader checksums everything it gets, next to many small
+// ping-pong connections. Reports the ping-pong round-trip latency and the
+// bulk throughput, first in kernel order with unbounded reads, then with
+// the bulk readers in SE_PRIO_BULK under a per-dispatch byte budget.
+//
+//   se_fairness_bench [interactive] [bulk] [seconds] [budget_kb]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "cromwell/se.h"
+
+using namespace cromwell;
+
+namespace {
+
+const size_t kChunk = 16 * 1024;
+
+struct Bench {
+  long long bulk_bytes;
+  unsigned long long checksum;
+  std::vector<long long> rtt;
+  std::vector<char> buf;
+};
+
+long long NowNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<long long>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+void SetNonBlock(int fd) {
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+void OnBulkWritable(SeEventLoop* loop, int fd, void* client, int mask) {
+  Bench* bench = static_cast<Bench*>(client);
+  while (write(fd, bench->buf.data(), bench->buf.size()) > 0) {}
+}
+
+void OnBulkReadable(SeEventLoop* loop, int fd, void* client, int mask) {
+  Bench* bench = static_cast<Bench*>(client);
+  char buf[kChunk];
+  ssize_t n;
+  while ((n = read(fd, buf, sizeof(buf))) > 0) {
+    for (ssize_t i = 0; i < n; ++i) bench->checksum = bench->checksum * 31 + static_cast<unsigned char>(buf[i]);
+    bench->bulk_bytes += n;
+    if (SeChargeFileEvent(loop, fd, SE_READABLE, n)) break;
+  }
+}
+
+void OnEcho(SeEventLoop* loop, int fd, void* client, int mask) {
+  long long ts;
+  if (read(fd, &ts, sizeof(ts)) == sizeof(ts) && write(fd, &ts, sizeof(ts)) != sizeof(ts)) {
+    perror("echo write");
+  }
+}
+
+void OnReply(SeEventLoop* loop, int fd, void* client, int mask) {
+  Bench* bench = static_cast<Bench*>(client);
+  long long ts;
+  if (read(fd, &ts, sizeof(ts)) != sizeof(ts)) return;
+  bench->rtt.push_back(NowNs() - ts);
+  ts = NowNs();
+  if (write(fd, &ts, sizeof(ts)) != sizeof(ts)) perror("client write");
+}
+
+int OnDeadline(SeEventLoop* loop, long long id, void* client) {
+  SeStop(loop);
+  return SE_NOMORE;
+}
+
+void Run(const char* name, int interactive, int bulk, int seconds, long long budget) {
+  SeEventLoop* loop = SeCreateEventLoop(1024);
+  if (!loop) {
+    fprintf(stderr, "cannot create loop\n");
+    exit(1);
+  }
+  Bench bench;
+  bench.bulk_bytes = 0;
+  bench.checksum = 0;
+  bench.buf.assign(64 * 1024, 'b');
+
+  std::vector<int> fds;
+  for (int i = 0; i < bulk + interactive; ++i) {
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+      perror("socketpair");
+      exit(1);
+    }
+    SetNonBlock(sv[0]);
+    SetNonBlock(sv[1]);
+    fds.push_back(sv[0]);
+    fds.push_back(sv[1]);
+    if (i < bulk) {
+      int size = 4 * 1024 * 1024;
+      setsockopt(sv[1], SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+      setsockopt(sv[0], SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+      SeCreateFileEvent(loop, sv[1], SE_WRITABLE, OnBulkWritable, &bench);
+      SeCreateFileEvent(loop, sv[0], SE_READABLE, OnBulkReadable, &bench);
+      if (budget > 0) SeSetFileEventClass(loop, sv[0], SE_PRIO_BULK, budget);
+    } else {
+      long long ts = NowNs();
+      SeCreateFileEvent(loop, sv[0], SE_READABLE, OnEcho, &bench);
+      SeCreateFileEvent(loop, sv[1], SE_READABLE, OnReply, &bench);
+      if (write(sv[1], &ts, sizeof(ts)) != sizeof(ts)) perror("write");
+    }
+  }
+
+  SeCreateTimeEvent(loop, seconds * 1000LL, OnDeadline, NULL, NULL);
+  SeMain(loop);
+
+  std::vector<long long>& rtt = bench.rtt;
+  std::sort(rtt.begin(), rtt.end());
+  if (!rtt.empty()) {
+    printf("%-8s round_trips=%zu p50=%.0fus p99=%.0fus bulk=%.0fMB/s\n", name,
+        rtt.size(), static_cast<double>(rtt[rtt.size() / 2]) / 1000.0,
+        static_cast<double>(rtt[rtt.size() * 99 / 100]) / 1000.0,
+        static_cast<double>(bench.bulk_bytes) / seconds / 1e6);
+  }
+  for (size_t i = 0; i < fds.size(); ++i) {
+    SeDeleteFileEvent(loop, fds[i], SE_READABLE | SE_WRITABLE);
+    close(fds[i]);
+  }
+  SeDeleteEventLoop(loop);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  int interactive = argc > 1 ? atoi(argv[1]) : 100;
+  int bulk = argc > 2 ? atoi(argv[2]) : 2;
+  int seconds = argc > 3 ? atoi(argv[3]) : 3;
+  long long budget = (argc > 4 ? atoll(argv[4]) : 64) * 1024;
+
+  Run("fifo", interactive, bulk, seconds, 0);
+  Run("budget", interactive, bulk, seconds, budget);
+  return 0;
+}
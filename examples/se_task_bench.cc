@@ -0,0 +1,77 @@
+// Cross-thread task injection benchmark for SeQueueInLoop.
+//
+// P producer threads each post M tasks to one loop as fast as they can
+// while the loop runs them. Reports tasks per second and how many loop
+// wakeups it took to drain them, i.e. how well wakeups coalesce.
+//
+//   se_task_bench [producers] [tasks_per_producer]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <thread>
+#include <vector>
+
+#include "cromwell/se.h"
+
+using namespace cromwell;
+
+namespace {
+
+double Now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<double>(ts.tv_sec) + static_cast<double>(ts.tv_nsec) / 1e9;
+}
+
+void OnTask(SeEventLoop* loop, void* client) {
+  ++*static_cast<long long*>(client);
+}
+
+void Produce(SeEventLoop* loop, SeTask* tasks, int count) {
+  for (int i = 0; i < count; ++i) {
+    SeQueueInLoop(loop, &tasks[i]);
+  }
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  int producers = argc > 1 ? atoi(argv[1]) : 4;
+  int per_producer = argc > 2 ? atoi(argv[2]) : 1000000;
+  long long expected = static_cast<long long>(producers) * per_producer;
+  long long run = 0;
+  long long wakeups = 0;
+
+  SeEventLoop* loop = SeCreateEventLoop(64);
+  if (!loop) {
+    fprintf(stderr, "cannot create loop\n");
+    return 1;
+  }
+
+  // Tasks are preallocated so the producers measure the queue, not malloc.
+  std::vector<SeTask> tasks(static_cast<size_t>(expected));
+  for (size_t i = 0; i < tasks.size(); ++i) {
+    tasks[i].proc = OnTask;
+    tasks[i].client = &run;
+  }
+
+  double start = Now();
+  std::vector<std::thread> threads;
+  for (int i = 0; i < producers; ++i) {
+    threads.push_back(std::thread(Produce, loop,
+        &tasks[static_cast<size_t>(i) * per_producer], per_producer));
+  }
+  while (run < expected) {
+    SeProcessEvents(loop, SE_FILE_EVENTS);
+    ++wakeups;
+  }
+  double elapsed = Now() - start;
+  for (size_t i = 0; i < threads.size(); ++i) threads[i].join();
+
+  printf("producers=%d tasks=%lld wakeups=%lld rate=%.0f/s\n",
+      producers, run, wakeups, static_cast<double>(run) / elapsed);
+  SeDeleteEventLoop(loop);
+  return 0;
+}
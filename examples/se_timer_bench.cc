@@ -0,0 +1,88 @@
+// Timer accuracy benchmark for SeCreateTimeEventNs.
+//
+// A periodic timer fires every interval microseconds on an otherwise idle
+// loop. Reports how late it fired (average, p99, max) for a few timer
+// slack settings and the loop's multiplexing layer.
+//
+//   se_timer_bench [interval_us] [samples] [api]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "cromwell/se.h"
+
+using namespace cromwell;
+
+namespace {
+
+long long NowNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<long long>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+struct Probe {
+  long long interval;
+  long long deadline;
+  size_t samples;
+  std::vector<long long> late;
+};
+
+int OnTimer(SeEventLoop* loop, long long id, void* client) {
+  Probe* probe = static_cast<Probe*>(client);
+  probe->late.push_back(NowNs() - probe->deadline);
+  if (probe->late.size() == probe->samples) {
+    SeStop(loop);
+    return SE_NOMORE;
+  }
+  probe->deadline = SeGetLoopTime(loop) + probe->interval;
+  return static_cast<int>(probe->interval);
+}
+
+void Run(const char* api, long long slack, long long interval, size_t samples) {
+  SeEventLoop* loop = SeCreateEventLoopWithApi(64, api);
+  if (!loop) {
+    fprintf(stderr, "cannot create loop\n");
+    exit(1);
+  }
+  SeSetTimerSlack(loop, slack);
+
+  Probe probe;
+  probe.interval = interval;
+  probe.samples = samples;
+  probe.late.reserve(samples);
+  SeUpdateTime(loop);
+  probe.deadline = SeGetLoopTime(loop) + interval;
+  SeCreateTimeEventNs(loop, interval, OnTimer, &probe, NULL);
+  SeMain(loop);
+
+  std::vector<long long>& late = probe.late;
+  std::sort(late.begin(), late.end());
+  long long sum = 0;
+  for (size_t i = 0; i < late.size(); ++i) sum += late[i];
+  printf("api=%s slack=%lldus avg=%.1fus p99=%.1fus max=%.1fus\n",
+      SeGetApiName(loop), slack / 1000,
+      static_cast<double>(sum) / static_cast<double>(late.size()) / 1000.0,
+      static_cast<double>(late[late.size() * 99 / 100]) / 1000.0,
+      static_cast<double>(late.back()) / 1000.0);
+  SeDeleteEventLoop(loop);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  long long interval = (argc > 1 ? atoll(argv[1]) : 300) * 1000LL;
+  size_t samples = argc > 2 ? static_cast<size_t>(atol(argv[2])) : 2000;
+  const char* api = argc > 3 ? argv[3] : NULL;
+
+  // A slack of a millisecond makes epoll round up to whole milliseconds,
+  // i.e. the old behaviour.
+  const long long slacks[] = {1000000, 50000, 1000};
+  for (size_t i = 0; i < sizeof(slacks) / sizeof(slacks[0]); ++i)
+    Run(api, slacks[i], interval, samples);
+  return 0;
+}
@@ -0,0 +1,129 @@
+// File transmission benchmark.
+//
+// One connection serves a file of N megabytes over and over to a reader
+// that discards it, either by reading it in 256KB pieces and sending the
+// copies, or with SendFile. Reports throughput and the CPU time the
+// process spent per gigabyte, reader included.
+//
+//   sendfile_bench [megabytes] [seconds]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+
+#include <vector>
+
+#include "cromwell/event_loop.h"
+#include "cromwell/tcp_connection.h"
+
+using namespace cromwell;
+
+namespace {
+
+const size_t kPiece = 256 * 1024;
+
+struct Source {
+  int fd;
+  size_t size;
+  size_t offset;
+  bool zero_copy;
+  std::vector<char> piece;
+};
+
+double CpuSeconds() {
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+  return static_cast<double>(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) +
+    static_cast<double>(ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+}
+
+void SetNonBlock(int fd) {
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+// Queue the next piece of the file, from the start again at its end.
+void Feed(TcpConnection* conn, Source* src) {
+  if (src->offset == src->size) src->offset = 0;
+  size_t len = src->size - src->offset < kPiece ? src->size - src->offset : kPiece;
+  if (src->zero_copy) {
+    conn->SendFile(src->fd, static_cast<off_t>(src->offset), len);
+  } else {
+    ssize_t n = pread(src->fd, src->piece.data(), len, static_cast<off_t>(src->offset));
+    if (n <= 0) return;
+    len = static_cast<size_t>(n);
+    conn->Send(src->piece.data(), len);
+  }
+  src->offset += len;
+}
+
+void Run(bool zero_copy, int file_fd, size_t size, int seconds) {
+  EventLoop loop;
+  int sv[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+    perror("socketpair");
+    exit(1);
+  }
+  SetNonBlock(sv[0]);
+  SetNonBlock(sv[1]);
+  TcpConnectionPtr server(new TcpConnection(loop, sv[0], "server", 0));
+  TcpConnectionPtr client(new TcpConnection(loop, sv[1], "client", 0));
+
+  Source src;
+  src.fd = file_fd;
+  src.size = size;
+  src.offset = 0;
+  src.zero_copy = zero_copy;
+  src.piece.resize(kPiece);
+  long long received = 0;
+  server->SetWriteCompleteCallback([&src](TcpConnection* conn) { Feed(conn, &src); });
+  client->SetMessageCallback([&received](TcpConnection* conn, FastBuffer* buf, long long receive_time) {
+    received += static_cast<long long>(buf->GetReadingSize());
+    buf->DrainReading(buf->GetReadingSize());
+  });
+  server->ConnectEstablished();
+  client->ConnectEstablished();
+
+  double cpu = CpuSeconds();
+  Feed(server.get(), &src);
+  loop.RunAfter(seconds, [&loop]() { loop.Quit(); });
+  loop.Loop();
+  cpu = CpuSeconds() - cpu;
+
+  double gb = static_cast<double>(received) / 1e9;
+  printf("%-9s %.0fMB/s cpu=%.2fs/GB\n", zero_copy ? "sendfile" : "copy",
+      static_cast<double>(received) / seconds / 1e6, gb > 0 ? cpu / gb : 0.0);
+
+  server->ConnectDestroyed();
+  client->ConnectDestroyed();
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  size_t mb = argc > 1 ? static_cast<size_t>(atol(argv[1])) : 64;
+  int seconds = argc > 2 ? atoi(argv[2]) : 3;
+
+  char path[] = "/tmp/sendfile_bench.XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0) {
+    perror("mkstemp");
+    return 1;
+  }
+  unlink(path);
+  std::vector<char> block(1024 * 1024, 'f');
+  for (size_t i = 0; i < mb; ++i) {
+    if (write(fd, block.data(), block.size()) != static_cast<ssize_t>(block.size())) {
+      perror("write");
+      return 1;
+    }
+  }
+
+  Run(false, fd, mb * block.size(), seconds);
+  Run(true, fd, mb * block.size(), seconds);
+  close(fd);
+  return 0;
+}
@@ -0,0 +1,120 @@
+// TcpConnection echo benchmark.
+//
+// Busy pairs of TcpConnections on socketpairs echo bursts of B bytes: the
+// client side sends a burst and waits until all of it came back. Idle
+// pairs sit next to them and never send. Reports throughput, bytes per
+// readv and writev, and the input buffer memory held by the idle and the
+// busy connections at the end.
+//
+//   tcp_connection_bench [busy] [idle] [burst] [seconds]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <vector>
+
+#include "cromwell/event_loop.h"
+#include "cromwell/tcp_connection.h"
+
+using namespace cromwell;
+
+namespace {
+
+struct Burst {
+  std::vector<char> data;
+  size_t pending; // bytes of the burst still to come back
+  long long bytes;
+};
+
+void SetNonBlock(int fd) {
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+void OnEcho(TcpConnection* conn, FastBuffer* buf, long long receive_time) {
+  conn->Send(buf->GetReading(), buf->GetReadingSize());
+  buf->DrainReading(buf->GetReadingSize());
+}
+
+TcpConnectionPtr NewConnection(EventLoop& loop, int fd) {
+  SetNonBlock(fd);
+  TcpConnectionPtr conn(new TcpConnection(loop, fd, "socketpair", 0));
+  return conn;
+}
+
+size_t InputBytes(const std::vector<TcpConnectionPtr>& conns) {
+  size_t total = 0;
+  for (size_t i = 0; i < conns.size(); ++i) total += conns[i]->InputBuffer()->GetCapacity();
+  return total;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  int busy = argc > 1 ? atoi(argv[1]) : 16;
+  int idle = argc > 2 ? atoi(argv[2]) : 1000;
+  size_t burst = argc > 3 ? static_cast<size_t>(atol(argv[3])) : 256 * 1024;
+  int seconds = argc > 4 ? atoi(argv[4]) : 3;
+
+  EventLoop loop;
+  std::vector<TcpConnectionPtr> busy_conns, idle_conns;
+  std::vector<Burst> bursts(static_cast<size_t>(busy));
+
+  for (int i = 0; i < busy + idle; ++i) {
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+      perror("socketpair");
+      return 1;
+    }
+    TcpConnectionPtr server = NewConnection(loop, sv[0]);
+    TcpConnectionPtr client = NewConnection(loop, sv[1]);
+    server->SetMessageCallback(OnEcho);
+    if (i < busy) {
+      Burst* b = &bursts[static_cast<size_t>(i)];
+      b->data.assign(burst, 'b');
+      b->pending = burst;
+      b->bytes = 0;
+      client->SetMessageCallback([b](TcpConnection* conn, FastBuffer* buf, long long receive_time) {
+        size_t n = buf->GetReadingSize();
+        buf->DrainReading(n);
+        b->bytes += static_cast<long long>(n);
+        b->pending -= n < b->pending ? n : b->pending;
+        if (b->pending == 0) {
+          b->pending = b->data.size();
+          conn->Send(b->data.data(), b->data.size());
+        }
+      });
+      busy_conns.push_back(server);
+      busy_conns.push_back(client);
+    } else {
+      idle_conns.push_back(server);
+      idle_conns.push_back(client);
+    }
+    server->ConnectEstablished();
+    client->ConnectEstablished();
+    if (i < busy) client->Send(bursts[static_cast<size_t>(i)].data.data(), burst);
+  }
+
+  loop.RunAfter(seconds, [&loop]() { loop.Quit(); });
+  loop.Loop();
+
+  long long bytes = 0, reads = 0, writes = 0;
+  for (size_t i = 0; i < bursts.size(); ++i) bytes += bursts[i].bytes;
+  for (size_t i = 0; i < busy_conns.size(); ++i) {
+    reads += busy_conns[i]->Reads();
+    writes += busy_conns[i]->Writes();
+  }
+  // Every echoed byte is read twice and written twice.
+  printf("busy=%d idle=%d burst=%zu echo=%.1fMB/s bytes/readv=%.0f bytes/writev=%.0f\n",
+      busy, idle, burst, static_cast<double>(bytes) / seconds / 1e6,
+      reads ? 2.0 * static_cast<double>(bytes) / static_cast<double>(reads) : 0.0,
+      writes ? 2.0 * static_cast<double>(bytes) / static_cast<double>(writes) : 0.0);
+  printf("input buffers: idle=%zu bytes busy=%zu bytes\n",
+      InputBytes(idle_conns), InputBytes(busy_conns));
+
+  for (size_t i = 0; i < busy_conns.size(); ++i) busy_conns[i]->ConnectDestroyed();
+  for (size_t i = 0; i < idle_conns.size(); ++i) idle_conns[i]->ConnectDestroyed();
+  return 0;
+}
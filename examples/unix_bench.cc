@@ -0,0 +1,130 @@
+// Unix domain socket benchmark.
+//
+// C connections from a client to an echo server on one loop, first over
+// loopback TCP, then over an AF_UNIX socket, both through Acceptor,
+// Connector and TcpConnection. Every connection keeps D messages of 64
+// bytes in flight and sends the next one for every echo. Reports messages
+// per second: local traffic over a unix socket skips the TCP stack.
+//
+//   unix_bench [connections] [depth] [seconds] [port]
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <memory>
+#include <vector>
+
+#include "cromwell/acceptor.h"
+#include "cromwell/connector.h"
+#include "cromwell/event_loop.h"
+#include "cromwell/se.h"
+#include "cromwell/tcp_connection.h"
+
+using namespace cromwell;
+
+namespace {
+
+const size_t kMsgSize = 64;
+const char kPath[] = "@cromwell-unix-bench";
+
+void OnEcho(SeEventLoop* loop, int fd, void* client, int mask) {
+  char buf[16384];
+  ssize_t n = read(fd, buf, sizeof(buf));
+  if (n > 0) {
+    if (write(fd, buf, static_cast<size_t>(n)) != n) perror("echo write");
+  } else if (n == 0 || errno != EAGAIN) {
+    SeDeleteFileEvent(loop, fd, SE_READABLE);
+    close(fd);
+  }
+}
+
+void OnServerConnection(EventLoop& loop, int fd, const char* ip, int port) {
+  if (SeCreateFileEvent(loop.se_loop(), fd, SE_READABLE, OnEcho, NULL) == SE_ERR) {
+    close(fd);
+  }
+}
+
+struct Client {
+  std::shared_ptr<Connector> connector;
+  TcpConnectionPtr conn;
+};
+
+void Measure(EventLoop& loop, const char* name, bool unix_socket, int connections, int depth,
+    int seconds, int port) {
+  std::unique_ptr<Acceptor> acceptor(unix_socket ? new Acceptor(loop, kPath)
+      : new Acceptor(loop, "127.0.0.1", port, false));
+  acceptor->SetNewConnectionCallback(OnServerConnection);
+  if (!acceptor->Listen()) {
+    perror("listen");
+    return;
+  }
+
+  long long done = 0;
+  int connected = 0;
+  std::vector<std::unique_ptr<Client> > clients;
+  for (int i = 0; i < connections; ++i) {
+    std::unique_ptr<Client> client(new Client());
+    Client* c = client.get();
+    c->connector = unix_socket ? std::make_shared<Connector>(loop, kPath)
+        : std::make_shared<Connector>(loop, "127.0.0.1", port);
+    c->connector->SetNewConnectionCallback([&, c](int sockfd) {
+      c->conn.Reset(new TcpConnection(loop, sockfd, "", 0));
+      if (!unix_socket) c->conn->SetTcpNoDelay(true);
+      c->conn->SetMessageCallback([&done](TcpConnection* conn, FastBuffer* buf, long long receive_time) {
+        size_t n = buf->GetReadingSize() / kMsgSize;
+        buf->DrainReading(n * kMsgSize);
+        done += static_cast<long long>(n);
+        char msg[kMsgSize * 64] = {0};
+        while (n > 0) {
+          size_t batch = n < 64 ? n : 64;
+          conn->Send(msg, batch * kMsgSize);
+          n -= batch;
+        }
+      });
+      c->conn->ConnectEstablished();
+      ++connected;
+    });
+    c->connector->Start();
+    clients.push_back(std::move(client));
+  }//end-for.
+
+  // Start once everything is connected.
+  EventLoop::TimerId poll = -1;
+  long long start = 0;
+  poll = loop.RunEvery(0.001, [&]() {
+    if (connected < connections) return;
+    loop.Cancel(poll);
+    char msg[kMsgSize] = {0};
+    for (size_t i = 0; i < clients.size(); ++i) {
+      for (int j = 0; j < depth; ++j) clients[i]->conn->Send(msg, sizeof(msg));
+    }
+    start = done;
+    loop.RunAfter(seconds, [&loop]() { loop.Quit(); });
+  });
+  loop.Loop();
+  printf("%-6s %.0f messages/s\n", name, static_cast<double>(done - start) / seconds);
+
+  for (size_t i = 0; i < clients.size(); ++i) {
+    clients[i]->connector->Stop();
+    if (clients[i]->conn) clients[i]->conn->ConnectDestroyed();
+  }//end-for.
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  int connections = argc > 1 ? atoi(argv[1]) : 4;
+  int depth = argc > 2 ? atoi(argv[2]) : 16;
+  int seconds = argc > 3 ? atoi(argv[3]) : 3;
+  int port = argc > 4 ? atoi(argv[4]) : 19610;
+
+  EventLoop loop;
+  Measure(loop, "tcp", false, connections, depth, seconds, port);
+  Measure(loop, "unix", true, connections, depth, seconds, port);
+  // Let the stopped connectors finish.
+  loop.RunAfter(0.01, [&loop]() { loop.Quit(); });
+  loop.Loop();
+  return 0;
+}
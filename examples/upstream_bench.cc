@@ -0,0 +1,182 @@
+// Upstream pool benchmark.
+//
+// B echo backends and a client on one loop. The client keeps D requests
+// of 64 bytes in flight, each answered by its echo, either through an
+// UpstreamPool of persistent connections or over a fresh connection per
+// request, handshake and close included. Reports requests per second and
+// how evenly the pool spread them.
+//
+//   upstream_bench [backends] [depth] [seconds] [port]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "cromwell/acceptor.h"
+#include "cromwell/connector.h"
+#include "cromwell/event_loop.h"
+#include "cromwell/se.h"
+#include "cromwell/tcp_connection.h"
+#include "cromwell/upstream_pool.h"
+
+using namespace cromwell;
+
+namespace {
+
+const size_t kRequestSize = 64;
+
+struct Stats {
+  long long done;
+  std::map<int, long long> per_port;
+};
+
+void OnEcho(SeEventLoop* loop, int fd, void* client, int mask) {
+  char buf[4096];
+  ssize_t n = read(fd, buf, sizeof(buf));
+  if (n > 0) {
+    if (write(fd, buf, static_cast<size_t>(n)) != n) perror("echo write");
+  } else if (n == 0) {
+    SeDeleteFileEvent(loop, fd, SE_READABLE);
+    close(fd);
+  }
+}
+
+void OnBackendConnection(EventLoop& loop, int fd, const char* ip, int port) {
+  if (SeCreateFileEvent(loop.se_loop(), fd, SE_READABLE, OnEcho, NULL) == SE_ERR) {
+    close(fd);
+  }
+}
+
+// Every whole echo ends one request and starts the next.
+void RunPooled(EventLoop& loop, int backends, int depth, int seconds, int port) {
+  UpstreamPool pool(loop, 2);
+  for (int i = 0; i < backends; ++i) pool.AddBackend("127.0.0.1", port + i);
+  Stats stats;
+  stats.done = 0;
+  char request[kRequestSize] = {0};
+  pool.SetConnectionCallback([&pool, &stats, &request](const TcpConnectionPtr& conn) {
+    if (!conn->Connected()) return;
+    conn->SetMessageCallback([&pool, &stats, &request](TcpConnection* c, FastBuffer* buf, long long receive_time) {
+      while (buf->GetReadingSize() >= kRequestSize) {
+        buf->DrainReading(kRequestSize);
+        pool.Release(c);
+        ++stats.done;
+        ++stats.per_port[c->PeerPort()];
+        TcpConnection* next = pool.Acquire();
+        if (next) next->Send(request, sizeof(request));
+      }
+    });
+  });
+  pool.Start();
+
+  // Start once everything is connected.
+  int expected = backends * 2;
+  EventLoop::TimerId poll = -1;
+  poll = loop.RunEvery(0.001, [&]() {
+    if (pool.Connected() < expected) return;
+    loop.Cancel(poll);
+    for (int i = 0; i < depth; ++i) {
+      TcpConnection* conn = pool.Acquire();
+      if (conn) conn->Send(request, sizeof(request));
+    }
+    loop.RunAfter(seconds, [&loop]() { loop.Quit(); });
+  });
+  loop.Loop();
+
+  printf("%-10s %.0f requests/s, per backend:", "pooled", static_cast<double>(stats.done) / seconds);
+  for (std::map<int, long long>::iterator it = stats.per_port.begin(); it != stats.per_port.end(); ++it) {
+    printf(" %lld", it->second);
+  }
+  printf("\n");
+  pool.Stop();
+}
+
+struct OneShot {
+  EventLoop* loop;
+  int port;
+  long long* done;
+  std::shared_ptr<Connector> connector;
+  TcpConnectionPtr conn;
+};
+
+// A request over a connection of its own, then the next one.
+void StartOneShot(OneShot* shot, int backend) {
+  shot->connector = std::make_shared<Connector>(*shot->loop, "127.0.0.1", shot->port + backend);
+  shot->connector->SetNewConnectionCallback([shot, backend](int sockfd) {
+    shot->conn.Reset(new TcpConnection(*shot->loop, sockfd, "127.0.0.1", shot->port + backend));
+    shot->conn->SetTcpNoDelay(true);
+    shot->conn->SetMessageCallback([shot](TcpConnection* c, FastBuffer* buf, long long receive_time) {
+      if (buf->GetReadingSize() < kRequestSize) return;
+      buf->DrainReading(buf->GetReadingSize());
+      ++*shot->done;
+      c->ForceClose();
+    });
+    shot->conn->SetCloseCallback([shot, backend](const TcpConnectionPtr& c) {
+      c->ConnectDestroyed();
+      TcpConnectionPtr keep = shot->conn;
+      shot->loop->QueueInLoop([keep]() {});
+      shot->conn.Reset();
+      StartOneShot(shot, backend);
+    });
+    shot->conn->ConnectEstablished();
+    char request[kRequestSize] = {0};
+    shot->conn->Send(request, sizeof(request));
+  });
+  shot->connector->Start();
+}
+
+void RunOneShot(EventLoop& loop, int backends, int depth, int seconds, int port) {
+  long long done = 0;
+  std::vector<std::unique_ptr<OneShot> > shots;
+  for (int i = 0; i < depth; ++i) {
+    std::unique_ptr<OneShot> shot(new OneShot());
+    shot->loop = &loop;
+    shot->port = port;
+    shot->done = &done;
+    StartOneShot(shot.get(), i % backends);
+    shots.push_back(std::move(shot));
+  }
+  loop.RunAfter(seconds, [&loop]() { loop.Quit(); });
+  loop.Loop();
+  printf("%-10s %.0f requests/s\n", "handshake", static_cast<double>(done) / seconds);
+  for (size_t i = 0; i < shots.size(); ++i) {
+    shots[i]->connector->SetNewConnectionCallback(Connector::NewConnectionCallback());
+    shots[i]->connector->Stop();
+    if (shots[i]->conn) {
+      shots[i]->conn->SetCloseCallback(TcpConnection::CloseCallback());
+      shots[i]->conn->ConnectDestroyed();
+    }
+  }
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  int backends = argc > 1 ? atoi(argv[1]) : 4;
+  int depth = argc > 2 ? atoi(argv[2]) : 16;
+  int seconds = argc > 3 ? atoi(argv[3]) : 3;
+  int port = argc > 4 ? atoi(argv[4]) : 19540;
+
+  EventLoop loop;
+  std::vector<std::unique_ptr<Acceptor> > acceptors;
+  for (int i = 0; i < backends; ++i) {
+    std::unique_ptr<Acceptor> acceptor(new Acceptor(loop, "127.0.0.1", port + i, false));
+    acceptor->SetNewConnectionCallback(OnBackendConnection);
+    if (!acceptor->Listen()) {
+      perror("listen");
+      return 1;
+    }
+    acceptors.push_back(std::move(acceptor));
+  }
+
+  RunPooled(loop, backends, depth, seconds, port);
+  RunOneShot(loop, backends, depth, seconds, port);
+  // Let the stopped connectors finish.
+  loop.RunAfter(0.01, [&loop]() { loop.Quit(); });
+  loop.Loop();
+  return 0;
+}
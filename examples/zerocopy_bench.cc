@@ -0,0 +1,128 @@
+// Zero copy send benchmark.
+//
+// One connection sends messages of N megabytes back to back, each built
+// in a FastBuffer and handed over with Send, either copied into the
+// kernel or with MSG_ZEROCOPY. Reports throughput, the CPU time the
+// process spent per gigabyte, and how many zero copy sends the kernel
+// reported as copied anyway. Over loopback it always copies, and the
+// connection falls back to plain sends after the first completion; give
+// a host and port of a discarding sink (e.g. nc -l 9000 >/dev/null on
+// another machine) to measure a real device.
+//
+//   zerocopy_bench [megabytes] [seconds] [host port]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+
+#include <vector>
+
+#include "cromwell/event_loop.h"
+#include "cromwell/socket_opt.h"
+#include "cromwell/tcp_connection.h"
+
+using namespace cromwell;
+
+namespace {
+
+const size_t kThreshold = 64 * 1024;
+
+double CpuSeconds() {
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+  return static_cast<double>(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) +
+    static_cast<double>(ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+}
+
+// A connected pair of loopback TCP sockets.
+bool LoopbackPair(int sv[2]) {
+  char err[SOCKET_ERR_LEN];
+  int listener = tcp_listen(err, "127.0.0.1", 0, false);
+  if (listener < 0) {
+    fprintf(stderr, "%s\n", err);
+    return false;
+  }
+  struct sockaddr_in addr;
+  socklen_t len = sizeof(addr);
+  getsockname(listener, reinterpret_cast<struct sockaddr*>(&addr), &len);
+  sv[0] = tcp_connect(err, "127.0.0.1", ntohs(addr.sin_port));
+  sv[1] = accept(listener, nullptr, nullptr);
+  close(listener);
+  if (sv[0] < 0 || sv[1] < 0) return false;
+  nonblock(nullptr, sv[0]);
+  nonblock(nullptr, sv[1]);
+  return true;
+}
+
+void Run(bool zero_copy, size_t size, int seconds, const char* host, int port) {
+  EventLoop loop;
+  int sv[2] = {-1, -1};
+  if (host) {
+    char err[SOCKET_ERR_LEN];
+    sv[0] = tcp_connect(err, host, port);
+    if (sv[0] < 0) {
+      fprintf(stderr, "%s\n", err);
+      exit(1);
+    }
+    nonblock(nullptr, sv[0]);
+  } else if (!LoopbackPair(sv)) {
+    exit(1);
+  }
+  TcpConnectionPtr server(new TcpConnection(loop, sv[0], "server", 0));
+  TcpConnectionPtr client;
+  if (zero_copy && !server->SetZeroCopyThreshold(kThreshold)) {
+    fprintf(stderr, "SO_ZEROCOPY refused\n");
+  }
+
+  std::vector<char> message(size, 'z');
+  long long sent = 0;
+  server->SetWriteCompleteCallback([&message, &sent](TcpConnection* conn) {
+    FastBuffer buf;
+    buf.Write(message.data(), message.size());
+    conn->Send(&buf);
+    sent += static_cast<long long>(message.size());
+  });
+  server->ConnectEstablished();
+  if (sv[1] >= 0) {
+    client.Reset(new TcpConnection(loop, sv[1], "client", 0));
+    client->SetMessageCallback([](TcpConnection* conn, FastBuffer* buf, long long receive_time) {
+      buf->DrainReading(buf->GetReadingSize());
+    });
+    client->ConnectEstablished();
+  }
+
+  double cpu = CpuSeconds();
+  FastBuffer first;
+  first.Write(message.data(), message.size());
+  server->Send(&first);
+  loop.RunAfter(seconds, [&loop]() { loop.Quit(); });
+  loop.Loop();
+  cpu = CpuSeconds() - cpu;
+
+  double gb = static_cast<double>(sent) / 1e9;
+  printf("%-9s %.0fMB/s cpu=%.2fs/GB zerocopy_sends=%lld copied=%lld\n",
+      zero_copy ? "zerocopy" : "copy", static_cast<double>(sent) / seconds / 1e6,
+      gb > 0 ? cpu / gb : 0.0, server->ZeroCopySends(), server->ZeroCopyCopied());
+
+  server->ConnectDestroyed();
+  if (client) client->ConnectDestroyed();
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  size_t mb = argc > 1 ? static_cast<size_t>(atol(argv[1])) : 4;
+  int seconds = argc > 2 ? atoi(argv[2]) : 3;
+  const char* host = argc > 4 ? argv[3] : nullptr;
+  int port = argc > 4 ? atoi(argv[4]) : 0;
+
+  Run(false, mb * 1024 * 1024, seconds, host, port);
+  Run(true, mb * 1024 * 1024, seconds, host, port);
+  return 0;
+}
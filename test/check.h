@@ -0,0 +1,26 @@
+#ifndef __CROMWELL_TEST_CHECK_H
+#define __CROMWELL_TEST_CHECK_H
+
+#include <stdio.h>
+
+// The test programs check with CHECK, which reports a failed condition
+// and keeps going, and exit with Failures() so ctest sees them fail.
+
+namespace cromwell {
+
+inline int& Failures() {
+  static int failures = 0;
+  return failures;
+}
+
+}//end-cromwell.
+
+#define CHECK(cond) \
+  do { \
+    if (!(cond)) { \
+      fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); \
+      ++cromwell::Failures(); \
+    } \
+  } while (0)
+
+#endif
@@ -0,0 +1,220 @@
+// Dispatch budget tests: an fd that used up its budget gets exactly its
+// budget per iteration and is dispatched again from the carry list
+// without the kernel reporting it, edge triggered included; the carried
+// fd runs after the fds polled ready and only once when it is polled
+// ready too; classes run in order; a carried fd that is removed is not
+// dispatched, and its class and budget go with it.
+//
+//   se_carry_test
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <vector>
+
+#include "cromwell/se.h"
+#include "test/check.h"
+
+using namespace cromwell;
+
+namespace {
+
+std::vector<int> order; // fds in dispatch order
+
+struct Reader {
+  int fd;
+  int peer;
+  int calls;
+  int bytes; // read in the last call
+  int total;
+};
+
+// One byte, one unit, until the budget is used up or the fd is dry.
+void OnRead(SeEventLoop* loop, int fd, void* client, int mask) {
+  Reader* r = static_cast<Reader*>(client);
+  order.push_back(fd);
+  ++r->calls;
+  r->bytes = 0;
+  for (;;) {
+    char c;
+    if (read(fd, &c, 1) != 1) break;
+    ++r->bytes;
+    ++r->total;
+    if (SeChargeFileEvent(loop, fd, SE_READABLE, 1)) break;
+  }//end-for.
+}
+
+bool Open(Reader* r) {
+  int sv[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv) == -1) {
+    perror("socketpair");
+    return false;
+  }
+  r->fd = sv[0];
+  r->peer = sv[1];
+  r->calls = r->bytes = r->total = 0;
+  return true;
+}
+
+void Close(SeEventLoop* loop, Reader* r) {
+  SeDeleteFileEvent(loop, r->fd, SE_READABLE);
+  close(r->fd);
+  close(r->peer);
+}
+
+void Fill(Reader* r, int bytes) {
+  char buf[256];
+  memset(buf, 'x', sizeof(buf));
+  while (bytes > 0) {
+    int n = bytes < static_cast<int>(sizeof(buf)) ? bytes : static_cast<int>(sizeof(buf));
+    if (write(r->peer, buf, static_cast<size_t>(n)) != n) perror("write");
+    bytes -= n;
+  }//end-while.
+}
+
+void Iterate(SeEventLoop* loop) {
+  order.clear();
+  SeProcessEvents(loop, SE_FILE_EVENTS | SE_DONT_WAIT);
+}
+
+// flags is SE_EDGE or 0.
+void TestBudget(SeEventLoop* loop, int flags) {
+  Reader r;
+  if (!Open(&r)) {
+    CHECK(false);
+    return;
+  }
+  CHECK(SeCreateFileEvent(loop, r.fd, SE_READABLE | flags, OnRead, &r) == SE_OK);
+  CHECK(SeSetFileEventClass(loop, r.fd, SE_PRIO_BULK, 10) == SE_OK);
+  Fill(&r, 100);
+  for (int i = 1; i <= 10; ++i) {
+    Iterate(loop);
+    // Once per iteration, polled ready and carried alike.
+    CHECK(r.calls == i);
+    CHECK(r.bytes == 10);
+  }//end-for.
+  CHECK(r.total == 100);
+  // The last full budget leaves it carried once more, to find it dry.
+  Iterate(loop);
+  Iterate(loop);
+  CHECK(r.calls == 11);
+  CHECK(r.total == 100);
+  Close(loop, &r);
+}
+
+void TestCarriedRunsLast(SeEventLoop* loop, int flags) {
+  Reader a, b;
+  if (!Open(&a) || !Open(&b)) {
+    CHECK(false);
+    return;
+  }
+  CHECK(SeCreateFileEvent(loop, a.fd, SE_READABLE | flags, OnRead, &a) == SE_OK);
+  CHECK(SeSetFileEventClass(loop, a.fd, SE_PRIO_INTERACTIVE, 1) == SE_OK);
+  CHECK(SeCreateFileEvent(loop, b.fd, SE_READABLE, OnRead, &b) == SE_OK);
+  CHECK(SeSetFileEventClass(loop, b.fd, SE_PRIO_INTERACTIVE, 1) == SE_OK);
+  Fill(&a, 5);
+  Fill(&b, 5);
+  Iterate(loop);
+  CHECK(order.size() == 2);
+  // Both out of budget: b polled ready again, a carried, a after b.
+  for (int i = 0; i < 3; ++i) {
+    Iterate(loop);
+    CHECK(order.size() == 2);
+    if (order.size() == 2 && flags == SE_EDGE) {
+      CHECK(order[0] == b.fd);
+      CHECK(order[1] == a.fd);
+    }
+  }//end-for.
+  Close(loop, &a);
+  Close(loop, &b);
+}
+
+void TestClasses(SeEventLoop* loop) {
+  const int classes[] = {SE_PRIO_BULK, SE_PRIO_INTERACTIVE, SE_PRIO_CONTROL};
+  Reader r[3];
+  for (int i = 0; i < 3; ++i) {
+    if (!Open(&r[i])) {
+      CHECK(false);
+      return;
+    }
+    CHECK(SeCreateFileEvent(loop, r[i].fd, SE_READABLE, OnRead, &r[i]) == SE_OK);
+    CHECK(SeSetFileEventClass(loop, r[i].fd, classes[i], 0) == SE_OK);
+    Fill(&r[i], 1);
+  }//end-for.
+  Iterate(loop);
+  CHECK(order.size() == 3);
+  if (order.size() == 3) {
+    CHECK(order[0] == r[2].fd);
+    CHECK(order[1] == r[1].fd);
+    CHECK(order[2] == r[0].fd);
+  }
+  for (int i = 0; i < 3; ++i) Close(loop, &r[i]);
+}
+
+void TestRemoveCarried(SeEventLoop* loop, int flags) {
+  Reader r;
+  if (!Open(&r)) {
+    CHECK(false);
+    return;
+  }
+  CHECK(SeCreateFileEvent(loop, r.fd, SE_READABLE | flags, OnRead, &r) == SE_OK);
+  CHECK(SeSetFileEventClass(loop, r.fd, SE_PRIO_INTERACTIVE, 4) == SE_OK);
+  Fill(&r, 40);
+  Iterate(loop);
+  CHECK(r.bytes == 4);
+
+  // Removed while carried: not dispatched.
+  SeDeleteFileEvent(loop, r.fd, SE_READABLE);
+  Iterate(loop);
+  CHECK(r.calls == 1);
+
+  // Registered anew, it starts without a budget.
+  CHECK(SeCreateFileEvent(loop, r.fd, SE_READABLE, OnRead, &r) == SE_OK);
+  Iterate(loop);
+  CHECK(r.calls == 2);
+  CHECK(r.bytes == 36);
+  CHECK(r.total == 40);
+
+  // Removed while carried and registered again before the next poll,
+  // with nothing left to read: the old carry must not fire.
+  CHECK(SeSetFileEventClass(loop, r.fd, SE_PRIO_INTERACTIVE, 4) == SE_OK);
+  Fill(&r, 40);
+  Iterate(loop);
+  CHECK(r.calls == 3);
+  SeDeleteFileEvent(loop, r.fd, SE_READABLE);
+  char buf[64];
+  while (read(r.fd, buf, sizeof(buf)) > 0) {}
+  CHECK(SeCreateFileEvent(loop, r.fd, SE_READABLE | flags, OnRead, &r) == SE_OK);
+  Iterate(loop);
+  CHECK(r.calls == 3);
+  Close(loop, &r);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  SeEventLoop* loop = SeCreateEventLoop(64);
+  if (loop == NULL) {
+    perror("SeCreateEventLoop");
+    return 1;
+  }
+  // Edge triggered fds depend on the carry list most; the layers without
+  // them run the level triggered cases only.
+  std::vector<int> flags(1, 0);
+  if (strcmp(SeGetApiName(loop), "epoll") == 0) flags.push_back(SE_EDGE);
+  for (size_t i = 0; i < flags.size(); ++i) {
+    TestBudget(loop, flags[i]);
+    TestCarriedRunsLast(loop, flags[i]);
+    TestRemoveCarried(loop, flags[i]);
+  }//end-for.
+  TestClasses(loop);
+  SeDeleteEventLoop(loop);
+  if (Failures()) {
+    fprintf(stderr, "se_carry_test: %d failed\n", Failures());
+    return 1;
+  }
+  printf("se_carry_test: ok\n");
+  return 0;
+}
@@ -0,0 +1,306 @@
+// Change list tests: interest changes made between two polls collapse to
+// the net mask, which is what the kernel ends up with, add/del/add and
+// del/add/del within one iteration included, and every change that
+// needed no syscall is counted as saved. The kernel side is read back
+// from /proc/self/fdinfo of the epoll fd. On epoll and io_uring alike, an
+// fd closed and its number reused before the next poll does not inherit
+// the old registration.
+//
+//   se_change_test
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <vector>
+
+#include "cromwell/se.h"
+#include "test/check.h"
+
+using namespace cromwell;
+
+namespace {
+
+int epoll_fd = -1;
+
+// The only epoll instance of the process, the loop's.
+int FindEpollFd() {
+  DIR* dir = opendir("/proc/self/fd");
+  if (dir == NULL) return -1;
+  int found = -1;
+  struct dirent* entry;
+  while ((entry = readdir(dir)) != NULL) {
+    char path[300], link[64];
+    snprintf(path, sizeof(path), "/proc/self/fd/%s", entry->d_name);
+    ssize_t n = readlink(path, link, sizeof(link) - 1);
+    if (n <= 0) continue;
+    link[n] = '\0';
+    if (strcmp(link, "anon_inode:[eventpoll]") == 0) found = atoi(entry->d_name);
+  }//end-while.
+  closedir(dir);
+  return found;
+}
+
+// The mask fd is registered with in the kernel, SE_NONE if it is not.
+int KernelMask(int fd) {
+  char path[64], line[256];
+  snprintf(path, sizeof(path), "/proc/self/fdinfo/%d", epoll_fd);
+  FILE* f = fopen(path, "r");
+  if (f == NULL) return -1;
+  int mask = SE_NONE;
+  while (fgets(line, sizeof(line), f)) {
+    int tfd;
+    unsigned int events;
+    if (sscanf(line, "tfd: %d events: %x", &tfd, &events) != 2 || tfd != fd) continue;
+    if (events & 0x1) mask |= SE_READABLE; // EPOLLIN
+    if (events & 0x4) mask |= SE_WRITABLE; // EPOLLOUT
+  }//end-while.
+  fclose(f);
+  return mask;
+}
+
+struct Peer {
+  int fd;
+  int reads;
+  int writes;
+  // Run from the readable callback, within the iteration.
+  void (*toggle)(SeEventLoop* loop, Peer* peer);
+};
+
+void OnPeer(SeEventLoop* loop, int fd, void* client, int mask) {
+  Peer* peer = static_cast<Peer*>(client);
+  if (mask & SE_READABLE) {
+    char buf[64];
+    if (read(fd, buf, sizeof(buf)) > 0) ++peer->reads;
+    if (peer->toggle) peer->toggle(loop, peer);
+  }
+  if ((mask & SE_WRITABLE) && (SeGetFileEvents(loop, fd) & SE_WRITABLE)) ++peer->writes;
+}
+
+void DelAddWrite(SeEventLoop* loop, Peer* peer) {
+  SeDeleteFileEvent(loop, peer->fd, SE_WRITABLE);
+  SeCreateFileEvent(loop, peer->fd, SE_WRITABLE, OnPeer, peer);
+}
+
+void DelAddDelWrite(SeEventLoop* loop, Peer* peer) {
+  SeDeleteFileEvent(loop, peer->fd, SE_WRITABLE);
+  SeCreateFileEvent(loop, peer->fd, SE_WRITABLE, OnPeer, peer);
+  SeDeleteFileEvent(loop, peer->fd, SE_WRITABLE);
+}
+
+// Removed for good and registered anew, both right away.
+void ReRegister(SeEventLoop* loop, Peer* peer) {
+  SeDeleteFileEvent(loop, peer->fd, SE_READABLE | SE_WRITABLE);
+  SeCreateFileEvent(loop, peer->fd, SE_READABLE, OnPeer, peer);
+}
+
+void Iterate(SeEventLoop* loop) {
+  SeProcessEvents(loop, SE_FILE_EVENTS | SE_DONT_WAIT);
+}
+
+void Poke(int fd) {
+  if (write(fd, "x", 1) != 1) perror("write");
+}
+
+void TestCollapse(SeEventLoop* loop) {
+  int sv[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv) == -1) {
+    perror("socketpair");
+    CHECK(false);
+    return;
+  }
+  Peer peer = {sv[0], 0, 0, NULL};
+  CHECK(SeCreateFileEvent(loop, sv[0], SE_READABLE, OnPeer, &peer) == SE_OK);
+  CHECK(KernelMask(sv[0]) == SE_READABLE);
+
+  // add/del between two polls: nothing reaches the kernel.
+  long long saved = SeGetSavedChanges(loop);
+  SeCreateFileEvent(loop, sv[0], SE_WRITABLE, OnPeer, &peer);
+  SeDeleteFileEvent(loop, sv[0], SE_WRITABLE);
+  Iterate(loop);
+  CHECK(KernelMask(sv[0]) == SE_READABLE);
+  CHECK(SeGetSavedChanges(loop) - saved == 2);
+  CHECK(peer.writes == 0);
+
+  // add/del/add: one syscall for three changes.
+  saved = SeGetSavedChanges(loop);
+  SeCreateFileEvent(loop, sv[0], SE_WRITABLE, OnPeer, &peer);
+  SeDeleteFileEvent(loop, sv[0], SE_WRITABLE);
+  SeCreateFileEvent(loop, sv[0], SE_WRITABLE, OnPeer, &peer);
+  Iterate(loop);
+  CHECK(KernelMask(sv[0]) == (SE_READABLE | SE_WRITABLE));
+  CHECK(SeGetSavedChanges(loop) - saved == 2);
+  CHECK(peer.writes == 1);
+
+  // del/add from a callback, within the iteration: no syscall.
+  peer.toggle = DelAddWrite;
+  saved = SeGetSavedChanges(loop);
+  Poke(sv[1]);
+  Iterate(loop);
+  Iterate(loop);
+  CHECK(peer.reads == 1);
+  CHECK(KernelMask(sv[0]) == (SE_READABLE | SE_WRITABLE));
+  CHECK(SeGetSavedChanges(loop) - saved == 2);
+
+  // del/add/del from a callback: writable goes, with one syscall.
+  peer.toggle = DelAddDelWrite;
+  saved = SeGetSavedChanges(loop);
+  Poke(sv[1]);
+  Iterate(loop);
+  Iterate(loop);
+  CHECK(peer.reads == 2);
+  CHECK(KernelMask(sv[0]) == SE_READABLE);
+  CHECK(SeGetSavedChanges(loop) - saved == 2);
+  int writes = peer.writes;
+  Iterate(loop);
+  CHECK(peer.writes == writes);
+
+  // A full removal and a new registration in one callback.
+  peer.toggle = ReRegister;
+  Poke(sv[1]);
+  Iterate(loop);
+  CHECK(peer.reads == 3);
+  CHECK(KernelMask(sv[0]) == SE_READABLE);
+  peer.toggle = NULL;
+  Poke(sv[1]);
+  Iterate(loop);
+  CHECK(peer.reads == 4);
+
+  // A queued change dropped by a full removal must not resurrect the fd.
+  SeCreateFileEvent(loop, sv[0], SE_WRITABLE, OnPeer, &peer);
+  SeDeleteFileEvent(loop, sv[0], SE_READABLE | SE_WRITABLE);
+  Iterate(loop);
+  CHECK(KernelMask(sv[0]) == SE_NONE);
+  CHECK(SeGetFileEvents(loop, sv[0]) == SE_NONE);
+  close(sv[0]);
+  close(sv[1]);
+}
+
+// Many fds toggled at random between polls: the kernel always ends up
+// with what the loop thinks is registered.
+void TestNetMask(SeEventLoop* loop) {
+  const int kPairs = 64;
+  std::vector<Peer> peers(kPairs);
+  std::vector<int> others(kPairs);
+  for (int i = 0; i < kPairs; ++i) {
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv) == -1) {
+      perror("socketpair");
+      CHECK(false);
+      return;
+    }
+    peers[i].fd = sv[0];
+    peers[i].reads = peers[i].writes = 0;
+    peers[i].toggle = NULL;
+    others[i] = sv[1];
+  }//end-for.
+
+  unsigned int x = 2463534242u;
+  for (int round = 0; round < 200; ++round) {
+    for (int k = 0; k < 3 * kPairs; ++k) {
+      x ^= x << 13;
+      x ^= x >> 17;
+      x ^= x << 5;
+      Peer* peer = &peers[x % kPairs];
+      int mask = (x >> 8) % 3 + 1;
+      if ((x >> 16) & 1) {
+        SeCreateFileEvent(loop, peer->fd, mask, OnPeer, peer);
+      } else {
+        SeDeleteFileEvent(loop, peer->fd, mask);
+      }
+    }//end-for.
+    Iterate(loop);
+    for (int i = 0; i < kPairs; ++i) {
+      CHECK(KernelMask(peers[i].fd) == SeGetFileEvents(loop, peers[i].fd));
+    }//end-for.
+  }//end-for.
+
+  for (int i = 0; i < kPairs; ++i) {
+    SeDeleteFileEvent(loop, peers[i].fd, SE_READABLE | SE_WRITABLE);
+    close(peers[i].fd);
+    close(others[i]);
+  }//end-for.
+}
+
+struct Counter {
+  int calls;
+};
+
+void OnCount(SeEventLoop* loop, int fd, void* client, int mask) {
+  char buf[64];
+  if (read(fd, buf, sizeof(buf)) > 0) ++static_cast<Counter*>(client)->calls;
+}
+
+// An fd removed and closed, its number taken by a new fd registered with
+// the same mask before the next poll: the new fd gets its events, and the
+// old socket is really closed.
+void TestReuse(SeEventLoop* loop) {
+  int old_sv[2], sv[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, old_sv) == -1) {
+    perror("socketpair");
+    CHECK(false);
+    return;
+  }
+  Counter old_counter = {0}, counter = {0};
+  int fd = old_sv[0];
+  CHECK(SeCreateFileEvent(loop, fd, SE_READABLE, OnCount, &old_counter) == SE_OK);
+  Iterate(loop);
+  SeDeleteFileEvent(loop, fd, SE_READABLE);
+  close(fd);
+
+  if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv) == -1) {
+    perror("socketpair");
+    CHECK(false);
+    close(old_sv[1]);
+    return;
+  }
+  if (sv[0] != fd) {
+    CHECK(dup2(sv[0], fd) == fd);
+    close(sv[0]);
+  }
+  CHECK(SeCreateFileEvent(loop, fd, SE_READABLE, OnCount, &counter) == SE_OK);
+  Poke(sv[1]);
+  for (int i = 0; i < 3 && counter.calls == 0; ++i) Iterate(loop);
+  CHECK(counter.calls == 1);
+  CHECK(old_counter.calls == 0);
+  char c;
+  CHECK(read(old_sv[1], &c, 1) == 0);
+
+  SeDeleteFileEvent(loop, fd, SE_READABLE);
+  close(fd);
+  close(sv[1]);
+  close(old_sv[1]);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  SeEventLoop* loop = SeCreateEventLoop(1024);
+  if (loop == NULL) {
+    perror("SeCreateEventLoop");
+    return 1;
+  }
+  TestReuse(loop);
+  if (strcmp(SeGetApiName(loop), "epoll") == 0 && (epoll_fd = FindEpollFd()) >= 0) {
+    TestCollapse(loop);
+    TestNetMask(loop);
+  } else {
+    printf("se_change_test: kernel masks need epoll, skipped\n");
+  }
+  SeDeleteEventLoop(loop);
+
+  // io_uring defers changes too, to the ring.
+  loop = SeCreateEventLoopWithApi(1024, "io_uring");
+  if (loop != NULL && strcmp(SeGetApiName(loop), "io_uring") == 0) TestReuse(loop);
+  if (loop != NULL) SeDeleteEventLoop(loop);
+
+  if (Failures()) {
+    fprintf(stderr, "se_change_test: %d failed\n", Failures());
+    return 1;
+  }
+  printf("se_change_test: ok\n");
+  return 0;
+}
@@ -0,0 +1,193 @@
+// Cross-thread task queue tests: a burst queued while the loop is idle
+// costs one eventfd write and runs in queue order in one iteration, a
+// task queued by a task waits for the next iteration, and tasks pushed by
+// several threads at once onto the Treiber stack all run exactly once,
+// each producer's in the order it queued them.
+//
+//   se_task_test
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <thread>
+#include <vector>
+
+#include "cromwell/se.h"
+#include "test/check.h"
+
+using namespace cromwell;
+
+namespace {
+
+const int kProducers = 4;
+const int kPerProducer = 50000;
+
+struct Item {
+  SeTask task;
+  int producer;
+  int seq;
+  int runs;
+};
+
+struct Tally {
+  int next[kProducers]; // seq expected from each producer
+  int runs;
+};
+
+Tally tally;
+
+void OnItem(SeEventLoop* loop, void* client) {
+  Item* item = static_cast<Item*>(client);
+  CHECK(item->runs == 0);
+  ++item->runs;
+  CHECK(item->seq == tally.next[item->producer]);
+  tally.next[item->producer] = item->seq + 1;
+  ++tally.runs;
+}
+
+void InitItems(std::vector<Item>* items, int producer) {
+  for (size_t i = 0; i < items->size(); ++i) {
+    Item& item = (*items)[i];
+    item.task.proc = OnItem;
+    item.task.client = &item;
+    item.producer = producer;
+    item.seq = static_cast<int>(i);
+    item.runs = 0;
+  }//end-for.
+}
+
+void ResetTally() {
+  memset(&tally, 0, sizeof(tally));
+}
+
+// Writes to the eventfd not yet read by the loop, -1 without eventfd.
+long long WakeupCount(SeEventLoop* loop) {
+  if (loop->wakeup_fd[0] != loop->wakeup_fd[1]) return -1;
+  char path[64], line[128];
+  snprintf(path, sizeof(path), "/proc/self/fdinfo/%d", loop->wakeup_fd[0]);
+  FILE* f = fopen(path, "r");
+  if (f == NULL) return -1;
+  long long count = -1;
+  while (fgets(line, sizeof(line), f)) {
+    if (sscanf(line, "eventfd-count: %llx", &count) == 1) break;
+  }//end-while.
+  fclose(f);
+  return count;
+}
+
+void Iterate(SeEventLoop* loop) {
+  SeProcessEvents(loop, SE_FILE_EVENTS | SE_DONT_WAIT);
+}
+
+void TestCoalesce(SeEventLoop* loop) {
+  ResetTally();
+  std::vector<Item> items(1000);
+  InitItems(&items, 0);
+  std::thread producer([loop, &items]() {
+    for (size_t i = 0; i < items.size(); ++i) SeQueueInLoop(loop, &items[i].task);
+  });
+  producer.join();
+
+  long long count = WakeupCount(loop);
+  if (count >= 0) CHECK(count == 1);
+  Iterate(loop);
+  CHECK(tally.runs == static_cast<int>(items.size()));
+  if (count >= 0) CHECK(WakeupCount(loop) == 0);
+  // Nothing left behind to wake the loop again.
+  Iterate(loop);
+  CHECK(tally.runs == static_cast<int>(items.size()));
+}
+
+struct Requeue {
+  SeTask task;
+  int runs;
+};
+
+void OnRequeue(SeEventLoop* loop, void* client) {
+  Requeue* r = static_cast<Requeue*>(client);
+  ++r->runs;
+  SeQueueInLoop(loop, &r->task);
+}
+
+void OnNothing(SeEventLoop* loop, void* client) {
+}
+
+void TestRequeue(SeEventLoop* loop) {
+  Requeue r;
+  r.task.proc = OnRequeue;
+  r.task.client = &r;
+  r.runs = 0;
+  SeQueueInLoop(loop, &r.task);
+  for (int i = 1; i <= 3; ++i) {
+    Iterate(loop);
+    CHECK(r.runs == i);
+  }//end-for.
+  // Drain it: the last requeue runs a no-op.
+  r.task.proc = OnNothing;
+  Iterate(loop);
+}
+
+bool timed_out = false;
+
+int OnDeadline(SeEventLoop* loop, long long id, void* client) {
+  timed_out = true;
+  return SE_NOMORE;
+}
+
+void TestProducers(SeEventLoop* loop) {
+  ResetTally();
+  std::vector<std::vector<Item> > items(kProducers, std::vector<Item>(kPerProducer));
+  for (int p = 0; p < kProducers; ++p) InitItems(&items[static_cast<size_t>(p)], p);
+
+  std::vector<std::thread> threads;
+  for (int p = 0; p < kProducers; ++p) {
+    std::vector<Item>* mine = &items[static_cast<size_t>(p)];
+    threads.push_back(std::thread([loop, mine]() {
+      for (size_t i = 0; i < mine->size(); ++i) {
+        SeQueueInLoop(loop, &(*mine)[i].task);
+        if (i % 1024 == 0) std::this_thread::yield();
+      }
+    }));
+  }//end-for.
+
+  // A lost task would leave the loop asleep: give up after a while.
+  long long deadline = SeCreateTimeEvent(loop, 10000, OnDeadline, NULL, NULL);
+  while (tally.runs < kProducers * kPerProducer && !timed_out) {
+    SeProcessEvents(loop, SE_ALL_EVENTS);
+  }//end-while.
+  for (size_t i = 0; i < threads.size(); ++i) threads[i].join();
+  if (!timed_out) SeDeleteTimeEvent(loop, deadline);
+
+  CHECK(!timed_out);
+  CHECK(tally.runs == kProducers * kPerProducer);
+  for (int p = 0; p < kProducers; ++p) {
+    CHECK(tally.next[p] == kPerProducer);
+    for (int i = 0; i < kPerProducer; ++i) CHECK(items[static_cast<size_t>(p)][static_cast<size_t>(i)].runs == 1);
+  }//end-for.
+  if (timed_out) {
+    // Still linked into the loop: it must not run them once they are gone.
+    fprintf(stderr, "se_task_test: %d of %d tasks ran\n", tally.runs, kProducers * kPerProducer);
+    exit(1);
+  }
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  SeEventLoop* loop = SeCreateEventLoop(64);
+  if (loop == NULL) {
+    perror("SeCreateEventLoop");
+    return 1;
+  }
+  TestCoalesce(loop);
+  TestRequeue(loop);
+  TestProducers(loop);
+  SeDeleteEventLoop(loop);
+  if (Failures()) {
+    fprintf(stderr, "se_task_test: %d failed\n", Failures());
+    return 1;
+  }
+  printf("se_task_test: ok\n");
+  return 0;
+}
@@ -0,0 +1,229 @@
+// Timer wheel tests: deadlines spread over the near wheel, the far wheel
+// and the heap fire exactly once and never early or late across the far
+// wheel cascades and the heap migrations, stale ids miss once a slot is
+// reused, and a timer deleted from a callback of the same batch does not
+// run.
+//
+//   se_timer_test
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "cromwell/se.h"
+#include "cromwell/se_timer.h"
+#include "test/check.h"
+
+using namespace cromwell;
+
+namespace {
+
+const long long kMs = 1000000;
+
+struct Deadline {
+  long long when;
+  long long id;
+  int fired;
+};
+
+// xorshift32, a fixed sequence so failures reproduce.
+unsigned int Random() {
+  static unsigned int x = 2463534242u;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return x;
+}
+
+void TestCascade() {
+  long long now = 1000 * kMs;
+  SeTimerWheel* tw = SeTimerCreate(now);
+
+  // Near wheel, its edge, the far wheel, its edge and the heap.
+  const long long offsets[] = {
+    0, 1, kMs / 3, kMs, 5 * kMs, 200 * kMs, 268 * kMs, 269 * kMs, 300 * kMs,
+    1000 * kMs, 5000 * kMs, 60000 * kMs, 68000 * kMs, 69000 * kMs,
+    70000 * kMs, 100000 * kMs, 500000 * kMs, 3600000 * kMs,
+  };
+  std::vector<Deadline> deadlines;
+  for (size_t i = 0; i < sizeof(offsets) / sizeof(offsets[0]); ++i) {
+    Deadline d = {now + offsets[i], 0, 0};
+    deadlines.push_back(d);
+  }
+  for (int i = 0; i < 2000; ++i) {
+    Deadline d = {now + static_cast<long long>(Random() % 4000000) * kMs / 1000, 0, 0};
+    deadlines.push_back(d);
+  }
+  // Inserted out of order.
+  for (size_t i = deadlines.size() - 1; i > 0; --i) {
+    std::swap(deadlines[i], deadlines[Random() % (i + 1)]);
+  }
+  for (size_t i = 0; i < deadlines.size(); ++i) {
+    SeTimeEvent* te = SeTimerAlloc(tw);
+    CHECK(te != NULL);
+    if (te == NULL) return;
+    te->client = &deadlines[i];
+    CHECK(SeTimerSchedule(tw, te, deadlines[i].when) == SE_OK);
+    deadlines[i].id = te->id;
+  }//end-for.
+  CHECK(SeTimerCount(tw) == static_cast<int>(deadlines.size()));
+
+  // Steps below a tick, around the near wheel span and far beyond it.
+  const long long steps[] = {
+    7 * kMs / 10, 13 * kMs, 257 * kMs, 3300 * kMs, 61000 * kMs,
+  };
+  long long last = 0;
+  for (size_t i = 0; i < deadlines.size(); ++i) last = std::max(last, deadlines[i].when);
+  int fired = 0;
+  for (int round = 0; now <= last; ++round) {
+    long long pending = -1;
+    for (size_t i = 0; i < deadlines.size(); ++i) {
+      if (!deadlines[i].fired && (pending < 0 || deadlines[i].when < pending))
+        pending = deadlines[i].when;
+    }//end-for.
+    long long nearest = SeTimerNearest(tw);
+    CHECK(nearest >= 0 && nearest <= pending);
+
+    long long prev = now;
+    now += steps[round % (sizeof(steps) / sizeof(steps[0]))];
+    SeTimerExpire(tw, now);
+    SeTimeEvent* te;
+    while ((te = SeTimerNextExpired(tw)) != NULL) {
+      Deadline* d = static_cast<Deadline*>(te->client);
+      // Not early, and not missed by an earlier round.
+      CHECK(d->when <= now);
+      CHECK(d->when > prev || prev == 1000 * kMs);
+      CHECK(d->fired == 0);
+      ++d->fired;
+      ++fired;
+      SeTimerRelease(tw, te);
+    }//end-while.
+    for (size_t i = 0; i < deadlines.size(); ++i) {
+      if (deadlines[i].when <= now) CHECK(deadlines[i].fired == 1);
+    }//end-for.
+  }//end-for.
+  CHECK(fired == static_cast<int>(deadlines.size()));
+  CHECK(SeTimerCount(tw) == 0);
+  CHECK(SeTimerNearest(tw) < 0);
+  SeTimerFree(tw);
+}
+
+void TestIdReuse() {
+  SeTimerWheel* tw = SeTimerCreate(0);
+  std::vector<long long> stale;
+  for (int i = 0; i < 1000; ++i) {
+    SeTimeEvent* te = SeTimerAlloc(tw);
+    CHECK(te != NULL);
+    if (te == NULL) break;
+    long long id = te->id;
+    CHECK(SeTimerFind(tw, id) == te);
+    for (size_t j = 0; j < stale.size(); ++j) CHECK(id != stale[j]);
+    SeTimerSchedule(tw, te, (i % 3) * 100000 * kMs);
+    SeTimerCancel(tw, te);
+    SeTimerRelease(tw, te);
+    CHECK(SeTimerFind(tw, id) == NULL);
+    stale.push_back(id);
+  }//end-for.
+  // A live timer is not reachable through an id its slot had before.
+  SeTimeEvent* te = SeTimerAlloc(tw);
+  for (size_t j = 0; j < stale.size(); ++j) CHECK(SeTimerFind(tw, stale[j]) != te);
+  SeTimerRelease(tw, te);
+  SeTimerFree(tw);
+}
+
+struct Pair {
+  long long ids[2];
+  int runs[2];
+  int finalized[2];
+};
+
+int OnPairFirst(SeEventLoop* loop, long long id, void* client);
+int OnPairSecond(SeEventLoop* loop, long long id, void* client);
+
+// Whichever of the two runs first deletes the other, due in the same batch.
+int OnPair(SeEventLoop* loop, int self, void* client) {
+  Pair* pair = static_cast<Pair*>(client);
+  ++pair->runs[self];
+  CHECK(SeDeleteTimeEvent(loop, pair->ids[1 - self]) == SE_OK);
+  return SE_NOMORE;
+}
+
+int OnPairFirst(SeEventLoop* loop, long long id, void* client) {
+  return OnPair(loop, 0, client);
+}
+
+int OnPairSecond(SeEventLoop* loop, long long id, void* client) {
+  return OnPair(loop, 1, client);
+}
+
+void OnPairFirstFinalize(SeEventLoop* loop, void* client) {
+  ++static_cast<Pair*>(client)->finalized[0];
+}
+
+void OnPairSecondFinalize(SeEventLoop* loop, void* client) {
+  ++static_cast<Pair*>(client)->finalized[1];
+}
+
+struct Periodic {
+  long long id;
+  int runs;
+  int finalized;
+};
+
+// Deletes itself and still asks to run again.
+int OnSelfDelete(SeEventLoop* loop, long long id, void* client) {
+  Periodic* p = static_cast<Periodic*>(client);
+  ++p->runs;
+  CHECK(SeDeleteTimeEvent(loop, id) == SE_OK);
+  return 1;
+}
+
+void OnPeriodicFinalize(SeEventLoop* loop, void* client) {
+  ++static_cast<Periodic*>(client)->finalized;
+}
+
+void TestCancelDuringDispatch() {
+  SeEventLoop* loop = SeCreateEventLoop(64);
+  CHECK(loop != NULL);
+  if (loop == NULL) return;
+
+  Pair pair = {{0, 0}, {0, 0}, {0, 0}};
+  pair.ids[0] = SeCreateTimeEventNs(loop, 0, OnPairFirst, &pair, OnPairFirstFinalize);
+  pair.ids[1] = SeCreateTimeEventNs(loop, 0, OnPairSecond, &pair, OnPairSecondFinalize);
+  Periodic self = {0, 0, 0};
+  self.id = SeCreateTimeEventNs(loop, 0, OnSelfDelete, &self, OnPeriodicFinalize);
+  for (int i = 0; i < 5; ++i) SeProcessEvents(loop, SE_ALL_EVENTS | SE_DONT_WAIT);
+
+  CHECK(pair.runs[0] + pair.runs[1] == 1);
+  CHECK(pair.finalized[0] == 1 && pair.finalized[1] == 1);
+  CHECK(self.runs == 1);
+  CHECK(self.finalized == 1);
+  // Gone for good, their ids included.
+  CHECK(SeDeleteTimeEvent(loop, pair.ids[0]) == SE_ERR);
+  CHECK(SeDeleteTimeEvent(loop, pair.ids[1]) == SE_ERR);
+  CHECK(SeDeleteTimeEvent(loop, self.id) == SE_ERR);
+
+  // A new timer may take a freed slot; the old id must not reach it.
+  Periodic later = {0, 0, 0};
+  later.id = SeCreateTimeEventNs(loop, 1000 * kMs, OnSelfDelete, &later, OnPeriodicFinalize);
+  CHECK(SeDeleteTimeEvent(loop, self.id) == SE_ERR);
+  CHECK(later.finalized == 0);
+  CHECK(SeDeleteTimeEvent(loop, later.id) == SE_OK);
+  CHECK(later.finalized == 1);
+  SeDeleteEventLoop(loop);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  TestCascade();
+  TestIdReuse();
+  TestCancelDuringDispatch();
+  if (Failures()) {
+    fprintf(stderr, "se_timer_test: %d failed\n", Failures());
+    return 1;
+  }
+  printf("se_timer_test: ok\n");
+  return 0;
+}
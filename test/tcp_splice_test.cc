@@ -0,0 +1,117 @@
+// Spliced region tests: a pipe whose writer closed wakes a reader on
+// every layer, though the kernel reports nothing but a hangup, and a
+// region from a pipe that runs dry and then loses its writer ends early
+// at EOF, and what was queued behind it still goes out.
+//
+//   tcp_splice_test
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <string>
+
+#include "cromwell/event_loop.h"
+#include "cromwell/se.h"
+#include "cromwell/tcp_connection.h"
+#include "test/check.h"
+
+using namespace cromwell;
+
+namespace {
+
+const char kExpected[] = "hello, tail";
+
+struct Peer {
+  EventLoop* loop;
+  std::string received;
+};
+
+void OnPeerReadable(SeEventLoop* loop, int fd, void* client, int mask) {
+  Peer* peer = static_cast<Peer*>(client);
+  char buf[256];
+  ssize_t n;
+  while ((n = read(fd, buf, sizeof(buf))) > 0) peer->received.append(buf, static_cast<size_t>(n));
+  if (peer->received == kExpected) peer->loop->Quit();
+}
+
+void OnHangup(SeEventLoop* loop, int fd, void* client, int mask) {
+  ++*static_cast<int*>(client);
+  SeDeleteFileEvent(loop, fd, SE_READABLE);
+}
+
+void TestHangup(const char* api) {
+  SeEventLoop* loop = SeCreateEventLoopWithApi(64, api);
+  if (loop == NULL) {
+    perror("SeCreateEventLoop");
+    CHECK(false);
+    return;
+  }
+  if (api != NULL && strcmp(SeGetApiName(loop), api) != 0) {
+    SeDeleteEventLoop(loop);
+    return;
+  }
+  int fds[2];
+  if (pipe(fds) == -1) {
+    perror("pipe");
+    CHECK(false);
+    SeDeleteEventLoop(loop);
+    return;
+  }
+  int calls = 0;
+  close(fds[1]);
+  CHECK(SeCreateFileEvent(loop, fds[0], SE_READABLE, OnHangup, &calls) == SE_OK);
+  for (int i = 0; i < 3; ++i) SeProcessEvents(loop, SE_FILE_EVENTS | SE_DONT_WAIT);
+  CHECK(calls == 1);
+  close(fds[0]);
+  SeDeleteEventLoop(loop);
+}
+
+void TestWriterCloses() {
+  int sv[2], source[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv) == -1 || pipe(source) == -1) {
+    perror("socketpair");
+    CHECK(false);
+    return;
+  }
+  EventLoop loop;
+  Peer peer = {&loop, std::string()};
+  CHECK(SeCreateFileEvent(loop.se_loop(), sv[1], SE_READABLE, OnPeerReadable, &peer) == SE_OK);
+
+  TcpConnectionPtr conn(new TcpConnection(loop, sv[0], "", 0));
+  conn->ConnectEstablished();
+  // A short write into a region of 100 bytes: the source runs dry.
+  CHECK(write(source[1], "hello", 5) == 5);
+  CHECK(conn->SendFile(source[0], 0, 100));
+  close(source[0]);
+  conn->Send(", tail", 6);
+
+  bool timed_out = false;
+  loop.RunAfter(0.02, [&source]() { close(source[1]); });
+  loop.RunAfter(2, [&loop, &timed_out]() {
+    timed_out = true;
+    loop.Quit();
+  });
+  loop.Loop();
+
+  CHECK(!timed_out);
+  CHECK(peer.received == kExpected);
+  SeDeleteFileEvent(loop.se_loop(), sv[1], SE_READABLE);
+  conn->ConnectDestroyed();
+  close(sv[1]);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  TestHangup(NULL);
+  TestHangup("io_uring");
+  TestWriterCloses();
+  if (Failures()) {
+    fprintf(stderr, "tcp_splice_test: %d failed\n", Failures());
+    return 1;
+  }
+  printf("tcp_splice_test: ok\n");
+  return 0;
+}